@@ -1,4 +1,7 @@
 #ifndef __ASMARM_AUXVEC_H
 #define __ASMARM_AUXVEC_H
 
+/* Location of the vDSO ELF image, see arch/arm/kernel/vdso.c */
+#define AT_SYSINFO_EHDR		33
+
 #endif
@@ -118,4 +118,19 @@ int dump_task_regs(struct task_struct *t, elf_gregset_t *elfregs);
 extern void elf_set_personality(const struct elf32_hdr *);
 #define SET_PERSONALITY(ex)	elf_set_personality(&(ex))
 
+#ifdef CONFIG_VDSO
+struct linux_binprm;
+
+#define ARCH_HAS_SETUP_ADDITIONAL_PAGES
+extern int arch_setup_additional_pages(struct linux_binprm *bprm,
+				       int uses_interp);
+
+#define ARCH_DLINFO						\
+do {								\
+	if (current->mm->context.vdso)				\
+		NEW_AUX_ENT(AT_SYSINFO_EHDR,			\
+			    current->mm->context.vdso);		\
+} while (0)
+#endif
+
 #endif
@@ -8,6 +8,9 @@ typedef struct {
 	unsigned int id;
 #endif
 	unsigned int kvm_seq;
+#ifdef CONFIG_VDSO
+	unsigned long vdso;
+#endif
 } mm_context_t;
 
 #ifdef CONFIG_CPU_HAS_ASID
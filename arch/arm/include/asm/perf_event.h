@@ -0,0 +1,14 @@
+#ifndef __ASM_ARM_PERF_EVENT_H
+#define __ASM_ARM_PERF_EVENT_H
+
+/*
+ * Pending events are run from the timer tick, there is no NMI context
+ * that would need a self-interrupt to get them going.
+ */
+static inline void set_perf_event_pending(void)
+{
+}
+
+#define PERF_EVENT_INDEX_OFFSET	0
+
+#endif /* __ASM_ARM_PERF_EVENT_H */
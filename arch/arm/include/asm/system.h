@@ -14,6 +14,11 @@
 #define CPU_ARCH_ARMv6		8
 #define CPU_ARCH_ARMv7		9
 
+#ifdef CONFIG_VDSO
+/* AT_SYSINFO_EHDR entry added by ARCH_DLINFO */
+#define AT_VECTOR_SIZE_ARCH	1
+#endif
+
 /*
  * CR1 bits (CP#15 CR1)
  */
@@ -0,0 +1,29 @@
+#ifndef __ASM_ARM_VDSO_H
+#define __ASM_ARM_VDSO_H
+
+/*
+ * Layout of the vDSO area in a process: the data page, then the page
+ * holding the user readable clocksource counter (left unmapped when the
+ * platform has none), then the vDSO text.
+ */
+#define VDSO_DATA_PAGE_OFFSET		0
+#define VDSO_COUNTER_PAGE_OFFSET	PAGE_SIZE
+#define VDSO_TEXT_OFFSET		(2 * PAGE_SIZE)
+
+#ifndef __ASSEMBLY__
+
+struct clocksource;
+
+#ifdef CONFIG_VDSO
+extern void arm_vdso_register_counter(struct clocksource *cs,
+				      unsigned long phys, u32 xor);
+#else
+static inline void arm_vdso_register_counter(struct clocksource *cs,
+					     unsigned long phys, u32 xor)
+{
+}
+#endif
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASM_ARM_VDSO_H */
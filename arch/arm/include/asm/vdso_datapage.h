@@ -0,0 +1,36 @@
+#ifndef __ASM_ARM_VDSO_DATAPAGE_H
+#define __ASM_ARM_VDSO_DATAPAGE_H
+
+#ifndef __ASSEMBLY__
+
+#include <linux/types.h>
+
+/*
+ * Timekeeping data shared with the vDSO. The kernel updates it from
+ * update_vsyscall(); readers retry while seq is odd or has changed.
+ *
+ * The counter is read from the counter page at cs_reg_offset and
+ * xor'ed with cs_xor, which lets down counters be presented counting
+ * up the way the clocksource core sees them. cs_valid is clear while
+ * the current clocksource cannot be read from user space.
+ */
+struct vdso_data {
+	u32 seq;
+	u32 cs_valid;
+	u64 cs_cycle_last;
+	u64 cs_mask;
+	u32 cs_mult;
+	u32 cs_shift;
+	u32 cs_reg_offset;
+	u32 cs_xor;
+	u32 xtime_sec;
+	u32 xtime_nsec;
+	u32 wtm_sec;
+	u32 wtm_nsec;
+	u32 tz_minuteswest;
+	u32 tz_dsttime;
+};
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASM_ARM_VDSO_DATAPAGE_H */
@@ -0,0 +1,132 @@
+/*
+ * Performance event callchain support - ARM architecture code
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The kernel side is walked with walk_stackframe(), so it uses the
+ * unwind tables with CONFIG_ARM_UNWIND and frame pointers otherwise.
+ * The user side follows APCS frame pointers (-mapcs-frame), where fp
+ * points just past the saved {fp, sp, lr} of the caller.
+ */
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/perf_event.h>
+#include <linux/percpu.h>
+#include <linux/uaccess.h>
+#include <asm/stacktrace.h>
+#include <asm/ptrace.h>
+
+static inline void callchain_store(struct perf_callchain_entry *entry, u64 ip)
+{
+	if (entry->nr < PERF_MAX_STACK_DEPTH)
+		entry->ip[entry->nr++] = ip;
+}
+
+static int callchain_trace(struct stackframe *fr, void *data)
+{
+	struct perf_callchain_entry *entry = data;
+
+	callchain_store(entry, fr->pc);
+
+	return entry->nr >= PERF_MAX_STACK_DEPTH;
+}
+
+static void
+perf_callchain_kernel(struct pt_regs *regs, struct perf_callchain_entry *entry)
+{
+	struct stackframe fr;
+
+	callchain_store(entry, PERF_CONTEXT_KERNEL);
+
+	fr.fp = regs->ARM_fp;
+	fr.sp = regs->ARM_sp;
+	fr.lr = regs->ARM_lr;
+	fr.pc = regs->ARM_pc;
+	walk_stackframe(&fr, callchain_trace, entry);
+}
+
+/* The caller's registers as saved by an APCS prologue, ending at fp */
+struct frame_tail {
+	struct frame_tail *fp;
+	unsigned long sp;
+	unsigned long lr;
+} __attribute__((packed));
+
+static struct frame_tail *
+user_backtrace(struct frame_tail *tail, struct perf_callchain_entry *entry)
+{
+	struct frame_tail buftail;
+
+	if (!access_ok(VERIFY_READ, tail, sizeof(buftail)))
+		return NULL;
+	if (__copy_from_user_inatomic(&buftail, tail, sizeof(buftail)))
+		return NULL;
+
+	callchain_store(entry, buftail.lr);
+
+	/* Frames must strictly move up the stack, this also stops loops */
+	if (tail + 1 >= buftail.fp)
+		return NULL;
+
+	return buftail.fp - 1;
+}
+
+static void
+perf_callchain_user(struct pt_regs *regs, struct perf_callchain_entry *entry)
+{
+	struct frame_tail *tail;
+
+	callchain_store(entry, PERF_CONTEXT_USER);
+	callchain_store(entry, regs->ARM_pc);
+
+	tail = (struct frame_tail *)regs->ARM_fp - 1;
+	while (tail && !((unsigned long)tail & 0x3) &&
+	       entry->nr < PERF_MAX_STACK_DEPTH)
+		tail = user_backtrace(tail, entry);
+}
+
+static void
+perf_do_callchain(struct pt_regs *regs, struct perf_callchain_entry *entry)
+{
+	int is_user;
+
+	if (!regs)
+		return;
+
+	is_user = user_mode(regs);
+
+	if (!current || current->pid == 0)
+		return;
+
+	if (is_user && current->state != TASK_RUNNING)
+		return;
+
+	if (!is_user) {
+		perf_callchain_kernel(regs, entry);
+		/* Kernel threads have no user side to walk */
+		if (!current->mm)
+			return;
+		regs = task_pt_regs(current);
+	}
+
+	perf_callchain_user(regs, entry);
+}
+
+/*
+ * Callchains are only taken from hrtimer or other interrupt context,
+ * never from an NMI, so one entry per cpu is enough.
+ */
+static DEFINE_PER_CPU(struct perf_callchain_entry, callchain);
+
+struct perf_callchain_entry *perf_callchain(struct pt_regs *regs)
+{
+	struct perf_callchain_entry *entry = &__get_cpu_var(callchain);
+
+	entry->nr = 0;
+
+	perf_do_callchain(regs, entry);
+
+	return entry;
+}
@@ -0,0 +1,23 @@
+/*
+ * Performance event support - ARM architecture code
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * ARMv5 cores such as the ARM926EJ-S have no performance monitor unit,
+ * so there are no hardware events to offer. Sampling is done with the
+ * generic cpu-clock and task-clock software events instead: they are
+ * driven by an hrtimer, whose interrupt provides the registers for the
+ * sampled PC and for the callchains from perf_callchain.c. Opening a
+ * hardware event fails with EOPNOTSUPP, on which perf record falls
+ * back to cpu-clock by itself.
+ */
+#include <linux/kernel.h>
+#include <linux/err.h>
+#include <linux/perf_event.h>
+
+const struct pmu *hw_perf_event_init(struct perf_event *event)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
@@ -0,0 +1,271 @@
+/*
+ *  linux/arch/arm/kernel/vdso.c
+ *
+ *  vDSO providing gettimeofday() and clock_gettime() to user space.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Every process gets three areas next to each other: a read-only copy
+ * of the timekeeping data, optionally a read-only uncached mapping of
+ * the page holding the clocksource counter register, and the vDSO text
+ * itself. The data is updated from update_vsyscall() under a sequence
+ * count which the vDSO code checks.
+ *
+ * With a VIVT data cache (ARMv5) the kernel and user mappings of the
+ * data page would alias, so both of them are made uncached there.
+ */
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/err.h>
+#include <linux/elf.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/spinlock.h>
+#include <linux/clocksource.h>
+#include <linux/time.h>
+
+#include <asm/cacheflush.h>
+#include <asm/cachetype.h>
+#include <asm/vdso.h>
+#include <asm/vdso_datapage.h>
+
+/* The linked vDSO image, see arch/arm/vdso/vdso.S */
+extern char vdso_start[], vdso_end[];
+
+unsigned int __read_mostly vdso_enabled = 1;
+
+static int __init vdso_setup(char *s)
+{
+	vdso_enabled = simple_strtoul(s, NULL, 0);
+	return 1;
+}
+__setup("vdso=", vdso_setup);
+
+static struct page **vdso_text_pages;
+static unsigned int vdso_text_npages;
+
+static struct page *vdso_data_pages[2];
+static struct vdso_data *vdso_data;
+static bool vdso_data_uncached;
+static DEFINE_SPINLOCK(vdso_data_lock);
+
+/* No struct pages behind the counter page, it is remapped at setup */
+static struct page *vdso_counter_pages[1];
+static struct clocksource *vdso_counter_cs;
+static unsigned long vdso_counter_phys;
+static u32 vdso_counter_xor;
+
+/*
+ * Let the vDSO read @cs directly: the counter is the 32-bit register
+ * at physical address @phys, xor'ed with @xor to get what cs->read()
+ * returns. Must be called before the vDSO is set up at arch_initcall
+ * time, typically from the machine's timer init.
+ */
+void __init arm_vdso_register_counter(struct clocksource *cs,
+				      unsigned long phys, u32 xor)
+{
+	vdso_counter_cs = cs;
+	vdso_counter_phys = phys;
+	vdso_counter_xor = xor;
+}
+
+static int __init vdso_init(void)
+{
+	unsigned long size = vdso_end - vdso_start;
+	struct page *page;
+	int i;
+
+	if (!vdso_enabled)
+		return 0;
+
+	if (memcmp(vdso_start, ELFMAG, SELFMAG)) {
+		printk(KERN_ERR "vDSO: image is not a valid ELF object\n");
+		goto disable;
+	}
+
+	vdso_text_npages = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	vdso_text_pages = kcalloc(vdso_text_npages + 1,
+				  sizeof(struct page *), GFP_KERNEL);
+	if (!vdso_text_pages)
+		goto disable;
+
+	for (i = 0; i < vdso_text_npages; i++) {
+		unsigned long offset = i << PAGE_SHIFT;
+		void *addr;
+
+		page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (!page)
+			goto free_text;
+		addr = page_address(page);
+		memcpy(addr, vdso_start + offset,
+		       min_t(unsigned long, size - offset, PAGE_SIZE));
+		/* User space fetches it through its own mapping */
+		__cpuc_flush_dcache_area(addr, PAGE_SIZE);
+		vdso_text_pages[i] = page;
+	}
+
+	page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!page)
+		goto free_text;
+	__cpuc_flush_dcache_area(page_address(page), PAGE_SIZE);
+	vdso_data_pages[0] = page;
+
+	if (cache_is_vivt() || cache_is_vipt_aliasing()) {
+		vdso_data = vmap(vdso_data_pages, 1, VM_MAP,
+				 pgprot_noncached(PAGE_KERNEL));
+		if (!vdso_data)
+			goto free_data;
+		vdso_data_uncached = true;
+	} else {
+		vdso_data = page_address(page);
+	}
+
+	return 0;
+
+free_data:
+	__free_page(vdso_data_pages[0]);
+	vdso_data_pages[0] = NULL;
+free_text:
+	for (i = 0; i < vdso_text_npages; i++)
+		if (vdso_text_pages[i])
+			__free_page(vdso_text_pages[i]);
+	kfree(vdso_text_pages);
+disable:
+	vdso_enabled = 0;
+	return -ENOMEM;
+}
+arch_initcall(vdso_init);
+
+static int vdso_map_counter(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma;
+	int ret;
+
+	ret = install_special_mapping(mm, addr, PAGE_SIZE,
+				      VM_READ | VM_MAYREAD,
+				      vdso_counter_pages);
+	if (ret)
+		return ret;
+
+	vma = find_vma(mm, addr);
+	return io_remap_pfn_range(vma, addr,
+				  vdso_counter_phys >> PAGE_SHIFT, PAGE_SIZE,
+				  pgprot_noncached(vma->vm_page_prot));
+}
+
+int arch_setup_additional_pages(struct linux_binprm *bprm, int uses_interp)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma;
+	unsigned long addr;
+	int ret;
+
+	if (!vdso_enabled)
+		return 0;
+
+	down_write(&mm->mmap_sem);
+	addr = get_unmapped_area(NULL, 0, VDSO_TEXT_OFFSET +
+				 (vdso_text_npages << PAGE_SHIFT), 0, 0);
+	if (IS_ERR_VALUE(addr)) {
+		ret = addr;
+		goto up_fail;
+	}
+
+	ret = install_special_mapping(mm, addr + VDSO_DATA_PAGE_OFFSET,
+				      PAGE_SIZE, VM_READ | VM_MAYREAD,
+				      vdso_data_pages);
+	if (ret)
+		goto up_fail;
+	if (vdso_data_uncached) {
+		/* Nothing is faulted in yet, so this covers every pte */
+		vma = find_vma(mm, addr + VDSO_DATA_PAGE_OFFSET);
+		vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+	}
+
+	if (vdso_counter_cs) {
+		ret = vdso_map_counter(mm, addr + VDSO_COUNTER_PAGE_OFFSET);
+		if (ret)
+			goto up_fail;
+	}
+
+	ret = install_special_mapping(mm, addr + VDSO_TEXT_OFFSET,
+				      vdso_text_npages << PAGE_SHIFT,
+				      VM_READ | VM_EXEC |
+				      VM_MAYREAD | VM_MAYWRITE | VM_MAYEXEC |
+				      VM_ALWAYSDUMP,
+				      vdso_text_pages);
+	if (ret)
+		goto up_fail;
+
+	mm->context.vdso = addr + VDSO_TEXT_OFFSET;
+
+up_fail:
+	up_write(&mm->mmap_sem);
+	return ret;
+}
+
+const char *arch_vma_name(struct vm_area_struct *vma)
+{
+	if (vma->vm_mm && vma->vm_start == vma->vm_mm->context.vdso)
+		return "[vdso]";
+	return NULL;
+}
+
+static inline void vdso_write_begin(struct vdso_data *vd)
+{
+	vd->seq++;
+	smp_wmb();
+}
+
+static inline void vdso_write_end(struct vdso_data *vd)
+{
+	smp_wmb();
+	vd->seq++;
+}
+
+void update_vsyscall(struct timespec *ts, struct clocksource *cs, u32 mult)
+{
+	struct vdso_data *vd = vdso_data;
+	unsigned long flags;
+
+	if (!vd)
+		return;
+
+	spin_lock_irqsave(&vdso_data_lock, flags);
+	vdso_write_begin(vd);
+
+	vd->cs_valid = vdso_counter_cs && cs == vdso_counter_cs;
+	vd->cs_cycle_last = cs->cycle_last;
+	vd->cs_mask = cs->mask;
+	vd->cs_mult = mult;
+	vd->cs_shift = cs->shift;
+	vd->cs_reg_offset = vdso_counter_phys & ~PAGE_MASK;
+	vd->cs_xor = vdso_counter_xor;
+	vd->xtime_sec = ts->tv_sec;
+	vd->xtime_nsec = ts->tv_nsec;
+	vd->wtm_sec = wall_to_monotonic.tv_sec;
+	vd->wtm_nsec = wall_to_monotonic.tv_nsec;
+
+	vdso_write_end(vd);
+	spin_unlock_irqrestore(&vdso_data_lock, flags);
+}
+
+void update_vsyscall_tz(void)
+{
+	struct vdso_data *vd = vdso_data;
+	unsigned long flags;
+
+	if (!vd)
+		return;
+
+	spin_lock_irqsave(&vdso_data_lock, flags);
+	vdso_write_begin(vd);
+	vd->tz_minuteswest = sys_tz.tz_minuteswest;
+	vd->tz_dsttime = sys_tz.tz_dsttime;
+	vdso_write_end(vd);
+	spin_unlock_irqrestore(&vdso_data_lock, flags);
+}
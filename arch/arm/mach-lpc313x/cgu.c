@@ -296,10 +296,9 @@ void cgu_ClkId2DomainId(CGU_CLOCK_ID_T clkid, CGU_DOMAIN_ID_T* pDomainId,
 }
 
 /***********************************************************************
-* Configure the selected fractional divider
+* Compute the control word for the selected fractional divider
 *********************************************************************/
-/* frac divider config function */
-u32 cgu_fdiv_config(u32 fdId, CGU_FDIV_SETUP_T fdivCfg, u32 enable)
+u32 cgu_fdiv_calc(u32 fdId, CGU_FDIV_SETUP_T fdivCfg, u32 enable)
 {
 	u32 conf, maddw, msubw, maxw, fdWidth;
 	int madd, msub;
@@ -332,6 +331,17 @@ u32 cgu_fdiv_config(u32 fdId, CGU_FDIV_SETUP_T fdivCfg, u32 enable)
 	if (enable)
 		conf |= CGU_SB_FDC_RUN;
 
+	return conf;
+}
+
+/***********************************************************************
+* Configure the selected fractional divider
+*********************************************************************/
+/* frac divider config function */
+u32 cgu_fdiv_config(u32 fdId, CGU_FDIV_SETUP_T fdivCfg, u32 enable)
+{
+	u32 conf = cgu_fdiv_calc(fdId, fdivCfg, enable);
+
 	/* finally configure the divider*/
 	CGU_SB->base_fdc[fdId] = conf;
 
@@ -603,6 +613,39 @@ void cgu_set_subdomain_freq(CGU_CLOCK_ID_T clkid, CGU_FDIV_SETUP_T fdiv_cfg)
 	}
 }
 
+/***********************************************************************
+* Reprogram several fractional dividers of one domain in one go. The
+* domain runs from FFAST while the dividers change, so the clocks derived
+* from them never run at an intermediate ratio. fdcs[] holds control
+* words as returned by cgu_fdiv_calc() or read back from base_fdc[].
+**********************************************************************/
+void cgu_set_fdcs(CGU_DOMAIN_ID_T domainId, const u32 *fdIds,
+		  const u32 *fdcs, int count)
+{
+	u32 base_freq, bcrId;
+	int i;
+
+	/* store base freq */
+	base_freq = CGU_SB_SSR_FS_GET(CGU_SB->base_ssr[domainId]);
+	/* switch domain to FFAST */
+	cgu_set_base_freq(domainId, CGU_FIN_SELECT_FFAST);
+	/* check if the domain has a BCR*/
+	bcrId = cgu_DomainId2bcrid(domainId);
+	/* disable all BCRs */
+	if (bcrId != CGU_INVALID_ID) {
+		CGU_SB->base_bcr[bcrId] = 0;
+	}
+	/* change fractional dividers */
+	for (i = 0; i < count; i++)
+		CGU_SB->base_fdc[fdIds[i]] = fdcs[i];
+	/* enable BCRs */
+	if (bcrId != CGU_INVALID_ID) {
+		CGU_SB->base_bcr[bcrId] = CGU_SB_BCR_FD_RUN;
+	}
+	/* switch domain to original base frequency */
+	cgu_set_base_freq(domainId, base_freq);
+}
+
 /***********************************************************************
 * Get frequency of requested PLL clock.
 **********************************************************************/
@@ -782,6 +825,7 @@ EXPORT_SYMBOL(cgu_set_base_freq);
 EXPORT_SYMBOL(cgu_get_clk_freq);
 EXPORT_SYMBOL(cgu_get_pll_freq);
 EXPORT_SYMBOL(cgu_set_subdomain_freq);
+EXPORT_SYMBOL(cgu_set_fdcs);
 EXPORT_SYMBOL(cgu_hpll_config);
 //EXPORT_SYMBOL(cgu_clk_set_exten);
 
@@ -0,0 +1,282 @@
+/*  arch/arm/mach-lpc313x/cpufreq.c
+ *
+ *  CPU frequency scaling for LPC313x & LPC315x.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * The system PLL (HPLL1) is left at the rate programmed by the boot
+ * loader: relocking it stalls every base domain hanging off it. Instead
+ * the SYS base fractional dividers feeding the ARM926 core and the AHB
+ * are divided further by the same integer, so the ARM:AHB ratio set up
+ * at boot is kept on every step. The AHB (and with it the MPMC) slows
+ * down together with the core, so the SDRAM refresh period is rescaled
+ * on each step. All other MPMC timings are in clocks and were set up for
+ * the boot rate, so they only get more relaxed at lower rates.
+ *
+ * Peripherals on their own base domains (timers, UART, SPI, I2C, ...)
+ * are not affected. Clocks that share the scaled dividers (DMA, NAND,
+ * SD/MMC) follow the AHB. The NAND timings are counted in clocks of the
+ * boot rate, so like the MPMC they only get more relaxed; the SD/MMC
+ * driver reprograms its card clock divider from the transition notifier.
+ */
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/irqflags.h>
+
+#include <mach/hardware.h>
+#include <mach/registers.h>
+#include <mach/cgu.h>
+
+/* Deepest division applied on top of the boot dividers */
+#define LPC313X_CPUFREQ_MAX_DIV	4
+/* The USB OTG controller needs at least 30MHz AHB for high speed */
+#define LPC313X_CPUFREQ_MIN_AHB	30000000
+/* ARM926 core and AHB */
+#define LPC313X_CPUFREQ_NR_FDIV	2
+
+struct lpc313x_cpufreq_step {
+	u32 fdc[LPC313X_CPUFREQ_NR_FDIV];
+	u32 dynref;
+};
+
+static struct cpufreq_frequency_table
+		lpc313x_freq_table[LPC313X_CPUFREQ_MAX_DIV + 1];
+static struct lpc313x_cpufreq_step lpc313x_steps[LPC313X_CPUFREQ_MAX_DIV];
+static u32 lpc313x_fdids[LPC313X_CPUFREQ_NR_FDIV];
+static int lpc313x_nr_fdiv;
+static int lpc313x_cur_step;
+
+static u32 lpc313x_gcd(u32 a, u32 b)
+{
+	while (b) {
+		u32 t = a % b;
+
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/*
+ * Control word dividing the boot rate 'rate' of the divider 'fdid' by
+ * 'div'. Returns 0 when the result does not fit the divider.
+ */
+static u32 lpc313x_cpufreq_fdc(u32 fdid, u32 base, u32 rate, u32 div)
+{
+	CGU_FDIV_SETUP_T fdiv;
+	u32 g, n, m;
+
+	g = lpc313x_gcd(base, rate);
+	n = rate / g;
+	m = (base / g) * div;
+	g = lpc313x_gcd(n, m);
+	n /= g;
+	m /= g;
+
+	/* SYS base dividers are 8 bits wide */
+	if (n > 0xFF || (m - n) > 0xFF)
+		return 0;
+
+	fdiv.stretch = !!(CGU_SB->base_fdc[fdid] & CGU_SB_FDC_STRETCH);
+	fdiv.n = n;
+	fdiv.m = m;
+
+	return cgu_fdiv_calc(fdid, fdiv, 1);
+}
+
+static int __init lpc313x_cpufreq_build_table(void)
+{
+	CGU_DOMAIN_ID_T domain;
+	u32 arm_fd, ahb_fd, base, arm_rate, ahb_rate, dynref;
+	int div, i = 0;
+
+	cgu_ClkId2DomainId(CGU_SB_ARM926_CORE_CLK_ID, &domain, &arm_fd);
+	cgu_ClkId2DomainId(CGU_SB_AHB0_CLK_ID, &domain, &ahb_fd);
+
+	/* A clock tied straight to the base can't be scaled without HPLL1 */
+	if (arm_fd == CGU_INVALID_ID || ahb_fd == CGU_INVALID_ID) {
+		pr_debug("cpufreq: ARM/AHB clocks have no divider\n");
+		return -ENODEV;
+	}
+
+	lpc313x_fdids[0] = arm_fd;
+	lpc313x_nr_fdiv = 1;
+	if (ahb_fd != arm_fd)
+		lpc313x_fdids[lpc313x_nr_fdiv++] = ahb_fd;
+
+	base = cgu_get_base_freq(CGU_SB_SYS_BASE_ID);
+	arm_rate = cgu_get_clk_freq(CGU_SB_ARM926_CORE_CLK_ID);
+	ahb_rate = cgu_get_clk_freq(CGU_SB_AHB0_CLK_ID);
+	dynref = MPMC_DYNREF;
+
+	for (div = 1; div <= LPC313X_CPUFREQ_MAX_DIV; div++) {
+		struct lpc313x_cpufreq_step *step = &lpc313x_steps[i];
+		int j;
+
+		if (ahb_rate / div < LPC313X_CPUFREQ_MIN_AHB)
+			break;
+
+		for (j = 0; j < lpc313x_nr_fdiv; j++) {
+			u32 fdid = lpc313x_fdids[j];
+
+			if (div == 1)
+				step->fdc[j] = CGU_SB->base_fdc[fdid];
+			else
+				step->fdc[j] = lpc313x_cpufreq_fdc(fdid, base,
+					fdid == arm_fd ? arm_rate : ahb_rate,
+					div);
+			if (!step->fdc[j])
+				break;
+		}
+		if (j < lpc313x_nr_fdiv)
+			continue;
+
+		/* refresh count is in MPMC clocks, round to refresh sooner */
+		step->dynref = max(dynref / div, 1U);
+
+		lpc313x_freq_table[i].index = i;
+		lpc313x_freq_table[i].frequency = arm_rate / div / 1000;
+		i++;
+	}
+	lpc313x_freq_table[i].index = i;
+	lpc313x_freq_table[i].frequency = CPUFREQ_TABLE_END;
+	lpc313x_cur_step = 0;
+
+	return 0;
+}
+
+static int lpc313x_cpufreq_verify(struct cpufreq_policy *policy)
+{
+	return cpufreq_frequency_table_verify(policy, lpc313x_freq_table);
+}
+
+static unsigned int lpc313x_cpufreq_get(unsigned int cpu)
+{
+	if (cpu)
+		return 0;
+
+	return cgu_get_clk_freq(CGU_SB_ARM926_CORE_CLK_ID) / 1000;
+}
+
+static void lpc313x_cpufreq_set_step(int idx)
+{
+	struct lpc313x_cpufreq_step *step = &lpc313x_steps[idx];
+	unsigned long flags;
+
+	local_irq_save(flags);
+	/*
+	 * Keep the SDRAM refreshed often enough across the switch: shorten
+	 * the refresh count before slowing down, lengthen it after speeding
+	 * up.
+	 */
+	if (idx > lpc313x_cur_step)
+		MPMC_DYNREF = step->dynref;
+
+	cgu_set_fdcs(CGU_SB_SYS_BASE_ID, lpc313x_fdids, step->fdc,
+		     lpc313x_nr_fdiv);
+
+	if (idx < lpc313x_cur_step)
+		MPMC_DYNREF = step->dynref;
+
+	lpc313x_cur_step = idx;
+	local_irq_restore(flags);
+}
+
+static int lpc313x_cpufreq_target(struct cpufreq_policy *policy,
+				  unsigned int target_freq,
+				  unsigned int relation)
+{
+	struct cpufreq_freqs freqs;
+	unsigned int idx;
+	int ret;
+
+	ret = cpufreq_frequency_table_target(policy, lpc313x_freq_table,
+					     target_freq, relation, &idx);
+	if (ret)
+		return ret;
+
+	freqs.old = lpc313x_cpufreq_get(0);
+	freqs.new = lpc313x_freq_table[idx].frequency;
+	freqs.cpu = 0;
+
+	if (idx == lpc313x_cur_step)
+		return 0;
+
+	cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
+	lpc313x_cpufreq_set_step(idx);
+	cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
+
+	return 0;
+}
+
+static int __init lpc313x_cpufreq_cpu_init(struct cpufreq_policy *policy)
+{
+	int ret;
+
+	if (policy->cpu != 0)
+		return -EINVAL;
+
+	ret = lpc313x_cpufreq_build_table();
+	if (ret)
+		return ret;
+
+	ret = cpufreq_frequency_table_cpuinfo(policy, lpc313x_freq_table);
+	if (ret)
+		return ret;
+
+	cpufreq_frequency_table_get_attr(lpc313x_freq_table, policy->cpu);
+
+	policy->cur = lpc313x_cpufreq_get(0);
+	policy->min = policy->cpuinfo.min_freq;
+	policy->max = policy->cpuinfo.max_freq;
+	/*
+	 * The dividers switch within a few FFAST cycles, leave room for
+	 * the drivers on the transition notifier.
+	 */
+	policy->cpuinfo.transition_latency = 100 * 1000;
+
+	return 0;
+}
+
+static int lpc313x_cpufreq_cpu_exit(struct cpufreq_policy *policy)
+{
+	cpufreq_frequency_table_put_attr(policy->cpu);
+	return 0;
+}
+
+static struct freq_attr *lpc313x_cpufreq_attr[] = {
+	&cpufreq_freq_attr_scaling_available_freqs,
+	NULL,
+};
+
+static struct cpufreq_driver lpc313x_cpufreq_driver = {
+	.flags		= CPUFREQ_STICKY,
+	.verify		= lpc313x_cpufreq_verify,
+	.target		= lpc313x_cpufreq_target,
+	.get		= lpc313x_cpufreq_get,
+	.init		= lpc313x_cpufreq_cpu_init,
+	.exit		= lpc313x_cpufreq_cpu_exit,
+	.name		= "lpc313x",
+	.attr		= lpc313x_cpufreq_attr,
+};
+
+static int __init lpc313x_cpufreq_init(void)
+{
+	return cpufreq_register_driver(&lpc313x_cpufreq_driver);
+}
+late_initcall(lpc313x_cpufreq_init);
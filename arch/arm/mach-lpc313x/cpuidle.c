@@ -0,0 +1,186 @@
+/*  arch/arm/mach-lpc313x/cpuidle.c
+ *
+ *  CPU idle support for LPC313x & LPC315x.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Three idle states are exposed:
+ *  #1 wait-for-interrupt
+ *  #2 wait-for-interrupt with SDRAM in self-refresh
+ *  #3 as #2, with the SYS base (ARM, AHB, MPMC) running from FFAST
+ *
+ * #2 and #3 run from ISRAM. The MPMC does not leave self-refresh on its
+ * own, so they are only entered while no other bus master (DMA, USB
+ * OTG) can touch SDRAM, otherwise #1 is used instead.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/cpuidle.h>
+#include <linux/io.h>
+#include <linux/string.h>
+#include <linux/time.h>
+#include <asm/proc-fns.h>
+#include <asm/cacheflush.h>
+
+#include <mach/hardware.h>
+#include <mach/dma.h>
+#include <mach/board.h>
+#include <mach/sram.h>
+
+#define LPC313X_MAX_STATES	3
+
+/* USB OTG controller command register and its run/stop bit */
+#define LPC313X_USBCMD		__REG(USBOTG_PHYS + 0x140)
+#define LPC313X_USBCMD_RS	_BIT(0)
+
+enum {
+	LPC313X_IDLE_WFI,
+	LPC313X_IDLE_SR,
+	LPC313X_IDLE_SR_FFAST,
+};
+
+extern void lpc313x_idle_sr(u32 sys_ffast);
+extern int lpc313x_idle_sr_sz;
+
+static void (*lpc313x_idle_sr_ptr)(u32);
+
+static DEFINE_PER_CPU(struct cpuidle_device, lpc313x_cpuidle_device);
+
+static struct cpuidle_driver lpc313x_idle_driver = {
+	.name =		"lpc313x_idle",
+	.owner =	THIS_MODULE,
+};
+
+/* Is any bus master other than the ARM able to access SDRAM? */
+static int lpc313x_bm_active(void)
+{
+	int ch;
+
+	for (ch = 0; ch < DMA_MAX_CHANNELS; ch++) {
+		if (DMACH_EN(ch) & 1)
+			return 1;
+	}
+
+	/* Don't touch the USB registers while its AHB clock is off */
+	if ((CGU_SB->clk_pcr[CGU_SB_USB_OTG_AHB_CLK_ID] & CGU_SB_PCR_RUN) &&
+	    (LPC313X_USBCMD & LPC313X_USBCMD_RS))
+		return 1;
+
+	return 0;
+}
+
+static void lpc313x_idle_self_refresh(int sys_ffast)
+{
+	int ext_refresh;
+
+	ext_refresh = lpc313x_ext_refresh_en(0);
+
+	/* Set FFAST as source clock for the non-active switch side of SYS */
+	if (sys_ffast) {
+		if (CGU_SB->base_ssr[CGU_SB_SYS_BASE_ID] & CGU_SB_SCR_EN1)
+			CGU_SB->base_fs2[CGU_SB_SYS_BASE_ID] = CGU_FIN_SELECT_FFAST;
+		else
+			CGU_SB->base_fs1[CGU_SB_SYS_BASE_ID] = CGU_FIN_SELECT_FFAST;
+	}
+
+	lpc313x_idle_sr_ptr(sys_ffast);
+
+	lpc313x_ext_refresh_en(ext_refresh);
+}
+
+/* Actual code that puts the SoC in different idle states */
+static int lpc313x_enter_idle(struct cpuidle_device *dev,
+			      struct cpuidle_state *state)
+{
+	struct timeval before, after;
+	int idle_time;
+	int idx = state - dev->states;
+
+	local_irq_disable();
+	do_gettimeofday(&before);
+
+	if (idx != LPC313X_IDLE_WFI && lpc313x_bm_active()) {
+		idx = LPC313X_IDLE_WFI;
+		dev->last_state = &dev->states[idx];
+	}
+
+	if (idx == LPC313X_IDLE_WFI)
+		cpu_do_idle();
+	else
+		lpc313x_idle_self_refresh(idx == LPC313X_IDLE_SR_FFAST);
+
+	do_gettimeofday(&after);
+	local_irq_enable();
+	idle_time = (after.tv_sec - before.tv_sec) * USEC_PER_SEC +
+			(after.tv_usec - before.tv_usec);
+	return idle_time;
+}
+
+static void __init lpc313x_init_state(struct cpuidle_state *state,
+		const char *name, const char *desc,
+		unsigned int exit_latency, unsigned int target_residency)
+{
+	state->enter = lpc313x_enter_idle;
+	state->exit_latency = exit_latency;
+	state->target_residency = target_residency;
+	state->flags = CPUIDLE_FLAG_TIME_VALID;
+	strcpy(state->name, name);
+	strcpy(state->desc, desc);
+}
+
+/* Initialize CPU idle by registering the idle states */
+static int __init lpc313x_init_cpuidle(void)
+{
+	struct cpuidle_device *device;
+	void *sram;
+
+	/* Copy the self-refresh code to ISRAM, SDRAM is off while it runs */
+	sram = lpc313x_sram_alloc(lpc313x_idle_sr_sz, NULL);
+	if (!sram) {
+		printk(KERN_ERR "lpc313x_init_cpuidle: no SRAM for idle code\n");
+		return -ENOMEM;
+	}
+	memcpy(sram, &lpc313x_idle_sr, lpc313x_idle_sr_sz);
+	flush_icache_range((unsigned long)sram,
+			(unsigned long)sram + lpc313x_idle_sr_sz);
+	lpc313x_idle_sr_ptr = sram;
+
+	cpuidle_register_driver(&lpc313x_idle_driver);
+
+	device = &per_cpu(lpc313x_cpuidle_device, smp_processor_id());
+	device->state_count = LPC313X_MAX_STATES;
+
+	/*
+	 * Entering self-refresh waits for the next refresh cycle to pass
+	 * (up to one refresh period), leaving it takes tXSR plus running the
+	 * exit path from uncached ISRAM. Switching SYS back to the locked
+	 * HPLL1 adds a few FFAST cycles on top.
+	 */
+	lpc313x_init_state(&device->states[LPC313X_IDLE_WFI],
+			"WFI", "Wait for interrupt", 1, 10);
+	lpc313x_init_state(&device->states[LPC313X_IDLE_SR],
+			"RAM_SR", "WFI and RAM self-refresh", 40, 200);
+	lpc313x_init_state(&device->states[LPC313X_IDLE_SR_FFAST],
+			"SYS_FFAST", "WFI, RAM SR and SYS on FFAST", 60, 1000);
+
+	if (cpuidle_register_device(device)) {
+		printk(KERN_ERR "lpc313x_init_cpuidle: Failed registering\n");
+		return -EIO;
+	}
+	return 0;
+}
+
+device_initcall(lpc313x_init_cpuidle);
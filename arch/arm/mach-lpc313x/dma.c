@@ -103,7 +103,7 @@ int dma_prog_channel (unsigned int chn, dma_setup_t *dma_setup)
 	return 0;
 }
 
-int dma_request_channel (char *name, dma_cb_t cb, void *data)
+int lpc313x_dma_request_channel (char *name, dma_cb_t cb, void *data)
 {
 	unsigned int mask;
 	unsigned int chn;
@@ -233,7 +233,7 @@ int dma_stop_channel_sg (unsigned int chn)
 	return 0;
 }
 
-int dma_release_channel (unsigned int chn)
+int lpc313x_dma_release_channel (unsigned int chn)
 {
 	unsigned int mask = (0x3 << (chn * 2));
 	unsigned long flags;
@@ -543,11 +543,11 @@ device_initcall(lpc313x_dma_init);
 
 
 EXPORT_SYMBOL(dma_prog_channel);
-EXPORT_SYMBOL(dma_request_channel);
+EXPORT_SYMBOL(lpc313x_dma_request_channel);
 EXPORT_SYMBOL(dma_request_specific_channel);
 EXPORT_SYMBOL(dma_start_channel);
 EXPORT_SYMBOL(dma_stop_channel);
-EXPORT_SYMBOL(dma_release_channel);
+EXPORT_SYMBOL(lpc313x_dma_release_channel);
 EXPORT_SYMBOL(dma_set_irq_mask);
 EXPORT_SYMBOL(dma_read_counter);
 EXPORT_SYMBOL(dma_write_counter);
@@ -250,7 +250,7 @@ static void __init ea_add_device_dm9000(void)
 	/* Configure Interrupt pin as input, no pull-up */
 	gpio_direction_input(GPIO_MNAND_RYBN3);
 
-	platform_device_register(&dm9000_device);
+	lpc313x_add_device_async(&dm9000_device);
 }
 #else
 static void __init ea_add_device_dm9000(void) {}
@@ -482,7 +482,6 @@ static void __init ea313x_init(void)
 	lpc313x_init();
 	/* register i2cdevices */
 	lpc313x_register_i2c_devices();
-	
 
 	platform_add_devices(devices, ARRAY_SIZE(devices));
 
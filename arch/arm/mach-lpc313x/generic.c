@@ -25,6 +25,7 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/string.h>
+#include <linux/async.h>
 #include <linux/console.h>
 #include <linux/serial_8250.h>
 
@@ -32,6 +33,9 @@
 #include <mach/hardware.h>
 
 #include <mach/gpio.h>
+#include <mach/board.h>
+#include <mach/sram.h>
+#include <mach/lpc313x_dmac.h>
 #include <asm/mach/map.h>
 
 /* local functions */
@@ -109,8 +113,36 @@ static struct platform_device serial_device = {
 };
 
 
+static struct lpc313x_dmac_platform_data lpc313x_dmac_data = {
+	.nr_channels = 4,
+};
+
+static u64 dmac_dmamask = 0xffffffffUL;
+static struct platform_device lpc313x_dmac_device = {
+	.name = "lpc313x-dmac",
+	.id = -1,
+	.dev = {
+		.dma_mask = &dmac_dmamask,
+		.coherent_dma_mask = 0xffffffff,
+		.platform_data = &lpc313x_dmac_data,
+	},
+};
+
+static struct platform_device lpc313x_adc_device = {
+	.name = "lpc313x-adc",
+	.id = -1,
+};
+
+static struct platform_device lpc313x_timer_trig_device = {
+	.name = "iio_lpc313x_timer_trigger",
+	.id = -1,
+};
+
 static struct platform_device *devices[] __initdata = {
 	&serial_device,
+	&lpc313x_dmac_device,
+	&lpc313x_adc_device,
+	&lpc313x_timer_trig_device,
 };
 
 static struct map_desc lpc313x_io_desc[] __initdata = {
@@ -162,18 +194,51 @@ static struct map_desc lpc313x_io_desc[] __initdata = {
 		.length		= IO_NAND_BUF_SIZE,
 		.type		= MT_DEVICE
 	},
+#ifdef CONFIG_LPC313X_SRAM_TEXT
+	/* __sram_text/__sram_data, cached */
+	{
+		.virtual	= io_p2v(IO_ISRAM0_PHYS),
+		.pfn		= __phys_to_pfn(IO_ISRAM0_PHYS),
+		.length		= SRAM_TEXT_SIZE,
+		.type		= MT_MEMORY
+	},
+	{
+		.virtual	= io_p2v(IO_ISRAM0_PHYS) + SRAM_TEXT_SIZE,
+		.pfn		= __phys_to_pfn(IO_ISRAM0_PHYS + SRAM_TEXT_SIZE),
+		.length		= IO_ISRAM0_SIZE - SRAM_TEXT_SIZE,
+		.type		= MT_DEVICE
+	},
+#else
 	{
 		.virtual	= io_p2v(IO_ISRAM0_PHYS),
 		.pfn		= __phys_to_pfn(IO_ISRAM0_PHYS),
 		.length		= IO_ISRAM0_SIZE,
 		.type		= MT_DEVICE
 	},
+#endif
 };
 
 void __init lpc313x_map_io(void)
 {
 	iotable_init(lpc313x_io_desc, ARRAY_SIZE(lpc313x_io_desc));
+	lpc313x_sram_init_text();
+}
+
+/* Enable/Disable external refresh controller used by
+ * auto clock scaling feature of CGU. Returns the previous setting.
+ */
+int lpc313x_ext_refresh_en(int enable)
+{
+	int old = !!(SYS_MPMC_TESTMODE0 & _BIT(12));
+
+	if (enable)
+		SYS_MPMC_TESTMODE0 |= _BIT(12);
+	else
+		SYS_MPMC_TESTMODE0 &= ~_BIT(12);
+
+	return old;
 }
+
 extern int __init cgu_init(char *str);
 
 int __init lpc313x_init(void)
@@ -185,8 +250,8 @@ int __init lpc313x_init(void)
 	cgu_clk_en_dis(CGU_SB_UART_U_CLK_ID, 1);
 	cgu_clk_en_dis(CGU_SB_IOCONF_PCLK_ID, 1);
 
-	/* Put adc block in low power state.
-	 * Once ADC driver is added this should move to driver.
+	/* Put adc block in low power state, the lpc313x-adc driver
+	 * only powers it up while converting.
 	 */
 	SYS_ADC_PD = 1;
 	/* Disable ring oscillators used by Random number generators */
@@ -220,6 +285,63 @@ int __init lpc313x_init(void)
 	return platform_add_devices(devices, ARRAY_SIZE(devices));
 }
 
+/*
+ * Devices with slow probes (ethernet PHY reset, USB PHY settle) can be
+ * passed to lpc313x_add_device_async() instead of being registered from
+ * init_machine. They are held back until all built-in drivers are
+ * registered, then each one is registered from its own async thread, so
+ * the probes overlap each other and the rest of boot. Threads are started
+ * in the order the devices were added. prepare_namespace() waits for all
+ * of them (wait_for_device_probe) before mounting a block device root.
+ *
+ * Devices that something at device_initcall time depends on must not be
+ * deferred: the NAND carries the UBI volumes that ubi_init() attaches
+ * from "ubi.mtd=" as a module_init. Drivers using platform_driver_probe()
+ * only bind devices that already exist when they register, their devices
+ * must not be deferred either.
+ */
+#define LPC313X_MAX_ASYNC_DEVS	8
+
+static struct platform_device *async_devices[LPC313X_MAX_ASYNC_DEVS] __initdata;
+static int nr_async_devices __initdata;
+static int async_devices_started __initdata;
+
+static void __init lpc313x_register_device_async(void *data,
+		async_cookie_t cookie)
+{
+	struct platform_device *pdev = data;
+	int ret;
+
+	ret = platform_device_register(pdev);
+	if (ret)
+		printk(KERN_ERR "lpc313x: can't register %s (%d)\n",
+				pdev->name, ret);
+}
+
+int __init lpc313x_add_device_async(struct platform_device *pdev)
+{
+	/* Too late to defer or out of slots, register it now */
+	if (async_devices_started ||
+	    nr_async_devices == LPC313X_MAX_ASYNC_DEVS)
+		return platform_device_register(pdev);
+
+	async_devices[nr_async_devices++] = pdev;
+	return 0;
+}
+
+static int __init lpc313x_start_async_devices(void)
+{
+	int i;
+
+	async_devices_started = 1;
+	for (i = 0; i < nr_async_devices; i++)
+		async_schedule(lpc313x_register_device_async, async_devices[i]);
+
+	return 0;
+}
+/* After the module_init of every built-in driver */
+device_initcall_sync(lpc313x_start_async_devices);
+
 
 #if defined(CONFIG_SERIAL_8250_CONSOLE)
 static int __init lpc313x_init_console(void)
@@ -29,13 +29,16 @@
 #include <linux/mtd/partitions.h>
 #include <linux/mmc/host.h>
 
+struct platform_device;
 
 extern void __init lpc313x_map_io(void);
 extern void __init lpc313x_init_irq(void);
 extern int __init lpc313x_init(void);
 extern int __init lpc313x_register_i2c_devices(void);
+extern int __init lpc313x_add_device_async(struct platform_device *pdev);
 extern void lpc313x_vbus_power(int enable);
 extern int lpc313x_entering_suspend_mem(void);
+extern int lpc313x_ext_refresh_en(int enable);
 
 
 struct sys_timer;
@@ -583,12 +583,19 @@ u32 cgu_get_clk_freq(CGU_CLOCK_ID_T clkid);
 /* Change the sub-domain frequency for the requested clock */
 void cgu_set_subdomain_freq(CGU_CLOCK_ID_T clkid, CGU_FDIV_SETUP_T fdiv_cfg);
 
+/* Reprogram several fractional dividers of one domain at once */
+void cgu_set_fdcs(CGU_DOMAIN_ID_T domainId, const u32 *fdIds,
+		  const u32 *fdcs, int count);
+
 /* Configure the selected HPLL */
 void cgu_hpll_config(CGU_HPLL_ID_T id, CGU_HPLL_SETUP_T* pllsetup);
 
 /* enable / disable external enabling of the requested clock in CGU */
 void cgu_clk_set_exten(CGU_CLOCK_ID_T clkid, u32 enable);
 
+/* frac divider control word, without programming it */
+u32 cgu_fdiv_calc(u32 fdId, CGU_FDIV_SETUP_T fdivCfg, u32 enable);
+
 /* frac divider config function */
 u32 cgu_fdiv_config(u32 fdId, CGU_FDIV_SETUP_T fdivCfg, u32 enable);
 
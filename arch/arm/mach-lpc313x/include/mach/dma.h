@@ -167,7 +167,7 @@ typedef struct dma_sg_ll
  * Program SDMA channel
  *
  * Function parameters:
- * 1st parameter - channel number, obtained from dma_request_channel()
+ * 1st parameter - channel number, obtained from lpc313x_dma_request_channel()
  * 2nd parameter - ptr to the structure containing setup info for the channel
  *
  * Returns: 0 on success, otherwise failure
@@ -186,7 +186,7 @@ int dma_prog_channel (unsigned int, dma_setup_t   *);
  *
  * Returns: channel number on success, otherwise (negative) failure
  */
-int dma_request_channel (char *, dma_cb_t cb, void *);
+int lpc313x_dma_request_channel (char *, dma_cb_t cb, void *);
 
 /*
  * Request specific SDMA channel
@@ -245,7 +245,7 @@ int dma_stop_channel (unsigned int);
  *
  * Returns: 0 on success, otherwise failure
  */
-int dma_release_channel (unsigned int);
+int lpc313x_dma_release_channel (unsigned int);
 
 /*
  * Read channel counter
@@ -0,0 +1,36 @@
+/* linux/arch/arm/mach-lpc313x/include/mach/fiq.h
+ *
+ * FIQ routing for LPC313x and LPC315x SoCs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __ASM_ARCH_FIQ_H
+#define __ASM_ARCH_FIQ_H
+
+struct fiq_handler;
+
+/* route an INTC source (1 .. NR_IRQ_CPU - 1) to FIQ or back to IRQ */
+extern int lpc313x_set_fiq(unsigned int irq, int on);
+
+/* claim the FIQ and have fn(data) called from it in FIQ mode */
+extern int lpc313x_claim_fiq(struct fiq_handler *fh,
+			     void (*fn)(void *), void *data);
+
+/* FIQ vector code calling the C handler, see fiq.S */
+extern unsigned char lpc313x_fiq_stub, lpc313x_fiq_stub_end;
+
+#endif
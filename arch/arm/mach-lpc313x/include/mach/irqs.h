@@ -59,6 +59,9 @@
 
 # define NR_IRQ_CPU	  30	/* IRQs directly recognized by CPU */
 
+/* enable_fiq()/disable_fiq() take INTC source numbers */
+#define FIQ_START	0
+
 #define IRQ_EVT_START   NR_IRQ_CPU
 
 /* System specific IRQs */
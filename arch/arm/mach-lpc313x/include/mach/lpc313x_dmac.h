@@ -0,0 +1,78 @@
+/*  linux/arch/arm/mach-lpc313x/include/mach/lpc313x_dmac.h
+ *
+ *  dmaengine interface for the LPC313x and LPC315x DMA controller.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __ASM_ARCH_LPC313X_DMAC_H
+#define __ASM_ARCH_LPC313X_DMAC_H
+
+#include <linux/dmaengine.h>
+
+/*
+ * struct lpc313x_dmac_platform_data - controller configuration
+ * @nr_channels: number of dmaengine channels to expose. Each channel
+ *               claims a pair of hardware channels (data + companion)
+ *               from the legacy allocator when a client requests it and
+ *               returns it when the client releases it. The remaining
+ *               hardware channels stay available to the legacy
+ *               lpc313x_dma_request_channel() and dma_request_sg_channel().
+ */
+struct lpc313x_dmac_platform_data {
+	unsigned int nr_channels;
+};
+
+/*
+ * struct lpc313x_dma_slave - controller-specific slave information
+ * @dma_dev: the lpc313x-dmac device, used to match channels
+ * @tx_reg: physical address of the peripheral register for mem->dev
+ * @rx_reg: physical address of the peripheral register for dev->mem
+ * @slave_nr: DMA_SLV_xxx request line of the peripheral
+ * @width: DMA_TRANSFER_xxx transfer size on the peripheral side
+ *
+ * Passed to the dmaengine core through dma_chan->private.
+ */
+struct lpc313x_dma_slave {
+	struct device	*dma_dev;
+	dma_addr_t	tx_reg;
+	dma_addr_t	rx_reg;
+	unsigned int	slave_nr;
+	unsigned int	width;
+};
+
+/*
+ * Cyclic transfers (audio style ring buffers). The ring is split in
+ * periods and period_callback is invoked from tasklet context each
+ * time the controller finishes a period.
+ */
+struct lpc313x_dma_cyclic {
+	unsigned int	periods;
+	void		(*period_callback)(void *param);
+	void		*period_callback_param;
+};
+
+struct lpc313x_dma_cyclic *lpc313x_dma_cyclic_prep(struct dma_chan *chan,
+		dma_addr_t buf_addr, size_t buf_len, size_t period_len,
+		enum dma_data_direction direction);
+void lpc313x_dma_cyclic_free(struct dma_chan *chan);
+int lpc313x_dma_cyclic_start(struct dma_chan *chan);
+void lpc313x_dma_cyclic_stop(struct dma_chan *chan);
+
+/* Index of the period the controller is currently working on */
+unsigned int lpc313x_dma_cyclic_pos(struct dma_chan *chan);
+
+#endif /* __ASM_ARCH_LPC313X_DMAC_H */
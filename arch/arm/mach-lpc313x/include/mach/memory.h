@@ -25,5 +25,14 @@
 
 #define PHYS_OFFSET	UL(0x30000000)
 
+#ifdef CONFIG_LPC313X_SRAM_TEXT
+/*
+ * __sram_text/__sram_data are linked to the start of ISRAM0, at its
+ * io_p2v(ISRAM0_PHYS) mapping.
+ */
+#define SRAM_TEXT_OFFSET	0xf1128000
+#define SRAM_TEXT_SIZE		0x4000
+#endif
+
 
 #endif
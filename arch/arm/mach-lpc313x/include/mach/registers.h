@@ -275,7 +275,24 @@
 /***********************************************************************
  * ADC_REG register definitions
  **********************************************************************/
+#define ADC_R_REG(ch)          __REG (ADC_PHYS + ((ch) << 2))
 #define ADC_CON_REG            __REG (ADC_PHYS + 0x20)
+#define ADC_CSEL_RES_REG       __REG (ADC_PHYS + 0x24)
+#define ADC_INT_ENABLE_REG     __REG (ADC_PHYS + 0x28)
+#define ADC_INT_STATUS_REG     __REG (ADC_PHYS + 0x2C)
+#define ADC_INT_CLEAR_REG      __REG (ADC_PHYS + 0x30)
+
+#define ADC_MAX_CHANNELS       4
+#define ADC_R_MASK             0x3FF
+/* ADC_CON_REG bits */
+#define ADC_CON_ENABLE         _BIT(1)
+#define ADC_CON_CSCAN          _BIT(2)
+#define ADC_CON_START          _BIT(3)
+#define ADC_CON_STATUS         _BIT(4)
+/* ADC_CSEL_RES_REG: conversion resolution per channel, 0 skips it */
+#define ADC_CSEL_RES(ch, bits) _SBF((ch) << 2, (bits))
+/* ADC_INT_*_REG bits */
+#define ADC_INT_SCAN_DONE      _BIT(0)
 
 /***********************************************************************
  * SYS_REG register definitions
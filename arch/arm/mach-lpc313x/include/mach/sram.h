@@ -0,0 +1,52 @@
+/* linux/arch/arm/mach-lpc313x/include/mach/sram.h
+ *
+ * On-chip SRAM (ISRAM) allocator and code placement for LPC313x and
+ * LPC315x SoCs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __ASM_ARCH_SRAM_H
+#define __ASM_ARCH_SRAM_H
+
+#include <linux/types.h>
+#include <linux/compiler.h>
+
+/* Allocation granularity, one cache line */
+#define SRAM_GRANULARITY	32
+
+#ifdef CONFIG_LPC313X_SRAM_TEXT
+/*
+ * Code and data linked into the start of ISRAM0. The ISRAM is out of
+ * branch range of the kernel text: functions are called through long
+ * calls, and files holding them are built with -mlong-calls.
+ */
+#define __sram_text	__attribute__((long_call)) __section(.sram.text) noinline
+#define __sram_data	__section(.sram.data)
+
+extern void __init lpc313x_sram_init_text(void);
+#else
+#define __sram_text
+#define __sram_data
+
+static inline void lpc313x_sram_init_text(void) {}
+#endif
+
+/* DMA-coherent (uncached) ISRAM buffers; dma may be NULL */
+extern void *lpc313x_sram_alloc(size_t len, dma_addr_t *dma);
+extern void lpc313x_sram_free(void *addr, size_t len);
+
+#endif
@@ -24,22 +24,30 @@
 #include <linux/init.h>
 #include <linux/list.h>
 #include <linux/timer.h>
+#include <linux/bitops.h>
+#include <linux/module.h>
+#include <linux/string.h>
 
 #include <mach/hardware.h>
 #include <asm/irq.h>
 #include <asm/mach/irq.h>
 #include <mach/irqs.h>
 #include <mach/cgu.h>
+#include <mach/sram.h>
+#ifdef CONFIG_FIQ
+#include <asm/fiq.h>
+#include <mach/fiq.h>
+#endif
 
 
 static IRQ_EVENT_MAP_T irq_2_event[] = BOARD_IRQ_EVENT_MAP;
 
-static void intc_mask_irq(unsigned int irq)
+static void __sram_text intc_mask_irq(unsigned int irq)
 {
 	INTC_REQ_REG(irq) = INTC_REQ_WE_ENABLE;
 }
 
-static void intc_unmask_irq(unsigned int irq)
+static void __sram_text intc_unmask_irq(unsigned int irq)
 {
 	INTC_REQ_REG(irq) = INTC_REQ_ENABLE | INTC_REQ_WE_ENABLE;
 }
@@ -81,7 +89,7 @@ static struct irq_chip lpc313x_internal_chip = {
 	.set_wake = intc_set_wake,
 };
 
-static void evt_mask_irq(unsigned int irq)
+static void __sram_text evt_mask_irq(unsigned int irq)
 {
 	u32 bank = EVT_GET_BANK(irq_2_event[irq - IRQ_EVT_START].event_pin);
 	u32 bit_pos = irq_2_event[irq - IRQ_EVT_START].event_pin & 0x1F;
@@ -89,7 +97,7 @@ static void evt_mask_irq(unsigned int irq)
 	EVRT_MASK_CLR(bank) = _BIT(bit_pos);
 }
 
-static void evt_unmask_irq(unsigned int irq)
+static void __sram_text evt_unmask_irq(unsigned int irq)
 {
 	u32 bank = EVT_GET_BANK(irq_2_event[irq - IRQ_EVT_START].event_pin);
 	u32 bit_pos = irq_2_event[irq - IRQ_EVT_START].event_pin & 0x1F;
@@ -97,7 +105,7 @@ static void evt_unmask_irq(unsigned int irq)
 	EVRT_MASK_SET(bank) = _BIT(bit_pos);
 }
 
-static void evt_ack_irq(unsigned int irq)
+static void __sram_text evt_ack_irq(unsigned int irq)
 {
 	u32 bank = EVT_GET_BANK(irq_2_event[irq - IRQ_EVT_START].event_pin);
 	u32 bit_pos = irq_2_event[irq - IRQ_EVT_START].event_pin & 0x1F;
@@ -163,42 +171,104 @@ static struct irq_chip lpc313x_evtr_chip = {
 };
 
 
-#define ROUTER_HDLR(n) \
-	static void router##n##_handler (unsigned int irq, struct irq_desc *desc) { \
-		u32 status, bank, bit_pos; \
-		if (IRQ_EVTR##n##_START == IRQ_EVTR##n##_END) { \
-			/* translate IRQ number */ \
-			irq = IRQ_EVTR##n##_START; \
-			generic_handle_irq(irq); \
-		} else { \
-			for (irq = IRQ_EVTR##n##_START; irq <= IRQ_EVTR##n##_END; irq++) {  \
-				/* compute bank & bit position for the event_pin */ \
-				bank = EVT_GET_BANK(irq_2_event[irq - IRQ_EVT_START].event_pin); \
-				bit_pos = irq_2_event[irq - IRQ_EVT_START].event_pin & 0x1F; \
-				status = EVRT_OUT_PEND(n, bank); \
-				if (status & _BIT(bit_pos)) \
-					generic_handle_irq(irq); \
-			} \
-		} \
+/* Event router outputs feeding IRQ_EVT_ROUTER0..3 */
+#define EVT_NR_ROUTERS	4
+
+static const struct {
+	unsigned int start;
+	unsigned int end;
+} evt_router_irqs[EVT_NR_ROUTERS] = {
+	{IRQ_EVTR0_START, IRQ_EVTR0_END},
+	{IRQ_EVTR1_START, IRQ_EVTR1_END},
+	{IRQ_EVTR2_START, IRQ_EVTR2_END},
+	{IRQ_EVTR3_START, IRQ_EVTR3_END},
+};
+
+/* events of each bank routed to each output, and event pin to IRQ */
+static u32 evt_router_mask[EVT_NR_ROUTERS][EVT_MAX_VALID_BANKS] __sram_data;
+static u8 evt_2_irq[EVT_MAX_VALID_BANKS * 32] __sram_data;
+
+static void __sram_text
+evt_router_handler(unsigned int irq, struct irq_desc *desc)
+{
+	unsigned int n = irq - IRQ_EVT_ROUTER0;
+	u32 status, bank, bit_pos;
+
+	if (evt_router_irqs[n].start == evt_router_irqs[n].end) {
+		/* translate IRQ number */
+		generic_handle_irq(evt_router_irqs[n].start);
+		return;
 	}
 
+	/* read each bank once and dispatch its pending events */
+	for (bank = 0; bank < EVT_MAX_VALID_BANKS; bank++) {
+		if (!evt_router_mask[n][bank])
+			continue;
 
-#if IRQ_EVTR0_END
-ROUTER_HDLR(0)
-#endif /* IRQ_EVTR0_END */
+		status = EVRT_OUT_PEND(n, bank) & evt_router_mask[n][bank];
+		while (status) {
+			bit_pos = __ffs(status);
+			status &= ~_BIT(bit_pos);
+			generic_handle_irq(evt_2_irq[(bank << 5) | bit_pos]);
+		}
+	}
+}
 
-#if IRQ_EVTR1_END
-ROUTER_HDLR(1)
-#endif /* IRQ_EVTR1_END */
+#ifdef CONFIG_FIQ
+/*
+ * Route an INTC source to FIQ (on != 0) or back to IRQ. A source routed
+ * to FIQ is enabled right away and can't be requested as an IRQ. Event
+ * router inputs can only be routed as a whole IRQ_EVT_ROUTERn group.
+ */
+int lpc313x_set_fiq(unsigned int irq, int on)
+{
+	if (irq < 1 || irq >= NR_IRQ_CPU)
+		return -EINVAL;
 
-#if IRQ_EVTR2_END
-ROUTER_HDLR(2)
-#endif /* IRQ_EVTR2_END */
+	if (on) {
+		set_irq_flags(irq, 0);
+		INTC_REQ_REG(irq) = INTC_REQ_TARGET_FIQ |
+			INTC_REQ_ENABLE | INTC_REQ_WE_ENABLE;
+	} else {
+		INTC_REQ_REG(irq) = INTC_REQ_TARGET_IRQ | INTC_REQ_WE_ENABLE;
+		set_irq_flags(irq, IRQF_VALID);
+	}
 
-#if IRQ_EVTR3_END
-ROUTER_HDLR(3)
-#endif /* IRQ_EVTR3_END */
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lpc313x_set_fiq);
 
+/* FIQ mode stack for the C handler called from lpc313x_fiq_stub */
+static u8 lpc313x_fiq_stack[1024] __attribute__((aligned(8)));
+
+/*
+ * Claim the FIQ and install a stub calling fn(data) in FIQ mode. fn runs
+ * on its own stack, so it must not sleep, take locks or touch current,
+ * and it has to clear its interrupt source.
+ */
+int lpc313x_claim_fiq(struct fiq_handler *fh, void (*fn)(void *), void *data)
+{
+	struct pt_regs regs;
+	int ret;
+
+	ret = claim_fiq(fh);
+	if (ret)
+		return ret;
+
+	memset(&regs, 0, sizeof(regs));
+	regs.ARM_r8 = (unsigned long)fn;
+	regs.ARM_r9 = (unsigned long)data;
+	regs.ARM_sp = (unsigned long)lpc313x_fiq_stack +
+			sizeof(lpc313x_fiq_stack);
+	set_fiq_regs(&regs);
+
+	set_fiq_handler(&lpc313x_fiq_stub,
+			&lpc313x_fiq_stub_end - &lpc313x_fiq_stub);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lpc313x_claim_fiq);
+#endif /* CONFIG_FIQ */
 
 void __init lpc313x_init_irq(void)
 {
@@ -295,18 +365,17 @@ void __init lpc313x_init_irq(void)
 				printk("Invalid Event type.\r\n");
 				break;
 		}
-		if ( (irq >= IRQ_EVTR0_START) && (irq <= IRQ_EVTR0_END) ) {
-			/* enable routing to vector 0 */
-			EVRT_OUT_MASK_SET(0, bank) = _BIT(bit_pos);
-		} else if ( (irq >= IRQ_EVTR1_START) && (irq <= IRQ_EVTR1_END) ) {
-			/* enable routing to vector 1 */
-			EVRT_OUT_MASK_SET(1, bank) = _BIT(bit_pos);
-		} else if ( (irq >= IRQ_EVTR2_START) && (irq <= IRQ_EVTR2_END) ) {
-			/* enable routing to vector 2 */
-			EVRT_OUT_MASK_SET(2, bank) = _BIT(bit_pos);
-		} else if ( (irq >= IRQ_EVTR3_START) && (irq <= IRQ_EVTR3_END) ) {
-			/* enable routing to vector 3 */
-			EVRT_OUT_MASK_SET(3, bank) = _BIT(bit_pos);
+		for (i = 0; i < EVT_NR_ROUTERS; i++) {
+			if (evt_router_irqs[i].end &&
+			    irq >= evt_router_irqs[i].start &&
+			    irq <= evt_router_irqs[i].end)
+				break;
+		}
+		if (i < EVT_NR_ROUTERS) {
+			/* enable routing to vector i */
+			EVRT_OUT_MASK_SET(i, bank) = _BIT(bit_pos);
+			evt_router_mask[i][bank] |= _BIT(bit_pos);
+			evt_2_irq[(bank << 5) | bit_pos] = irq;
 		} else {
 			printk("Invalid Event router setup.\r\n");
 		}
@@ -316,26 +385,12 @@ void __init lpc313x_init_irq(void)
 	EVRT_ATR(3) &= ~_BIT(12);
 	EVRT_MASK_SET(3) = _BIT(12);
 
-	/* install IRQ_EVT_ROUTER0  chain handler */
-#if IRQ_EVTR0_END
-	/* install chain handler for IRQ_EVT_ROUTER0 */
-	set_irq_chained_handler (IRQ_EVT_ROUTER0, router0_handler);
-#endif
-
-#if IRQ_EVTR1_END
-	/* install chain handler for IRQ_EVT_ROUTER1 */
-	set_irq_chained_handler (IRQ_EVT_ROUTER1, router1_handler);
-#endif
-
-#if IRQ_EVTR2_END
-	/* install chain handler for IRQ_EVT_ROUTER2 */
-	set_irq_chained_handler (IRQ_EVT_ROUTER2, router2_handler);
-#endif
-
-#if IRQ_EVTR3_END
-	/* install chain handler for IRQ_EVT_ROUTER3 */
-	set_irq_chained_handler (IRQ_EVT_ROUTER3, router3_handler);
-#endif
+	/* install chain handlers for the used IRQ_EVT_ROUTERx */
+	for (i = 0; i < EVT_NR_ROUTERS; i++) {
+		if (evt_router_irqs[i].end)
+			set_irq_chained_handler(IRQ_EVT_ROUTER0 + i,
+						evt_router_handler);
+	}
 
 	/* Set the priority treshold to 0, i.e. don't mask any interrupt */
 	/* on the basis of priority level, for both targets (IRQ/FIQ)    */
@@ -30,9 +30,8 @@
 #include <linux/clk.h>
 #include <linux/io.h>
 #include <asm/cacheflush.h>
-
-
-#define LPC313x_ISRAM_VA io_p2v(ISRAM0_PHYS)
+#include <mach/board.h>
+#include <mach/sram.h>
 
 /*
  * Pointers used for sizing and copying suspend function data
@@ -40,18 +39,10 @@
 extern int lpc313x_suspend_mem(void);
 extern int lpc313x_suspend_mem_sz;
 
+/* ISRAM copy of the suspend code, DRAM is unavailable while it runs */
+static int (*lpc313x_suspend_ptr) (u32);
 
-/* Enable/Disable external refresh controller used by
- * auto clock scaling feature of CGU.
- */
-static void lpc313x_ext_refresh_en(int enable)
-{
-	if (enable)
-		SYS_MPMC_TESTMODE0 |= _BIT(12);
-	else
-		SYS_MPMC_TESTMODE0 &= ~_BIT(12);
 
-}
 static int lpc313x_pm_valid_state(suspend_state_t state)
 {
 	switch (state) {
@@ -95,14 +86,9 @@ static void lpc313x_clk_debug(void)
 
 static int lpc313x_enter_sleep(u32 standby)
 {
-	int (*lpc313x_suspend_ptr) (u32);
 	int i;
 	u32 base_clk_state = 0;
 
-#if defined(BACKUP_ISRAM)
-	void *iram_swap_area;
-#endif
-
 	/* print clocks which are still on */
 	lpc313x_clk_debug();
 
@@ -132,44 +118,9 @@ static int lpc313x_enter_sleep(u32 standby)
 		CGU_SB->clk_pcr[CGU_SB_INTC_CLK_ID] = CGU_SB_PCR_RUN;
 	}
 
-
-
-#if defined(BACKUP_ISRAM)
-	/* Allocate some space for temporary IRAM storage */
-	iram_swap_area = kmalloc(lpc313x_suspend_mem_sz, GFP_KERNEL);
-	if (!iram_swap_area) {
-		printk(KERN_ERR
-		       "PM Suspend: cannot allocate memory to save portion "
-			"of SRAM\n");
-		return -ENOMEM;
-	}
-	/* Backup a small area of IRAM used for the suspend code */
-	memcpy(iram_swap_area, (void *) LPC313x_ISRAM_VA,
-			lpc313x_suspend_mem_sz);
-#endif
-
-	/*
-	 * Copy code to suspend system into IRAM. The suspend code
-	 * needs to run from IRAM as DRAM may no longer be available
-	 * when the PLL is stopped.
-	 */
-	memcpy((void *) LPC313x_ISRAM_VA, &lpc313x_suspend_mem,
-			lpc313x_suspend_mem_sz);
-	flush_icache_range((unsigned long)LPC313x_ISRAM_VA,
-		(unsigned long)(LPC313x_ISRAM_VA) + lpc313x_suspend_mem_sz);
-
 	/* Transfer to suspend code in IRAM */
-	lpc313x_suspend_ptr = (void *) LPC313x_ISRAM_VA;
 	(void) lpc313x_suspend_ptr(standby);
 
-#if defined(BACKUP_ISRAM)
-	/* Restore original IRAM contents */
-	memcpy((void *) LPC313x_ISRAM_VA, iram_swap_area,
-			lpc313x_suspend_mem_sz);
-
-	kfree(iram_swap_area);
-#endif
-
 	if (standby == 0) {
 		/* switch on domains clocks which were switched off in this
 		 * routine.
@@ -265,8 +216,25 @@ static struct platform_suspend_ops lpc313x_pm_ops ={
 
 static int __init lpc313x_pm_init(void)
 {
+	void *sram;
+
 	pr_info("LPC31: Power Management init.\n");
 
+	/*
+	 * Copy code to suspend system into IRAM. The suspend code
+	 * needs to run from IRAM as DRAM may no longer be available
+	 * when the PLL is stopped.
+	 */
+	sram = lpc313x_sram_alloc(lpc313x_suspend_mem_sz, NULL);
+	if (!sram) {
+		printk(KERN_ERR "PM: cannot allocate SRAM for suspend code\n");
+		return -ENOMEM;
+	}
+	memcpy(sram, &lpc313x_suspend_mem, lpc313x_suspend_mem_sz);
+	flush_icache_range((unsigned long)sram,
+		(unsigned long)sram + lpc313x_suspend_mem_sz);
+	lpc313x_suspend_ptr = sram;
+
 	/* Make sure all systems clocks are marked
 	 * as wakeable.
 	 */
@@ -0,0 +1,99 @@
+/*  arch/arm/mach-lpc313x/sram.c
+ *
+ *  On-chip SRAM (ISRAM) allocator for LPC313x & LPC315x.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * ISRAM0 is mapped uncached, so buffers handed out here are coherent
+ * for the CPU and the DMA controller alike. With LPC313X_SRAM_TEXT the
+ * first SRAM_TEXT_SIZE bytes hold the __sram_text/__sram_data sections
+ * instead, mapped cached, and the pool covers the rest.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/genalloc.h>
+#include <linux/log2.h>
+#include <asm/cacheflush.h>
+
+#include <mach/hardware.h>
+#include <mach/sram.h>
+
+#define LPC313X_SRAM_VIRT	io_p2v(ISRAM0_PHYS)
+
+#ifdef CONFIG_LPC313X_SRAM_TEXT
+#define LPC313X_SRAM_POOL_OFS	SRAM_TEXT_SIZE
+#else
+#define LPC313X_SRAM_POOL_OFS	0
+#endif
+
+static struct gen_pool *lpc313x_sram_pool;
+
+void *lpc313x_sram_alloc(size_t len, dma_addr_t *dma)
+{
+	unsigned long vaddr;
+
+	if (dma)
+		*dma = 0;
+	if (!lpc313x_sram_pool)
+		return NULL;
+
+	vaddr = gen_pool_alloc(lpc313x_sram_pool, len);
+	if (!vaddr)
+		return NULL;
+
+	if (dma)
+		*dma = ISRAM0_PHYS + (vaddr - LPC313X_SRAM_VIRT);
+	return (void *)vaddr;
+}
+EXPORT_SYMBOL(lpc313x_sram_alloc);
+
+void lpc313x_sram_free(void *addr, size_t len)
+{
+	gen_pool_free(lpc313x_sram_pool, (unsigned long)addr, len);
+}
+EXPORT_SYMBOL(lpc313x_sram_free);
+
+#ifdef CONFIG_LPC313X_SRAM_TEXT
+extern char __sram_start[], __ssram_text[], __esram_text[];
+
+/* Copy the SRAM sections from the kernel image, called from map_io */
+void __init lpc313x_sram_init_text(void)
+{
+	size_t len = __esram_text - __ssram_text;
+
+	memcpy(__ssram_text, __sram_start, len);
+	flush_icache_range((unsigned long)__ssram_text,
+			   (unsigned long)__esram_text);
+}
+#endif
+
+static int __init lpc313x_sram_init(void)
+{
+	int status;
+
+	lpc313x_sram_pool = gen_pool_create(ilog2(SRAM_GRANULARITY), -1);
+	if (!lpc313x_sram_pool)
+		return -ENOMEM;
+
+	status = gen_pool_add(lpc313x_sram_pool,
+			      LPC313X_SRAM_VIRT + LPC313X_SRAM_POOL_OFS,
+			      ISRAM0_LENGTH - LPC313X_SRAM_POOL_OFS, -1);
+	WARN_ON(status < 0);
+	return status;
+}
+core_initcall(lpc313x_sram_init);
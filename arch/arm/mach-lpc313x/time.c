@@ -25,22 +25,87 @@
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/time.h>
+#include <linux/clocksource.h>
+#include <linux/clockchips.h>
 
 #include <mach/hardware.h>
 #include <asm/io.h>
 #include <asm/irq.h>
 #include <asm/leds.h>
+#include <asm/vdso.h>
 
 #include <asm/mach/time.h>
 #include <mach/gpio.h>
 #include <mach/board.h>
-//#include <mach/cgu.h>
+#include <mach/cgu.h>
 
+/*
+ * TIMER0 is used as the clock event device (periodic or oneshot) and
+ * TIMER1 as a free running 32-bit clocksource. TIMER2 and TIMER3 are
+ * left stopped for other users.
+ */
+#define CLKEVT_TIMER_BASE	TIMER0_PHYS
+#define CLKSRC_TIMER_BASE	TIMER1_PHYS
+
+/* Timer ticks per jiffy in periodic mode */
+static u32 lpc313x_timer_latch;
+
+static void lpc313x_clkevt_set_mode(enum clock_event_mode mode,
+		struct clock_event_device *clk)
+{
+	/* Stop the timer and drop any pending interrupt */
+	TIMER_CONTROL(CLKEVT_TIMER_BASE) = 0;
+	TIMER_CLEAR(CLKEVT_TIMER_BASE) = 0;
+
+	switch (mode) {
+	case CLOCK_EVT_MODE_PERIODIC:
+		TIMER_LOAD(CLKEVT_TIMER_BASE) = lpc313x_timer_latch;
+		TIMER_CONTROL(CLKEVT_TIMER_BASE) =
+			(TM_CTRL_ENABLE | TM_CTRL_PERIODIC);
+		break;
+
+	case CLOCK_EVT_MODE_ONESHOT:
+		/* Armed from lpc313x_clkevt_set_next_event() */
+		break;
+
+	case CLOCK_EVT_MODE_UNUSED:
+	case CLOCK_EVT_MODE_SHUTDOWN:
+	case CLOCK_EVT_MODE_RESUME:
+		break;
+	}
+}
+
+static int lpc313x_clkevt_set_next_event(unsigned long delta,
+		struct clock_event_device *clk)
+{
+	/* Free running mode: the interrupt fires when the counter hits 0 */
+	TIMER_CONTROL(CLKEVT_TIMER_BASE) = 0;
+	TIMER_LOAD(CLKEVT_TIMER_BASE) = delta;
+	TIMER_CLEAR(CLKEVT_TIMER_BASE) = 0;
+	TIMER_CONTROL(CLKEVT_TIMER_BASE) = TM_CTRL_ENABLE;
+
+	return 0;
+}
+
+static struct clock_event_device lpc313x_clkevt = {
+	.name		= "lpc313x_timer0",
+	.features	= CLOCK_EVT_FEAT_PERIODIC | CLOCK_EVT_FEAT_ONESHOT,
+	.rating		= 300,
+	.set_next_event	= lpc313x_clkevt_set_next_event,
+	.set_mode	= lpc313x_clkevt_set_mode,
+};
 
 static irqreturn_t lpc313x_timer_interrupt(int irq, void *dev_id)
 {
-	TIMER_CLEAR(TIMER0_PHYS) = 0;
-	timer_tick();
+	struct clock_event_device *evt = &lpc313x_clkevt;
+
+	TIMER_CLEAR(CLKEVT_TIMER_BASE) = 0;
+
+	/* In oneshot mode stop the counter from wrapping and firing again */
+	if (evt->mode == CLOCK_EVT_MODE_ONESHOT)
+		TIMER_CONTROL(CLKEVT_TIMER_BASE) = 0;
+
+	evt->event_handler(evt);
 	return IRQ_HANDLED;
 }
 
@@ -50,47 +115,76 @@ static struct irqaction lpc313x_timer_irq = {
 	.handler	= lpc313x_timer_interrupt,
 };
 
+static cycle_t lpc313x_clksrc_read(struct clocksource *cs)
+{
+	/* Counter runs down, the clocksource core wants it counting up */
+	return (cycle_t)~TIMER_VALUE(CLKSRC_TIMER_BASE);
+}
+
+static struct clocksource lpc313x_clksrc = {
+	.name		= "lpc313x_timer1",
+	.rating		= 300,
+	.read		= lpc313x_clksrc_read,
+	.mask		= CLOCKSOURCE_MASK(32),
+	.flags		= CLOCK_SOURCE_IS_CONTINUOUS,
+};
+
 static void __init lpc313x_timer_init (void)
 {
+	u32 clkevt_rate, clksrc_rate;
+
 	/* Switch on needed Timer clocks & switch off others*/
 	cgu_clk_en_dis(CGU_SB_TIMER0_PCLK_ID, 1);
-	cgu_clk_en_dis(CGU_SB_TIMER1_PCLK_ID, 0);
+	cgu_clk_en_dis(CGU_SB_TIMER1_PCLK_ID, 1);
 	cgu_clk_en_dis(CGU_SB_TIMER2_PCLK_ID, 0);
 	cgu_clk_en_dis(CGU_SB_TIMER3_PCLK_ID, 0);
 
+	clkevt_rate = cgu_get_clk_freq(CGU_SB_TIMER0_PCLK_ID);
+	clksrc_rate = cgu_get_clk_freq(CGU_SB_TIMER1_PCLK_ID);
+
 	/* Stop/disable all timers */
-	TIMER_CONTROL(TIMER0_PHYS) = 0;
+	TIMER_CONTROL(CLKEVT_TIMER_BASE) = 0;
+	TIMER_CONTROL(CLKSRC_TIMER_BASE) = 0;
+	TIMER_CLEAR(CLKEVT_TIMER_BASE) = 0;
+	TIMER_CLEAR(CLKSRC_TIMER_BASE) = 0;
 
-	TIMER_LOAD(TIMER0_PHYS) = LATCH;
-	TIMER_CONTROL(TIMER0_PHYS) = (TM_CTRL_ENABLE | TM_CTRL_PERIODIC);
-	TIMER_CLEAR(TIMER0_PHYS) = 0;
-	setup_irq (IRQ_TIMER0, &lpc313x_timer_irq);
-}
+	/* Free running clocksource, wraps from 0 back to 0xffffffff */
+	TIMER_LOAD(CLKSRC_TIMER_BASE) = 0xffffffff;
+	TIMER_CONTROL(CLKSRC_TIMER_BASE) = TM_CTRL_ENABLE;
 
-/*!
- * Returns number of us since last clock interrupt.  Note that interrupts
- * will have been disabled by do_gettimeoffset()
- */
-static unsigned long lpc313x_gettimeoffset(void)
-{
-	u32 elapsed = LATCH - TIMER_VALUE(TIMER0_PHYS);
-	return ((elapsed * 100) / (XTAL_CLOCK / 20000));
+	clocksource_calc_mult_shift(&lpc313x_clksrc, clksrc_rate, 4);
+	clocksource_register(&lpc313x_clksrc);
+	/* Let the vDSO read the counter, inverted like the read above */
+	arm_vdso_register_counter(&lpc313x_clksrc,
+				  CLKSRC_TIMER_BASE + 0x04, 0xffffffff);
+
+	/* Clock event device, periodic until the tick code goes oneshot */
+	lpc313x_timer_latch = DIV_ROUND_CLOSEST(clkevt_rate, HZ);
+	setup_irq(IRQ_TIMER0, &lpc313x_timer_irq);
+
+	clockevents_calc_mult_shift(&lpc313x_clkevt, clkevt_rate, 4);
+	lpc313x_clkevt.max_delta_ns =
+		clockevent_delta2ns(0xfffffffe, &lpc313x_clkevt);
+	lpc313x_clkevt.min_delta_ns =
+		clockevent_delta2ns(0xf, &lpc313x_clkevt);
+	lpc313x_clkevt.cpumask = cpumask_of(0);
+	clockevents_register_device(&lpc313x_clkevt);
 }
 
 static void lpc313x_timer_suspend(void)
 {
-	TIMER_CONTROL(TIMER0_PHYS) &= ~TM_CTRL_ENABLE;	/* disable timers */
+	/* disable the clocksource, clockevents are shut down by the core */
+	TIMER_CONTROL(CLKSRC_TIMER_BASE) &= ~TM_CTRL_ENABLE;
 }
 
 static void lpc313x_timer_resume(void)
 {
-	TIMER_CONTROL(TIMER0_PHYS) |= TM_CTRL_ENABLE;	/* enable timers */
+	TIMER_CONTROL(CLKSRC_TIMER_BASE) |= TM_CTRL_ENABLE;
 }
 
 
 struct sys_timer lpc313x_timer = {
 	.init = lpc313x_timer_init,
-	.offset = lpc313x_gettimeoffset,
 	.suspend = lpc313x_timer_suspend,
 	.resume = lpc313x_timer_resume,
 };
@@ -0,0 +1,213 @@
+/*
+ * Userspace implementations of gettimeofday() and clock_gettime().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This runs in user mode inside the vDSO: no libgcc is linked in, so
+ * stay away from 64-bit divisions and variable 64-bit shifts.
+ */
+#include <linux/compiler.h>
+#include <linux/types.h>
+#include <linux/time.h>
+#include <asm/system.h>
+#include <asm/unistd.h>
+#include <asm/vdso.h>
+#include <asm/vdso_datapage.h>
+
+extern const struct vdso_data *__get_datapage(void);
+
+static notrace long clock_gettime_fallback(clockid_t clock,
+					   struct timespec *ts)
+{
+	register long r0 asm("r0") = clock;
+	register struct timespec *r1 asm("r1") = ts;
+	register long r7 asm("r7") = __NR_clock_gettime;
+
+	asm volatile("swi #0"
+		     : "+r" (r0)
+		     : "r" (r1), "r" (r7)
+		     : "memory");
+
+	return r0;
+}
+
+static notrace long gettimeofday_fallback(struct timeval *tv,
+					  struct timezone *tz)
+{
+	register struct timeval *r0 asm("r0") = tv;
+	register struct timezone *r1 asm("r1") = tz;
+	register long r7 asm("r7") = __NR_gettimeofday;
+
+	asm volatile("swi #0"
+		     : "+r" (r0)
+		     : "r" (r1), "r" (r7)
+		     : "memory");
+
+	return (long)r0;
+}
+
+static notrace u32 vdso_read_begin(const struct vdso_data *vd)
+{
+	u32 seq;
+
+	do {
+		seq = ACCESS_ONCE(vd->seq);
+	} while (seq & 1);
+	smp_rmb();
+
+	return seq;
+}
+
+static notrace int vdso_read_retry(const struct vdso_data *vd, u32 start)
+{
+	smp_rmb();
+	return ACCESS_ONCE(vd->seq) != start;
+}
+
+/* (hi:lo) >> shift for shift < 32, without calling into libgcc */
+static notrace u64 vdso_shr64(u64 val, u32 shift)
+{
+	u32 hi = val >> 32, lo = val;
+
+	if (!shift)
+		return val;
+
+	return ((u64)(hi >> shift) << 32) | (lo >> shift) |
+		(hi << (32 - shift));
+}
+
+static notrace u64 vdso_get_ns(const struct vdso_data *vd)
+{
+	const void *counter = (const void *)vd + VDSO_COUNTER_PAGE_OFFSET;
+	u32 raw = *(const volatile u32 *)(counter + vd->cs_reg_offset);
+	u64 cycles = ((u64)(raw ^ vd->cs_xor) - vd->cs_cycle_last) &
+		vd->cs_mask;
+
+	return vdso_shr64(cycles * vd->cs_mult, vd->cs_shift);
+}
+
+static notrace void vdso_set_ts(struct timespec *ts, long sec, u64 ns)
+{
+	/* ns is below a few seconds here, so this loops at most a few times */
+	while (ns >= NSEC_PER_SEC) {
+		ns -= NSEC_PER_SEC;
+		sec++;
+	}
+	ts->tv_sec = sec;
+	ts->tv_nsec = ns;
+}
+
+static notrace int do_realtime(const struct vdso_data *vd,
+			       struct timespec *ts)
+{
+	u32 seq, sec, nsec;
+	u64 ns;
+
+	do {
+		seq = vdso_read_begin(vd);
+		if (!vd->cs_valid)
+			return -1;
+		sec = vd->xtime_sec;
+		nsec = vd->xtime_nsec;
+		ns = vdso_get_ns(vd);
+	} while (vdso_read_retry(vd, seq));
+
+	vdso_set_ts(ts, sec, ns + nsec);
+	return 0;
+}
+
+static notrace int do_monotonic(const struct vdso_data *vd,
+				struct timespec *ts)
+{
+	u32 seq, nsec;
+	long sec;
+	u64 ns;
+
+	do {
+		seq = vdso_read_begin(vd);
+		if (!vd->cs_valid)
+			return -1;
+		sec = (long)vd->xtime_sec + (s32)vd->wtm_sec;
+		nsec = vd->xtime_nsec + vd->wtm_nsec;
+		ns = vdso_get_ns(vd);
+	} while (vdso_read_retry(vd, seq));
+
+	vdso_set_ts(ts, sec, ns + nsec);
+	return 0;
+}
+
+static notrace void do_realtime_coarse(const struct vdso_data *vd,
+				       struct timespec *ts)
+{
+	u32 seq, sec, nsec;
+
+	do {
+		seq = vdso_read_begin(vd);
+		sec = vd->xtime_sec;
+		nsec = vd->xtime_nsec;
+	} while (vdso_read_retry(vd, seq));
+
+	ts->tv_sec = sec;
+	ts->tv_nsec = nsec;
+}
+
+static notrace void do_monotonic_coarse(const struct vdso_data *vd,
+					struct timespec *ts)
+{
+	u32 seq, nsec;
+	long sec;
+
+	do {
+		seq = vdso_read_begin(vd);
+		sec = (long)vd->xtime_sec + (s32)vd->wtm_sec;
+		nsec = vd->xtime_nsec + vd->wtm_nsec;
+	} while (vdso_read_retry(vd, seq));
+
+	vdso_set_ts(ts, sec, nsec);
+}
+
+notrace int __vdso_clock_gettime(clockid_t clock, struct timespec *ts)
+{
+	const struct vdso_data *vd = __get_datapage();
+
+	switch (clock) {
+	case CLOCK_REALTIME_COARSE:
+		do_realtime_coarse(vd, ts);
+		return 0;
+	case CLOCK_MONOTONIC_COARSE:
+		do_monotonic_coarse(vd, ts);
+		return 0;
+	case CLOCK_REALTIME:
+		if (!do_realtime(vd, ts))
+			return 0;
+		break;
+	case CLOCK_MONOTONIC:
+		if (!do_monotonic(vd, ts))
+			return 0;
+		break;
+	}
+
+	return clock_gettime_fallback(clock, ts);
+}
+
+notrace int __vdso_gettimeofday(struct timeval *tv, struct timezone *tz)
+{
+	const struct vdso_data *vd = __get_datapage();
+	struct timespec ts;
+
+	if (tv) {
+		if (do_realtime(vd, &ts))
+			return gettimeofday_fallback(tv, tz);
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = (u32)ts.tv_nsec / 1000;
+	}
+
+	if (tz) {
+		tz->tz_minuteswest = vd->tz_minuteswest;
+		tz->tz_dsttime = vd->tz_dsttime;
+	}
+
+	return 0;
+}
@@ -2509,7 +2509,8 @@ int __init blk_dev_init(void)
 	BUILD_BUG_ON(__REQ_NR_BITS > 8 *
 			sizeof(((struct request *)0)->cmd_flags));
 
-	kblockd_workqueue = create_workqueue("kblockd");
+	/* unplugging may be needed to free memory, keep a rescuer */
+	kblockd_workqueue = alloc_workqueue("kblockd", WQ_RESCUER, 1);
 	if (!kblockd_workqueue)
 		panic("Failed to create kblockd\n");
 
@@ -0,0 +1,1152 @@
+/*
+ * drivers/dma/lpc313x_dmac.c
+ *
+ * dmaengine driver for the LPC313x and LPC315x DMA controller
+ *
+ * Based on drivers/dma/dw_dmac.c, Copyright (C) 2007-2008 Atmel
+ * Corporation, and on the channel handling in
+ * arch/arm/mach-lpc313x/dma.c.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmapool.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+
+#include <mach/hardware.h>
+#include <mach/dma.h>
+#include <mach/sram.h>
+#include <mach/lpc313x_dmac.h>
+
+/*
+ * The controller has no native descriptor fetch. Linked list transfers
+ * are done with a pair of hardware channels: the companion (higher)
+ * channel copies one dma_sg_ll_t entry into the alternate registers of
+ * the data (lower) channel, which starts it. An entry with
+ * DMA_CFG_CMP_CH_EN set re-triggers the companion when it finishes, so
+ * the next entry is loaded without any CPU involvement.
+ *
+ * The legacy allocator in arch/arm/mach-lpc313x/dma.c owns all twelve
+ * hardware channels and IRQ_DMA. There is no fixed split between the two
+ * APIs: a dmaengine channel borrows a free adjacent pair from the legacy
+ * allocator in alloc_chan_resources() and gives it back in
+ * free_chan_resources(), so with nr_channels dmaengine channels in use
+ * at most 2 * nr_channels hardware channels are taken from old style
+ * clients. Whichever side asks first gets a channel.
+ *
+ * The linked list entries of a channel are put in ISRAM when there is
+ * room, so the companion fetches don't compete with the CPU for SDRAM.
+ *
+ * The controller does not tell us which entry it is working on, so
+ * every transaction ends with a one word memory to memory "marker"
+ * entry copying the transaction cookie into a per-channel status word.
+ * Completion is then simply a matter of reading that word.
+ */
+
+/* Maximum number of transfers per linked list entry */
+#define LPC313X_DMAC_MAX_COUNT	(DMA_MAX_TRANSFERS + 1)
+
+/*
+ * Number of descriptors (= linked list entries) to allocate for each
+ * channel. A cyclic ring of 64 periods needs an entry and a marker per
+ * period, a 512KiB word-wide transfer 64 entries plus the marker.
+ */
+#define NR_DESCS_PER_CHANNEL	132
+
+/* Bits in lpc313x_dmac_chan.flags */
+#define LPC313X_DMAC_IS_CYCLIC	0
+
+struct lpc313x_dmac_lli {
+	dma_sg_ll_t	ll;
+	/* copied into the channel status word by the marker entry */
+	u32		seq;
+};
+
+struct lpc313x_dmac_desc {
+	struct dma_async_tx_descriptor	txd;
+	struct lpc313x_dmac_lli		*lli;
+	struct list_head		desc_node;
+	struct list_head		tx_list;
+	size_t				len;
+	dma_addr_t			src;
+	dma_addr_t			dst;
+};
+
+struct lpc313x_dmac_chan {
+	struct dma_chan		chan;
+	spinlock_t		lock;
+
+	/* companion channel, the data channel is hw_chn - 1 */
+	int			hw_chn;
+	volatile u32		*status;
+	dma_addr_t		status_phys;
+
+	dma_cookie_t		completed;
+	unsigned long		flags;
+	struct list_head	active_list;
+	struct list_head	queue;
+	struct list_head	free_list;
+	unsigned int		descs_allocated;
+	struct tasklet_struct	tasklet;
+
+	/* linked list entries in ISRAM, or NULL if they come from lli_pool */
+	struct lpc313x_dmac_lli	*lli_sram;
+	dma_addr_t		lli_sram_phys;
+
+	/* cyclic transfers */
+	struct lpc313x_dma_cyclic	*cdesc;
+	struct lpc313x_dmac_desc	**periods;
+	unsigned int			cyclic_last;
+};
+
+struct lpc313x_dmac {
+	struct dma_device	dma;
+	struct dma_pool		*lli_pool;
+	u32			*status;
+	dma_addr_t		status_phys;
+	struct lpc313x_dmac_chan chan[0];
+};
+
+/* Byte shift for each DMA_TRANSFER_xxx size */
+static const unsigned int lpc313x_dmac_width_shift[] = {
+	[DMA_TRANSFER_WORD]		= 2,
+	[DMA_TRANSFER_HALF_WORD]	= 1,
+	[DMA_TRANSFER_BYTE]		= 0,
+	[DMA_TRANSFER_BURST]		= 4,
+};
+
+static inline struct lpc313x_dmac_chan *to_lpc313x_dmac_chan(struct dma_chan *chan)
+{
+	return container_of(chan, struct lpc313x_dmac_chan, chan);
+}
+
+static inline struct lpc313x_dmac *to_lpc313x_dmac(struct dma_device *ddev)
+{
+	return container_of(ddev, struct lpc313x_dmac, dma);
+}
+
+static inline struct lpc313x_dmac_desc *txd_to_lpc313x_desc(
+		struct dma_async_tx_descriptor *txd)
+{
+	return container_of(txd, struct lpc313x_dmac_desc, txd);
+}
+
+static struct device *chan2dev(struct dma_chan *chan)
+{
+	return &chan->dev->device;
+}
+
+static struct device *chan2parent(struct dma_chan *chan)
+{
+	return chan->dev->device.parent;
+}
+
+static struct lpc313x_dmac_desc *lpc313x_dmac_first_active(
+		struct lpc313x_dmac_chan *c)
+{
+	return list_entry(c->active_list.next, struct lpc313x_dmac_desc,
+			desc_node);
+}
+
+/* Last linked list entry of a transaction, always its marker */
+static struct lpc313x_dmac_desc *lpc313x_dmac_last_lli(
+		struct lpc313x_dmac_desc *first)
+{
+	if (list_empty(&first->tx_list))
+		return first;
+	return list_entry(first->tx_list.prev, struct lpc313x_dmac_desc,
+			desc_node);
+}
+
+/*----------------------------------------------------------------------*/
+
+static struct lpc313x_dmac_desc *lpc313x_dmac_desc_get(
+		struct lpc313x_dmac_chan *c)
+{
+	struct lpc313x_dmac_desc *desc, *_desc;
+	struct lpc313x_dmac_desc *ret = NULL;
+
+	spin_lock_bh(&c->lock);
+	list_for_each_entry_safe(desc, _desc, &c->free_list, desc_node) {
+		if (async_tx_test_ack(&desc->txd)) {
+			list_del(&desc->desc_node);
+			ret = desc;
+			break;
+		}
+	}
+	spin_unlock_bh(&c->lock);
+
+	return ret;
+}
+
+/*
+ * Move a descriptor, including any children, to the free list.
+ * `desc' must not be on any lists.
+ */
+static void lpc313x_dmac_desc_put(struct lpc313x_dmac_chan *c,
+		struct lpc313x_dmac_desc *desc)
+{
+	if (desc) {
+		spin_lock_bh(&c->lock);
+		list_splice_init(&desc->tx_list, &c->free_list);
+		list_add(&desc->desc_node, &c->free_list);
+		spin_unlock_bh(&c->lock);
+	}
+}
+
+/* Called with c->lock held and bh disabled */
+static dma_cookie_t lpc313x_dmac_assign_cookie(struct lpc313x_dmac_chan *c,
+		struct lpc313x_dmac_desc *desc)
+{
+	dma_cookie_t cookie = c->chan.cookie;
+
+	if (++cookie < 0)
+		cookie = 1;
+
+	c->chan.cookie = cookie;
+	desc->txd.cookie = cookie;
+
+	return cookie;
+}
+
+/*----------------------------------------------------------------------*/
+
+static inline int lpc313x_dmac_busy(struct lpc313x_dmac_chan *c)
+{
+	return (DMACH_EN(c->hw_chn) | DMACH_EN(c->hw_chn - 1)) & 1;
+}
+
+static void lpc313x_dmac_halt(struct lpc313x_dmac_chan *c)
+{
+	DMACH_EN(c->hw_chn) = 0;
+	DMACH_EN(c->hw_chn - 1) = 0;
+}
+
+/* Called with c->lock held and bh disabled */
+static void lpc313x_dmac_dostart(struct lpc313x_dmac_chan *c,
+		struct lpc313x_dmac_desc *first)
+{
+	unsigned int data_chn = c->hw_chn - 1;
+
+	/* ASSERT:  channel is idle */
+	if (lpc313x_dmac_busy(c)) {
+		dev_err(chan2dev(&c->chan),
+			"BUG: Attempted to start non-idle channel\n");
+		return;
+	}
+
+	DMACH_TCNT(data_chn) = 0;
+
+	/* Companion loads the first entry into the data channel */
+	DMACH_SRC_ADDR(c->hw_chn) = first->txd.phys;
+	DMACH_DST_ADDR(c->hw_chn) = DMACH_ALT_PHYS(data_chn);
+	DMACH_LEN(c->hw_chn) = 0x4;
+	DMACH_CFG(c->hw_chn) = DMA_CFG_CMP_CH_EN | DMA_CFG_CMP_CH_NR(data_chn);
+	DMACH_EN(c->hw_chn) = 1;
+}
+
+/*
+ * Let the controller continue from entry `last' into the entry at
+ * `next'. The next pointer must be visible before the companion enable.
+ */
+static void lpc313x_dmac_link(struct lpc313x_dmac_chan *c,
+		struct lpc313x_dmac_desc *last, dma_addr_t next)
+{
+	last->lli->ll.next_entry = next;
+	wmb();
+	last->lli->ll.setup.cfg |= DMA_CFG_CMP_CH_EN |
+		DMA_CFG_CMP_CH_NR(c->hw_chn);
+}
+
+/* Called with c->lock held and bh disabled */
+static void lpc313x_dmac_start_queued(struct lpc313x_dmac_chan *c)
+{
+	struct lpc313x_dmac_desc *desc, *prev = NULL;
+	struct lpc313x_dmac_desc *first;
+
+	if (list_empty(&c->queue))
+		return;
+
+	/* Chain the queued transactions behind each other */
+	list_for_each_entry(desc, &c->queue, desc_node) {
+		if (prev)
+			lpc313x_dmac_link(c, lpc313x_dmac_last_lli(prev),
+					desc->txd.phys);
+		prev = desc;
+	}
+
+	first = list_entry(c->queue.next, struct lpc313x_dmac_desc, desc_node);
+
+	if (list_empty(&c->active_list)) {
+		list_splice_tail_init(&c->queue, &c->active_list);
+		lpc313x_dmac_dostart(c, first);
+		return;
+	}
+
+	/*
+	 * Append to the running chain. If the controller already fetched
+	 * the old tail it stops there and the tasklet restarts it.
+	 */
+	prev = list_entry(c->active_list.prev, struct lpc313x_dmac_desc,
+			desc_node);
+	lpc313x_dmac_link(c, lpc313x_dmac_last_lli(prev), first->txd.phys);
+	list_splice_tail_init(&c->queue, &c->active_list);
+}
+
+/*----------------------------------------------------------------------*/
+
+static void lpc313x_dmac_descriptor_complete(struct lpc313x_dmac_chan *c,
+		struct lpc313x_dmac_desc *desc)
+{
+	dma_async_tx_callback		callback;
+	void				*param;
+	struct dma_async_tx_descriptor	*txd = &desc->txd;
+
+	dev_vdbg(chan2dev(&c->chan), "descriptor %u complete\n", txd->cookie);
+
+	c->completed = txd->cookie;
+	callback = txd->callback;
+	param = txd->callback_param;
+
+	list_splice_init(&desc->tx_list, &c->free_list);
+	list_move(&desc->desc_node, &c->free_list);
+
+	if (!c->chan.private) {
+		struct device *parent = chan2parent(&c->chan);
+		if (!(txd->flags & DMA_COMPL_SKIP_DEST_UNMAP)) {
+			if (txd->flags & DMA_COMPL_DEST_UNMAP_SINGLE)
+				dma_unmap_single(parent, desc->dst,
+						desc->len, DMA_FROM_DEVICE);
+			else
+				dma_unmap_page(parent, desc->dst,
+						desc->len, DMA_FROM_DEVICE);
+		}
+		if (!(txd->flags & DMA_COMPL_SKIP_SRC_UNMAP)) {
+			if (txd->flags & DMA_COMPL_SRC_UNMAP_SINGLE)
+				dma_unmap_single(parent, desc->src,
+						desc->len, DMA_TO_DEVICE);
+			else
+				dma_unmap_page(parent, desc->src,
+						desc->len, DMA_TO_DEVICE);
+		}
+	}
+
+	/*
+	 * The API requires that no submissions are done from a
+	 * callback, so we don't need to drop the lock here
+	 */
+	if (callback)
+		callback(param);
+}
+
+/* Called with c->lock held and bh disabled */
+static void lpc313x_dmac_scan_descriptors(struct lpc313x_dmac_chan *c)
+{
+	struct lpc313x_dmac_desc *desc, *_desc;
+	dma_cookie_t done = (dma_cookie_t)*c->status;
+	dma_cookie_t cookie;
+	int found = 0;
+
+	list_for_each_entry(desc, &c->active_list, desc_node) {
+		if (desc->txd.cookie == done) {
+			found = 1;
+			break;
+		}
+	}
+
+	/* Everything up to the last marker written is done */
+	if (found) {
+		list_for_each_entry_safe(desc, _desc, &c->active_list,
+				desc_node) {
+			cookie = desc->txd.cookie;
+			lpc313x_dmac_descriptor_complete(c, desc);
+			if (cookie == done)
+				break;
+		}
+	}
+
+	/* A transaction was linked in after the old tail was fetched */
+	if (!list_empty(&c->active_list) && !lpc313x_dmac_busy(c))
+		lpc313x_dmac_dostart(c, lpc313x_dmac_first_active(c));
+}
+
+static void lpc313x_dmac_tasklet(unsigned long data)
+{
+	struct lpc313x_dmac_chan *c = (struct lpc313x_dmac_chan *)data;
+	struct lpc313x_dma_cyclic *cdesc;
+	unsigned int cur, n = 0;
+
+	spin_lock(&c->lock);
+
+	if (!test_bit(LPC313X_DMAC_IS_CYCLIC, &c->flags)) {
+		lpc313x_dmac_scan_descriptors(c);
+		spin_unlock(&c->lock);
+		return;
+	}
+
+	/* Count the periods finished since the last run */
+	cdesc = c->cdesc;
+	cur = *c->status;
+	if (cur < cdesc->periods) {
+		while (c->cyclic_last != cur) {
+			if (++c->cyclic_last == cdesc->periods)
+				c->cyclic_last = 0;
+			n++;
+		}
+	}
+
+	spin_unlock(&c->lock);
+
+	if (cdesc->period_callback)
+		while (n--)
+			cdesc->period_callback(cdesc->period_callback_param);
+}
+
+/* Called by the legacy IRQ_DMA dispatcher for the data channel */
+static void lpc313x_dmac_irq(int chn, dma_irq_type_t type, void *data)
+{
+	struct lpc313x_dmac_chan *c = data;
+
+	if (type == DMA_IRQ_DMAABORT)
+		dev_err(chan2dev(&c->chan), "transfer aborted\n");
+
+	tasklet_schedule(&c->tasklet);
+}
+
+/*----------------------------------------------------------------------*/
+
+static dma_cookie_t lpc313x_dmac_tx_submit(struct dma_async_tx_descriptor *tx)
+{
+	struct lpc313x_dmac_desc *desc = txd_to_lpc313x_desc(tx);
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(tx->chan);
+	dma_cookie_t cookie;
+
+	spin_lock_bh(&c->lock);
+	cookie = lpc313x_dmac_assign_cookie(c, desc);
+	lpc313x_dmac_last_lli(desc)->lli->seq = cookie;
+	list_add_tail(&desc->desc_node, &c->queue);
+	spin_unlock_bh(&c->lock);
+
+	return cookie;
+}
+
+/* Add one linked list entry to the transaction started by *first */
+static int lpc313x_dmac_append(struct lpc313x_dmac_chan *c,
+		struct lpc313x_dmac_desc **first, struct lpc313x_dmac_desc **prev,
+		u32 src, u32 dst, u32 count, u32 cfg)
+{
+	struct lpc313x_dmac_desc *desc;
+
+	desc = lpc313x_dmac_desc_get(c);
+	if (!desc) {
+		dev_err(chan2dev(&c->chan),
+			"not enough descriptors available\n");
+		return -ENOMEM;
+	}
+
+	desc->lli->ll.setup.src_address = src;
+	desc->lli->ll.setup.dest_address = dst;
+	desc->lli->ll.setup.trans_length = count - 1;
+	desc->lli->ll.setup.cfg = cfg | DMA_CFG_CMP_CH_EN |
+		DMA_CFG_CMP_CH_NR(c->hw_chn);
+	desc->lli->ll.next_entry = 0;
+
+	if (!*first) {
+		*first = desc;
+	} else {
+		(*prev)->lli->ll.next_entry = desc->txd.phys;
+		list_add_tail(&desc->desc_node, &(*first)->tx_list);
+	}
+	*prev = desc;
+
+	return 0;
+}
+
+/* Split a block in entries of at most LPC313X_DMAC_MAX_COUNT transfers */
+static int lpc313x_dmac_append_block(struct lpc313x_dmac_chan *c,
+		struct lpc313x_dmac_desc **first, struct lpc313x_dmac_desc **prev,
+		u32 src, int src_inc, u32 dst, int dst_inc, size_t len,
+		unsigned int shift, u32 cfg)
+{
+	u32 count;
+	int ret;
+
+	while (len) {
+		count = min_t(size_t, len >> shift, LPC313X_DMAC_MAX_COUNT);
+
+		ret = lpc313x_dmac_append(c, first, prev, src, dst, count, cfg);
+		if (ret)
+			return ret;
+
+		if (src_inc)
+			src += count << shift;
+		if (dst_inc)
+			dst += count << shift;
+		len -= count << shift;
+	}
+
+	return 0;
+}
+
+/* Terminate the transaction with its completion marker */
+static int lpc313x_dmac_append_marker(struct lpc313x_dmac_chan *c,
+		struct lpc313x_dmac_desc **first, struct lpc313x_dmac_desc **prev)
+{
+	struct lpc313x_dmac_desc *marker;
+	int ret;
+
+	ret = lpc313x_dmac_append(c, first, prev, 0, c->status_phys, 1,
+			DMA_CFG_TX_WORD);
+	if (ret)
+		return ret;
+
+	marker = *prev;
+	marker->lli->ll.setup.src_address = marker->txd.phys +
+		offsetof(struct lpc313x_dmac_lli, seq);
+	/* End of chain until another transaction is linked in */
+	marker->lli->ll.setup.cfg = DMA_CFG_TX_WORD;
+
+	return 0;
+}
+
+static struct dma_async_tx_descriptor *
+lpc313x_dmac_prep_dma_memcpy(struct dma_chan *chan, dma_addr_t dest,
+		dma_addr_t src, size_t len, unsigned long flags)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	struct lpc313x_dmac_desc *first = NULL, *prev = NULL;
+	unsigned int width;
+
+	dev_vdbg(chan2dev(chan), "prep_dma_memcpy d0x%x s0x%x l0x%zx f0x%lx\n",
+			dest, src, len, flags);
+
+	if (unlikely(!len))
+		return NULL;
+
+	if (!((src | dest | len) & 3))
+		width = DMA_TRANSFER_WORD;
+	else if (!((src | dest | len) & 1))
+		width = DMA_TRANSFER_HALF_WORD;
+	else
+		width = DMA_TRANSFER_BYTE;
+
+	if (lpc313x_dmac_append_block(c, &first, &prev, src, 1, dest, 1, len,
+			lpc313x_dmac_width_shift[width], _SBF(10, width)))
+		goto err_desc_get;
+	if (lpc313x_dmac_append_marker(c, &first, &prev))
+		goto err_desc_get;
+
+	first->txd.flags = flags;
+	first->len = len;
+	first->src = src;
+	first->dst = dest;
+
+	return &first->txd;
+
+err_desc_get:
+	lpc313x_dmac_desc_put(c, first);
+	return NULL;
+}
+
+static struct dma_async_tx_descriptor *
+lpc313x_dmac_prep_slave_sg(struct dma_chan *chan, struct scatterlist *sgl,
+		unsigned int sg_len, enum dma_data_direction direction,
+		unsigned long flags)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	struct lpc313x_dma_slave *dws = chan->private;
+	struct lpc313x_dmac_desc *first = NULL, *prev = NULL;
+	struct scatterlist *sg;
+	unsigned int i, shift;
+	size_t total_len = 0;
+	u32 cfg;
+	int ret;
+
+	if (unlikely(!dws || !sg_len))
+		return NULL;
+
+	shift = lpc313x_dmac_width_shift[dws->width];
+	cfg = _SBF(10, dws->width);
+
+	switch (direction) {
+	case DMA_TO_DEVICE:
+		cfg |= DMA_CFG_WR_SLV_NR(dws->slave_nr);
+		break;
+	case DMA_FROM_DEVICE:
+		cfg |= DMA_CFG_RD_SLV_NR(dws->slave_nr);
+		break;
+	default:
+		return NULL;
+	}
+
+	for_each_sg(sgl, sg, sg_len, i) {
+		u32 mem = sg_dma_address(sg);
+		u32 len = sg_dma_len(sg);
+
+		if (unlikely((mem | len) & ((1 << shift) - 1))) {
+			dev_err(chan2dev(chan), "unaligned slave transfer\n");
+			goto err_desc_get;
+		}
+
+		if (direction == DMA_TO_DEVICE)
+			ret = lpc313x_dmac_append_block(c, &first, &prev,
+					mem, 1, dws->tx_reg, 0, len, shift, cfg);
+		else
+			ret = lpc313x_dmac_append_block(c, &first, &prev,
+					dws->rx_reg, 0, mem, 1, len, shift, cfg);
+		if (ret)
+			goto err_desc_get;
+
+		total_len += len;
+	}
+
+	if (lpc313x_dmac_append_marker(c, &first, &prev))
+		goto err_desc_get;
+
+	first->txd.flags = flags;
+	first->len = total_len;
+
+	return &first->txd;
+
+err_desc_get:
+	lpc313x_dmac_desc_put(c, first);
+	return NULL;
+}
+
+static void lpc313x_dmac_terminate_all(struct dma_chan *chan)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	struct lpc313x_dmac_desc *desc, *_desc;
+	LIST_HEAD(list);
+
+	spin_lock_bh(&c->lock);
+
+	lpc313x_dmac_halt(c);
+
+	/* active_list entries will end up before queued entries */
+	list_splice_init(&c->queue, &list);
+	list_splice_init(&c->active_list, &list);
+
+	/* Flush all pending and queued descriptors */
+	list_for_each_entry_safe(desc, _desc, &list, desc_node)
+		lpc313x_dmac_descriptor_complete(c, desc);
+
+	spin_unlock_bh(&c->lock);
+}
+
+static enum dma_status
+lpc313x_dmac_is_tx_complete(struct dma_chan *chan, dma_cookie_t cookie,
+		dma_cookie_t *done, dma_cookie_t *used)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	dma_cookie_t last_used;
+	dma_cookie_t last_complete;
+	int ret;
+
+	last_complete = c->completed;
+	last_used = chan->cookie;
+
+	ret = dma_async_is_complete(cookie, last_complete, last_used);
+	if (ret != DMA_SUCCESS) {
+		spin_lock_bh(&c->lock);
+		lpc313x_dmac_scan_descriptors(c);
+		spin_unlock_bh(&c->lock);
+
+		last_complete = c->completed;
+		last_used = chan->cookie;
+
+		ret = dma_async_is_complete(cookie, last_complete, last_used);
+	}
+
+	if (done)
+		*done = last_complete;
+	if (used)
+		*used = last_used;
+
+	return ret;
+}
+
+static void lpc313x_dmac_issue_pending(struct dma_chan *chan)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+
+	spin_lock_bh(&c->lock);
+	lpc313x_dmac_start_queued(c);
+	spin_unlock_bh(&c->lock);
+}
+
+static int lpc313x_dmac_alloc_chan_resources(struct dma_chan *chan)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	struct lpc313x_dmac *dmac = to_lpc313x_dmac(chan->device);
+	struct lpc313x_dma_slave *dws = chan->private;
+	struct lpc313x_dmac_desc *desc;
+	int hw_chn;
+	int i;
+
+	/* We need controller-specific data to set up slave transfers */
+	BUG_ON(dws && dws->dma_dev != dmac->dma.dev);
+
+	if (c->hw_chn < 0) {
+		hw_chn = dma_request_sg_channel((char *)dev_name(chan2dev(chan)),
+				NULL, NULL, lpc313x_dmac_irq, c, 0);
+		if (hw_chn < 0) {
+			dev_dbg(chan2dev(chan), "no free channel pair\n");
+			return hw_chn;
+		}
+		c->hw_chn = hw_chn;
+
+		/* FINISHED interrupt of the data channel only */
+		dma_set_irq_mask(hw_chn, 1, 1);
+		dma_set_irq_mask(hw_chn - 1, 1, 0);
+	}
+
+	c->completed = chan->cookie = 1;
+	*c->status = 0;
+
+	if (!c->descs_allocated)
+		c->lli_sram = lpc313x_sram_alloc(NR_DESCS_PER_CHANNEL *
+				sizeof(struct lpc313x_dmac_lli),
+				&c->lli_sram_phys);
+
+	spin_lock_bh(&c->lock);
+	i = c->descs_allocated;
+	while (c->descs_allocated < NR_DESCS_PER_CHANNEL) {
+		spin_unlock_bh(&c->lock);
+
+		desc = kzalloc(sizeof(struct lpc313x_dmac_desc), GFP_KERNEL);
+		if (desc && c->lli_sram) {
+			desc->lli = &c->lli_sram[i];
+			desc->txd.phys = c->lli_sram_phys +
+				i * sizeof(struct lpc313x_dmac_lli);
+		} else if (desc) {
+			desc->lli = dma_pool_alloc(dmac->lli_pool, GFP_KERNEL,
+					&desc->txd.phys);
+		}
+		if (!desc || !desc->lli) {
+			kfree(desc);
+			dev_info(chan2dev(chan),
+				"only allocated %d descriptors\n", i);
+			spin_lock_bh(&c->lock);
+			break;
+		}
+
+		INIT_LIST_HEAD(&desc->tx_list);
+		dma_async_tx_descriptor_init(&desc->txd, chan);
+		desc->txd.tx_submit = lpc313x_dmac_tx_submit;
+		desc->txd.flags = DMA_CTRL_ACK;
+		lpc313x_dmac_desc_put(c, desc);
+
+		spin_lock_bh(&c->lock);
+		i = ++c->descs_allocated;
+	}
+	spin_unlock_bh(&c->lock);
+
+	dev_dbg(chan2dev(chan), "channel pair %d/%d, %d descriptors\n",
+		c->hw_chn - 1, c->hw_chn, i);
+
+	return i;
+}
+
+static void lpc313x_dmac_free_chan_resources(struct dma_chan *chan)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	struct lpc313x_dmac *dmac = to_lpc313x_dmac(chan->device);
+	struct lpc313x_dmac_desc *desc, *_desc;
+	LIST_HEAD(list);
+
+	/* ASSERT:  channel is idle */
+	BUG_ON(!list_empty(&c->active_list));
+	BUG_ON(!list_empty(&c->queue));
+	BUG_ON(lpc313x_dmac_busy(c));
+
+	spin_lock_bh(&c->lock);
+	list_splice_init(&c->free_list, &list);
+	c->descs_allocated = 0;
+	spin_unlock_bh(&c->lock);
+
+	tasklet_kill(&c->tasklet);
+
+	/* Give the hardware pair back to the legacy allocator */
+	dma_set_irq_mask(c->hw_chn - 1, 1, 1);
+	dma_release_sg_channel(c->hw_chn);
+	c->hw_chn = -1;
+
+	list_for_each_entry_safe(desc, _desc, &list, desc_node) {
+		if (!c->lli_sram)
+			dma_pool_free(dmac->lli_pool, desc->lli,
+					desc->txd.phys);
+		kfree(desc);
+	}
+
+	if (c->lli_sram) {
+		lpc313x_sram_free(c->lli_sram, NR_DESCS_PER_CHANNEL *
+				sizeof(struct lpc313x_dmac_lli));
+		c->lli_sram = NULL;
+	}
+}
+
+/* --------------------- Cyclic DMA API extensions -------------------- */
+
+/**
+ * lpc313x_dma_cyclic_start - start the cyclic DMA transfer
+ * @chan: the DMA channel to start
+ *
+ * May be called with interrupts disabled, such as from an ALSA trigger.
+ * Returns zero on success or -errno on failure.
+ */
+int lpc313x_dma_cyclic_start(struct dma_chan *chan)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	unsigned long flags;
+
+	if (!test_bit(LPC313X_DMAC_IS_CYCLIC, &c->flags)) {
+		dev_err(chan2dev(chan), "missing prep for cyclic DMA\n");
+		return -ENODEV;
+	}
+
+	spin_lock_irqsave(&c->lock, flags);
+
+	if (lpc313x_dmac_busy(c)) {
+		spin_unlock_irqrestore(&c->lock, flags);
+		return -EBUSY;
+	}
+
+	c->cyclic_last = c->cdesc->periods - 1;
+	*c->status = c->cyclic_last;
+	lpc313x_dmac_dostart(c, c->periods[0]);
+
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(lpc313x_dma_cyclic_start);
+
+/**
+ * lpc313x_dma_cyclic_stop - stop the cyclic DMA transfer
+ * @chan: the DMA channel to stop
+ *
+ * May be called with interrupts disabled, like lpc313x_dma_cyclic_start.
+ */
+void lpc313x_dma_cyclic_stop(struct dma_chan *chan)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	unsigned long flags;
+
+	spin_lock_irqsave(&c->lock, flags);
+	lpc313x_dmac_halt(c);
+	spin_unlock_irqrestore(&c->lock, flags);
+}
+EXPORT_SYMBOL(lpc313x_dma_cyclic_stop);
+
+/**
+ * lpc313x_dma_cyclic_pos - current period of a cyclic transfer
+ * @chan: the DMA channel
+ *
+ * Returns the index of the period the controller is working on.
+ */
+unsigned int lpc313x_dma_cyclic_pos(struct dma_chan *chan)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	unsigned int cur = *c->status + 1;
+
+	return cur < c->cdesc->periods ? cur : 0;
+}
+EXPORT_SYMBOL(lpc313x_dma_cyclic_pos);
+
+/**
+ * lpc313x_dma_cyclic_prep - prepare the cyclic DMA transfer
+ * @chan: the DMA channel to prepare
+ * @buf_addr: physical DMA address where the buffer starts
+ * @buf_len: total number of bytes for the entire buffer
+ * @period_len: number of bytes for each period
+ * @direction: transfer direction, to or from device
+ *
+ * Must be called before trying to start the transfer. Returns a valid
+ * struct lpc313x_dma_cyclic if successful or an ERR_PTR(-errno) if not.
+ */
+struct lpc313x_dma_cyclic *lpc313x_dma_cyclic_prep(struct dma_chan *chan,
+		dma_addr_t buf_addr, size_t buf_len, size_t period_len,
+		enum dma_data_direction direction)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	struct lpc313x_dma_slave *dws = chan->private;
+	struct lpc313x_dma_cyclic *cdesc;
+	struct lpc313x_dmac_desc *first, *prev, *last = NULL;
+	unsigned long was_cyclic;
+	unsigned int periods, shift, i;
+	u32 cfg;
+	int ret;
+
+	spin_lock_bh(&c->lock);
+	if (!list_empty(&c->queue) || !list_empty(&c->active_list)) {
+		spin_unlock_bh(&c->lock);
+		dev_dbg(chan2dev(chan),
+				"queue and/or active list are not empty\n");
+		return ERR_PTR(-EBUSY);
+	}
+
+	was_cyclic = test_and_set_bit(LPC313X_DMAC_IS_CYCLIC, &c->flags);
+	spin_unlock_bh(&c->lock);
+	if (was_cyclic) {
+		dev_dbg(chan2dev(chan),
+				"channel already prepared for cyclic DMA\n");
+		return ERR_PTR(-EBUSY);
+	}
+
+	ret = -EINVAL;
+	if (!dws || !period_len)
+		goto out_err;
+
+	shift = lpc313x_dmac_width_shift[dws->width];
+	periods = buf_len / period_len;
+	if (!periods || ((buf_addr | period_len) & ((1 << shift) - 1)))
+		goto out_err;
+
+	cfg = _SBF(10, dws->width);
+	if (direction == DMA_TO_DEVICE)
+		cfg |= DMA_CFG_WR_SLV_NR(dws->slave_nr);
+	else if (direction == DMA_FROM_DEVICE)
+		cfg |= DMA_CFG_RD_SLV_NR(dws->slave_nr);
+	else
+		goto out_err;
+
+	ret = -ENOMEM;
+	cdesc = kzalloc(sizeof(struct lpc313x_dma_cyclic), GFP_KERNEL);
+	if (!cdesc)
+		goto out_err;
+
+	c->periods = kzalloc(sizeof(struct lpc313x_dmac_desc *) * periods,
+			GFP_KERNEL);
+	if (!c->periods)
+		goto out_err_alloc;
+
+	/* One transaction per period, each ending with a marker */
+	for (i = 0; i < periods; i++) {
+		dma_addr_t mem = buf_addr + period_len * i;
+
+		first = prev = NULL;
+		if (direction == DMA_TO_DEVICE)
+			ret = lpc313x_dmac_append_block(c, &first, &prev,
+					mem, 1, dws->tx_reg, 0, period_len,
+					shift, cfg);
+		else
+			ret = lpc313x_dmac_append_block(c, &first, &prev,
+					dws->rx_reg, 0, mem, 1, period_len,
+					shift, cfg);
+		if (!ret)
+			ret = lpc313x_dmac_append_marker(c, &first, &prev);
+		if (ret) {
+			lpc313x_dmac_desc_put(c, first);
+			goto out_err_desc_get;
+		}
+
+		prev->lli->seq = i;
+		c->periods[i] = first;
+
+		if (last)
+			lpc313x_dmac_link(c, last, first->txd.phys);
+		last = prev;
+	}
+
+	/* lets make a cyclic list */
+	lpc313x_dmac_link(c, last, c->periods[0]->txd.phys);
+
+	dev_dbg(chan2dev(chan), "cyclic prepared buf 0x%08x len %zu "
+			"period %zu periods %d\n", buf_addr, buf_len,
+			period_len, periods);
+
+	cdesc->periods = periods;
+	c->cdesc = cdesc;
+
+	return cdesc;
+
+out_err_desc_get:
+	while (i--)
+		lpc313x_dmac_desc_put(c, c->periods[i]);
+	kfree(c->periods);
+	c->periods = NULL;
+out_err_alloc:
+	kfree(cdesc);
+out_err:
+	clear_bit(LPC313X_DMAC_IS_CYCLIC, &c->flags);
+	return ERR_PTR(ret);
+}
+EXPORT_SYMBOL(lpc313x_dma_cyclic_prep);
+
+/**
+ * lpc313x_dma_cyclic_free - free a prepared cyclic DMA transfer
+ * @chan: the DMA channel to free
+ */
+void lpc313x_dma_cyclic_free(struct dma_chan *chan)
+{
+	struct lpc313x_dmac_chan *c = to_lpc313x_dmac_chan(chan);
+	struct lpc313x_dma_cyclic *cdesc = c->cdesc;
+	unsigned int i;
+
+	if (!cdesc)
+		return;
+
+	spin_lock_bh(&c->lock);
+	lpc313x_dmac_halt(c);
+	spin_unlock_bh(&c->lock);
+
+	tasklet_kill(&c->tasklet);
+
+	for (i = 0; i < cdesc->periods; i++)
+		lpc313x_dmac_desc_put(c, c->periods[i]);
+
+	kfree(c->periods);
+	c->periods = NULL;
+	kfree(cdesc);
+	c->cdesc = NULL;
+
+	clear_bit(LPC313X_DMAC_IS_CYCLIC, &c->flags);
+}
+EXPORT_SYMBOL(lpc313x_dma_cyclic_free);
+
+/*----------------------------------------------------------------------*/
+
+static int __init lpc313x_dmac_probe(struct platform_device *pdev)
+{
+	struct lpc313x_dmac_platform_data *pdata = pdev->dev.platform_data;
+	struct lpc313x_dmac *dmac;
+	int err;
+	int i;
+
+	if (!pdata || !pdata->nr_channels ||
+	    pdata->nr_channels > DMA_MAX_CHANNELS / 2)
+		return -EINVAL;
+
+	dmac = kzalloc(sizeof(struct lpc313x_dmac) +
+			pdata->nr_channels * sizeof(struct lpc313x_dmac_chan),
+			GFP_KERNEL);
+	if (!dmac)
+		return -ENOMEM;
+
+	dmac->lli_pool = dma_pool_create("lpc313x_dmac_lli", &pdev->dev,
+			sizeof(struct lpc313x_dmac_lli), 4, 0);
+	if (!dmac->lli_pool) {
+		err = -ENOMEM;
+		goto err_kfree;
+	}
+
+	dmac->status = dma_alloc_coherent(&pdev->dev,
+			pdata->nr_channels * sizeof(u32), &dmac->status_phys,
+			GFP_KERNEL);
+	if (!dmac->status) {
+		err = -ENOMEM;
+		goto err_pool;
+	}
+
+	platform_set_drvdata(pdev, dmac);
+
+	INIT_LIST_HEAD(&dmac->dma.channels);
+	for (i = 0; i < pdata->nr_channels; i++, dmac->dma.chancnt++) {
+		struct lpc313x_dmac_chan *c = &dmac->chan[i];
+
+		c->chan.device = &dmac->dma;
+		c->chan.cookie = c->completed = 1;
+		c->chan.chan_id = i;
+		list_add_tail(&c->chan.device_node, &dmac->dma.channels);
+
+		spin_lock_init(&c->lock);
+		c->hw_chn = -1;
+		c->status = &dmac->status[i];
+		c->status_phys = dmac->status_phys + i * sizeof(u32);
+
+		INIT_LIST_HEAD(&c->active_list);
+		INIT_LIST_HEAD(&c->queue);
+		INIT_LIST_HEAD(&c->free_list);
+
+		tasklet_init(&c->tasklet, lpc313x_dmac_tasklet,
+				(unsigned long)c);
+	}
+
+	dma_cap_set(DMA_MEMCPY, dmac->dma.cap_mask);
+	dma_cap_set(DMA_SLAVE, dmac->dma.cap_mask);
+	dmac->dma.dev = &pdev->dev;
+	dmac->dma.device_alloc_chan_resources = lpc313x_dmac_alloc_chan_resources;
+	dmac->dma.device_free_chan_resources = lpc313x_dmac_free_chan_resources;
+
+	dmac->dma.device_prep_dma_memcpy = lpc313x_dmac_prep_dma_memcpy;
+
+	dmac->dma.device_prep_slave_sg = lpc313x_dmac_prep_slave_sg;
+	dmac->dma.device_terminate_all = lpc313x_dmac_terminate_all;
+
+	dmac->dma.device_is_tx_complete = lpc313x_dmac_is_tx_complete;
+	dmac->dma.device_issue_pending = lpc313x_dmac_issue_pending;
+
+	err = dma_async_device_register(&dmac->dma);
+	if (err)
+		goto err_status;
+
+	dev_info(&pdev->dev, "LPC313x DMA controller, %d channels\n",
+			dmac->dma.chancnt);
+
+	return 0;
+
+err_status:
+	platform_set_drvdata(pdev, NULL);
+	dma_free_coherent(&pdev->dev, pdata->nr_channels * sizeof(u32),
+			dmac->status, dmac->status_phys);
+err_pool:
+	dma_pool_destroy(dmac->lli_pool);
+err_kfree:
+	kfree(dmac);
+	return err;
+}
+
+static int __exit lpc313x_dmac_remove(struct platform_device *pdev)
+{
+	struct lpc313x_dmac *dmac = platform_get_drvdata(pdev);
+	struct lpc313x_dmac_platform_data *pdata = pdev->dev.platform_data;
+	struct lpc313x_dmac_chan *c, *_c;
+
+	dma_async_device_unregister(&dmac->dma);
+
+	list_for_each_entry_safe(c, _c, &dmac->dma.channels,
+			chan.device_node) {
+		list_del(&c->chan.device_node);
+		tasklet_kill(&c->tasklet);
+	}
+
+	platform_set_drvdata(pdev, NULL);
+	dma_free_coherent(&pdev->dev, pdata->nr_channels * sizeof(u32),
+			dmac->status, dmac->status_phys);
+	dma_pool_destroy(dmac->lli_pool);
+	kfree(dmac);
+
+	return 0;
+}
+
+static struct platform_driver lpc313x_dmac_driver = {
+	.remove		= __exit_p(lpc313x_dmac_remove),
+	.driver = {
+		.name	= "lpc313x-dmac",
+		.owner	= THIS_MODULE,
+	},
+};
+
+static int __init lpc313x_dmac_init(void)
+{
+	return platform_driver_probe(&lpc313x_dmac_driver, lpc313x_dmac_probe);
+}
+module_init(lpc313x_dmac_init);
+
+static void __exit lpc313x_dmac_exit(void)
+{
+	platform_driver_unregister(&lpc313x_dmac_driver);
+}
+module_exit(lpc313x_dmac_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("LPC313x DMA controller dmaengine driver");
+MODULE_ALIAS("platform:lpc313x-dmac");
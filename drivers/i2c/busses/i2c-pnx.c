@@ -15,7 +15,6 @@
 #include <linux/ioport.h>
 #include <linux/delay.h>
 #include <linux/i2c.h>
-#include <linux/timer.h>
 #include <linux/completion.h>
 #include <linux/platform_device.h>
 #include <linux/i2c-pnx.h>
@@ -50,81 +49,49 @@ static inline int wait_reset(long timeout, struct i2c_pnx_algo_data *data)
 	return (timeout <= 0);
 }
 
-static inline void i2c_pnx_arm_timer(struct i2c_adapter *adap)
-{
-	struct i2c_pnx_algo_data *data = adap->algo_data;
-	struct timer_list *timer = &data->mif.timer;
-	int expires = I2C_PNX_TIMEOUT / (1000 / HZ);
-
-	if (expires <= 1)
-		expires = 2;
-
-	del_timer_sync(timer);
-
-	dev_dbg(&adap->dev, "Timer armed at %lu plus %u jiffies.\n",
-		jiffies, expires);
+/* Master interrupt enables */
+#define I2C_PNX_IE_ALL	(mcntrl_tdie | mcntrl_afie | mcntrl_naie | \
+			 mcntrl_drmie | mcntrl_rffie | mcntrl_daie)
 
-	timer->expires = jiffies + expires;
-	timer->data = (unsigned long)adap;
+static void i2c_pnx_set_ie(struct i2c_pnx_algo_data *alg_data, u32 ie)
+{
+	u32 ctl = ioread32(I2C_REG_CTL(alg_data));
 
-	add_timer(timer);
+	if ((ctl & I2C_PNX_IE_ALL) != ie)
+		iowrite32((ctl & ~I2C_PNX_IE_ALL) | ie, I2C_REG_CTL(alg_data));
 }
 
-/**
- * i2c_pnx_start - start a device
- * @slave_addr:		slave address
- * @adap:		pointer to adapter structure
- *
- * Generate a START signal in the desired mode.
+/*
+ * Interrupts needed for the current state of a transfer: Tx FIFO empty
+ * while there are words left to queue, transaction done once the STOP
+ * is queued, and Rx FIFO full while bytes are still expected.
  */
-static int i2c_pnx_start(unsigned char slave_addr, struct i2c_adapter *adap)
+static u32 i2c_pnx_ie(struct i2c_pnx_mif *mif)
 {
-	struct i2c_pnx_algo_data *alg_data = adap->algo_data;
-
-	dev_dbg(&adap->dev, "%s(): addr 0x%x mode %d\n", __func__,
-		slave_addr, alg_data->mif.mode);
-
-	/* Check for 7 bit slave addresses only */
-	if (slave_addr & ~0x7f) {
-		dev_err(&adap->dev, "%s: Invalid slave address %x. "
-		       "Only 7-bit addresses are supported\n",
-		       adap->name, slave_addr);
-		return -EINVAL;
-	}
-
-	/* First, make sure bus is idle */
-	if (wait_timeout(I2C_PNX_TIMEOUT, alg_data)) {
-		/* Somebody else is monopolizing the bus */
-		dev_err(&adap->dev, "%s: Bus busy. Slave addr = %02x, "
-		       "cntrl = %x, stat = %x\n",
-		       adap->name, slave_addr,
-		       ioread32(I2C_REG_CTL(alg_data)),
-		       ioread32(I2C_REG_STS(alg_data)));
-		return -EBUSY;
-	} else if (ioread32(I2C_REG_STS(alg_data)) & mstatus_afi) {
-		/* Sorry, we lost the bus */
-		dev_err(&adap->dev, "%s: Arbitration failure. "
-		       "Slave addr = %02x\n", adap->name, slave_addr);
-		return -EIO;
-	}
+	u32 ie = mcntrl_afie | mcntrl_naie;
 
-	/*
-	 * OK, I2C is enabled and we have the bus.
-	 * Clear the current TDI and AFI status flags.
-	 */
-	iowrite32(ioread32(I2C_REG_STS(alg_data)) | mstatus_tdi | mstatus_afi,
-		  I2C_REG_STS(alg_data));
+	if (mif->tx_msg < mif->num)
+		ie |= mcntrl_drmie;
+	else
+		ie |= mcntrl_tdie;
+	if (mif->rx_left)
+		ie |= mcntrl_rffie;
 
-	dev_dbg(&adap->dev, "%s(): sending %#x\n", __func__,
-		(slave_addr << 1) | start_bit | alg_data->mif.mode);
+	return ie;
+}
 
-	/* Write the slave address, START bit and R/W bit */
-	iowrite32((slave_addr << 1) | start_bit | alg_data->mif.mode,
-		  I2C_REG_TX(alg_data));
+static void i2c_pnx_reset(struct i2c_pnx_algo_data *alg_data)
+{
+	u32 ctl;
 
-	dev_dbg(&adap->dev, "%s(): exit\n", __func__);
+	/* Reset master and disable interrupts */
+	ctl = ioread32(I2C_REG_CTL(alg_data));
+	ctl &= ~I2C_PNX_IE_ALL;
+	iowrite32(ctl, I2C_REG_CTL(alg_data));
 
-	return 0;
+	ctl |= mcntrl_reset;
+	iowrite32(ctl, I2C_REG_CTL(alg_data));
+	wait_reset(I2C_PNX_TIMEOUT, alg_data);
 }
 
 /**
@@ -158,250 +125,250 @@ static void i2c_pnx_stop(struct i2c_adapter *adap)
 }
 
 /**
- * i2c_pnx_master_xmit - transmit data to slave
- * @adap:		pointer to I2C adapter structure
+ * i2c_pnx_fill_tx - queue words of a transfer
+ * @alg_data:		pointer to algorithm data
  *
- * Sends one byte of data to the slave
+ * Fills the Tx FIFO with the slave addresses (with START), data bytes
+ * of write messages and the dummy bytes that clock in read messages,
+ * for all messages of the transfer in turn. The last word carries the
+ * STOP bit.
  */
-static int i2c_pnx_master_xmit(struct i2c_adapter *adap)
+static void i2c_pnx_fill_tx(struct i2c_pnx_algo_data *alg_data)
 {
-	struct i2c_pnx_algo_data *alg_data = adap->algo_data;
-	u32 val;
+	struct i2c_pnx_mif *mif = &alg_data->mif;
+
+	while (mif->tx_msg < mif->num &&
+	       !(ioread32(I2C_REG_STS(alg_data)) & mstatus_tff)) {
+		struct i2c_msg *msg = &mif->msgs[mif->tx_msg];
+		int last = (mif->tx_msg == mif->num - 1);
+		int words;
+		u32 val;
+
+		if (mif->tx_pos < 0)
+			val = start_bit | (msg->addr << 1) |
+				((msg->flags & I2C_M_RD) ? rw_bit : 0);
+		else if (!msg->len)
+			/* STOP after a zero-sized transfer */
+			val = 0xff;
+		else if (msg->flags & I2C_M_RD)
+			val = 0;
+		else
+			val = msg->buf[mif->tx_pos];
+		mif->tx_pos++;
+
+		words = msg->len ? msg->len : last;
+		if (mif->tx_pos == words) {
+			if (last)
+				val |= stop_bit;
+			mif->tx_msg++;
+			mif->tx_pos = -1;
+		}
 
-	dev_dbg(&adap->dev, "%s(): entering: stat = %04x.\n",
-		__func__, ioread32(I2C_REG_STS(alg_data)));
+		iowrite32(val, I2C_REG_TX(alg_data));
+	}
+}
 
-	if (alg_data->mif.len > 0) {
-		/* We still have something to talk about... */
-		val = *alg_data->mif.buf++;
+/**
+ * i2c_pnx_drain_rx - read received bytes
+ * @alg_data:		pointer to algorithm data
+ *
+ * Empties the Rx FIFO into the buffers of the read messages, in order.
+ */
+static void i2c_pnx_drain_rx(struct i2c_pnx_algo_data *alg_data)
+{
+	struct i2c_pnx_mif *mif = &alg_data->mif;
 
-		/* last byte of a message */
-		if ((alg_data->mif.len == 1) && alg_data->last)
-			val |= stop_bit;
+	while (!(ioread32(I2C_REG_STS(alg_data)) & mstatus_rfe)) {
+		u8 val = ioread32(I2C_REG_RX(alg_data)) & 0xff;
+		struct i2c_msg *msg;
 
-		alg_data->mif.len--;
-		iowrite32(val, I2C_REG_TX(alg_data));
+		if (!mif->rx_left)
+			continue;
 
-		dev_dbg(&adap->dev, "%s(): xmit %#x [%d]\n", __func__,
-			val, alg_data->mif.len + 1);
+		msg = &mif->msgs[mif->rx_msg];
+		while (!(msg->flags & I2C_M_RD) || mif->rx_pos == msg->len) {
+			msg = &mif->msgs[++mif->rx_msg];
+			mif->rx_pos = 0;
+		}
+		msg->buf[mif->rx_pos++] = val;
+		mif->rx_left--;
+	}
+}
 
-		if (alg_data->mif.len == 0) {
-			if (alg_data->last) {
-				/* Wait until the STOP is seen. */
-				if (wait_timeout(I2C_PNX_TIMEOUT, alg_data))
-					dev_err(&adap->dev, "The bus is still "
-						"active after timeout\n");
-			}
-			/* Disable master interrupts */
-			iowrite32(ioread32(I2C_REG_CTL(alg_data)) &
-				~(mcntrl_afie | mcntrl_naie | mcntrl_drmie),
-				  I2C_REG_CTL(alg_data));
+/**
+ * i2c_pnx_process - advance a transfer
+ * @adap:		pointer to I2C adapter structure
+ *
+ * Handles the current controller status, from the interrupt handler or
+ * from the polling loop. Returns non-zero once the transfer is over,
+ * with the result in mif.ret.
+ */
+static int i2c_pnx_process(struct i2c_adapter *adap)
+{
+	struct i2c_pnx_algo_data *alg_data = adap->algo_data;
+	struct i2c_pnx_mif *mif = &alg_data->mif;
+	u32 stat;
 
-			del_timer_sync(&alg_data->mif.timer);
+	stat = ioread32(I2C_REG_STS(alg_data));
+	if (stat & (mstatus_tdi | mstatus_afi))
+		iowrite32(stat & (mstatus_tdi | mstatus_afi),
+			  I2C_REG_STS(alg_data));
 
-			dev_dbg(&adap->dev, "%s(): Waking up xfer routine.\n",
-				__func__);
+	dev_dbg(&adap->dev, "%s(): stat = %04x, tx %d/%d, rx left %d\n",
+		__func__, stat, mif->tx_msg, mif->num, mif->rx_left);
 
-			complete(&alg_data->mif.complete);
-		}
-	} else if (alg_data->mif.len == 0) {
-		/* zero-sized transfer */
-		i2c_pnx_stop(adap);
+	/* let's see what kind of event this is */
+	if (stat & mstatus_afi) {
+		/* We lost arbitration in the midst of a transfer */
+		mif->ret = -EIO;
+		return 1;
+	}
 
-		/* Disable master interrupts. */
-		iowrite32(ioread32(I2C_REG_CTL(alg_data)) &
-			~(mcntrl_afie | mcntrl_naie | mcntrl_drmie),
-			  I2C_REG_CTL(alg_data));
+	if (stat & mstatus_nai) {
+		/* Slave did not acknowledge, generate a STOP */
+		dev_dbg(&adap->dev, "%s(): "
+			"Slave did not acknowledge, generating a STOP.\n",
+			__func__);
+		i2c_pnx_stop(adap);
+		mif->ret = -EIO;
+		return 1;
+	}
 
-		/* Stop timer. */
-		del_timer_sync(&alg_data->mif.timer);
-		dev_dbg(&adap->dev, "%s(): Waking up xfer routine after "
-			"zero-xfer.\n", __func__);
+	/* A full Rx FIFO holds off the bus, so empty it first */
+	if (!(stat & mstatus_rfe))
+		i2c_pnx_drain_rx(alg_data);
 
-		complete(&alg_data->mif.complete);
+	if (mif->tx_msg < mif->num) {
+		i2c_pnx_fill_tx(alg_data);
+		return 0;
 	}
 
-	dev_dbg(&adap->dev, "%s(): exiting: stat = %04x.\n",
-		__func__, ioread32(I2C_REG_STS(alg_data)));
+	if (!(stat & mstatus_tdi))
+		return 0;
 
-	return 0;
+	/* The STOP went out, collect the last bytes */
+	i2c_pnx_drain_rx(alg_data);
+	if (mif->rx_left) {
+		dev_err(&adap->dev, "%s: %d bytes missing from read\n",
+			adap->name, mif->rx_left);
+		mif->ret = -EIO;
+	}
+
+	return 1;
 }
 
 /**
- * i2c_pnx_master_rcv - receive data from slave
- * @adap:		pointer to I2C adapter structure
+ * i2c_pnx_start - start a transfer
+ * @adap:		pointer to adapter structure
  *
- * Reads one byte data from the slave
+ * Wait for the bus to be idle and queue the first words of the transfer,
+ * starting with the START and the first slave address.
  */
-static int i2c_pnx_master_rcv(struct i2c_adapter *adap)
+static int i2c_pnx_start(struct i2c_adapter *adap)
 {
 	struct i2c_pnx_algo_data *alg_data = adap->algo_data;
-	unsigned int val = 0;
-	u32 ctl = 0;
+	u16 slave_addr = alg_data->mif.msgs[0].addr;
 
-	dev_dbg(&adap->dev, "%s(): entering: stat = %04x.\n",
-		__func__, ioread32(I2C_REG_STS(alg_data)));
-
-	/* Check, whether there is already data,
-	 * or we didn't 'ask' for it yet.
-	 */
-	if (ioread32(I2C_REG_STS(alg_data)) & mstatus_rfe) {
-		dev_dbg(&adap->dev, "%s(): Write dummy data to fill "
-			"Rx-fifo...\n", __func__);
-
-		if (alg_data->mif.len == 1) {
-			/* Last byte, do not acknowledge next rcv. */
-			val |= stop_bit;
-			/*
-			 * Enable interrupt RFDAIE (data in Rx fifo),
-			 * and disable DRMIE (need data for Tx)
-			 */
-			ctl = ioread32(I2C_REG_CTL(alg_data));
-			ctl |= mcntrl_rffie | mcntrl_daie;
-			ctl &= ~mcntrl_drmie;
-			iowrite32(ctl, I2C_REG_CTL(alg_data));
-		}
-
-		/*
-		 * Now we'll 'ask' for data:
-		 * For each byte we want to receive, we must
-		 * write a (dummy) byte to the Tx-FIFO.
-		 */
-		iowrite32(val, I2C_REG_TX(alg_data));
+	dev_dbg(&adap->dev, "%s(): addr 0x%x, %d messages\n", __func__,
+		slave_addr, alg_data->mif.num);
 
-		return 0;
+	/* First, make sure bus is idle */
+	if (wait_timeout(I2C_PNX_TIMEOUT, alg_data)) {
+		/* Somebody else is monopolizing the bus */
+		dev_err(&adap->dev, "%s: Bus busy. Slave addr = %02x, "
+		       "cntrl = %x, stat = %x\n",
+		       adap->name, slave_addr,
+		       ioread32(I2C_REG_CTL(alg_data)),
+		       ioread32(I2C_REG_STS(alg_data)));
+		return -EBUSY;
+	} else if (ioread32(I2C_REG_STS(alg_data)) & mstatus_afi) {
+		/* Sorry, we lost the bus */
+		dev_err(&adap->dev, "%s: Arbitration failure. "
+		       "Slave addr = %02x\n", adap->name, slave_addr);
+		return -EIO;
 	}
 
-	/* Handle data. */
-	if (alg_data->mif.len > 0) {
-		val = ioread32(I2C_REG_RX(alg_data));
-		*alg_data->mif.buf++ = (u8) (val & 0xff);
-		dev_dbg(&adap->dev, "%s(): rcv 0x%x [%d]\n", __func__, val,
-			alg_data->mif.len);
-
-		alg_data->mif.len--;
-		if (alg_data->mif.len == 0) {
-			if (alg_data->last)
-				/* Wait until the STOP is seen. */
-				if (wait_timeout(I2C_PNX_TIMEOUT, alg_data))
-					dev_err(&adap->dev, "The bus is still "
-						"active after timeout\n");
-
-			/* Disable master interrupts */
-			ctl = ioread32(I2C_REG_CTL(alg_data));
-			ctl &= ~(mcntrl_afie | mcntrl_naie | mcntrl_rffie |
-				 mcntrl_drmie | mcntrl_daie);
-			iowrite32(ctl, I2C_REG_CTL(alg_data));
-
-			/* Kill timer. */
-			del_timer_sync(&alg_data->mif.timer);
-			complete(&alg_data->mif.complete);
-		}
-	}
+	/*
+	 * OK, I2C is enabled and we have the bus.
+	 * Clear the current TDI and AFI status flags.
+	 */
+	iowrite32(ioread32(I2C_REG_STS(alg_data)) | mstatus_tdi | mstatus_afi,
+		  I2C_REG_STS(alg_data));
 
-	dev_dbg(&adap->dev, "%s(): exiting: stat = %04x.\n",
-		__func__, ioread32(I2C_REG_STS(alg_data)));
+	i2c_pnx_fill_tx(alg_data);
+
+	dev_dbg(&adap->dev, "%s(): exit\n", __func__);
 
 	return 0;
 }
 
 static irqreturn_t i2c_pnx_interrupt(int irq, void *dev_id)
 {
-	u32 stat, ctl;
 	struct i2c_adapter *adap = dev_id;
 	struct i2c_pnx_algo_data *alg_data = adap->algo_data;
 
-	dev_dbg(&adap->dev, "%s(): mstat = %x mctrl = %x, mode = %d\n",
-		__func__,
-		ioread32(I2C_REG_STS(alg_data)),
-		ioread32(I2C_REG_CTL(alg_data)),
-		alg_data->mif.mode);
-	stat = ioread32(I2C_REG_STS(alg_data));
-
-	/* let's see what kind of event this is */
-	if (stat & mstatus_afi) {
-		/* We lost arbitration in the midst of a transfer */
-		alg_data->mif.ret = -EIO;
-
-		/* Disable master interrupts. */
-		ctl = ioread32(I2C_REG_CTL(alg_data));
-		ctl &= ~(mcntrl_afie | mcntrl_naie | mcntrl_rffie |
-			 mcntrl_drmie);
-		iowrite32(ctl, I2C_REG_CTL(alg_data));
+	if (!alg_data->mif.msgs)
+		return IRQ_NONE;
 
-		/* Stop timer, to prevent timeout. */
-		del_timer_sync(&alg_data->mif.timer);
+	if (i2c_pnx_process(adap)) {
+		/* Disable master interrupts, wake up the xfer routine */
+		i2c_pnx_set_ie(alg_data, 0);
 		complete(&alg_data->mif.complete);
-	} else if (stat & mstatus_nai) {
-		/* Slave did not acknowledge, generate a STOP */
-		dev_dbg(&adap->dev, "%s(): "
-			"Slave did not acknowledge, generating a STOP.\n",
-			__func__);
-		i2c_pnx_stop(adap);
-
-		/* Disable master interrupts. */
-		ctl = ioread32(I2C_REG_CTL(alg_data));
-		ctl &= ~(mcntrl_afie | mcntrl_naie | mcntrl_rffie |
-			 mcntrl_drmie);
-		iowrite32(ctl, I2C_REG_CTL(alg_data));
+	} else
+		i2c_pnx_set_ie(alg_data, i2c_pnx_ie(&alg_data->mif));
 
-		/* Our return value. */
-		alg_data->mif.ret = -EIO;
+	return IRQ_HANDLED;
+}
 
-		/* Stop timer, to prevent timeout. */
-		del_timer_sync(&alg_data->mif.timer);
-		complete(&alg_data->mif.complete);
-	} else {
-		/*
-		 * Two options:
-		 * - Master Tx needs data.
-		 * - There is data in the Rx-fifo
-		 * The latter is only the case if we have requested for data,
-		 * via a dummy write. (See 'i2c_pnx_master_rcv'.)
-		 * We therefore check, as a sanity check, whether that interrupt
-		 * has been enabled.
-		 */
-		if ((stat & mstatus_drmi) || !(stat & mstatus_rfe)) {
-			if (alg_data->mif.mode == I2C_SMBUS_WRITE) {
-				i2c_pnx_master_xmit(adap);
-			} else if (alg_data->mif.mode == I2C_SMBUS_READ) {
-				i2c_pnx_master_rcv(adap);
-			}
+/**
+ * i2c_pnx_poll - run a transfer without interrupts
+ * @adap:		pointer to I2C adapter structure
+ *
+ * Used by i2c_pnx_xfer_atomic() for callers that can't sleep. The
+ * controller interrupts stay masked, the state machine is run from here.
+ */
+static int i2c_pnx_poll(struct i2c_adapter *adap)
+{
+	struct i2c_pnx_algo_data *alg_data = adap->algo_data;
+	unsigned long timeout = jiffies_to_usecs(adap->timeout);
+
+	while (!i2c_pnx_process(adap)) {
+		if (!timeout--) {
+			dev_err(&adap->dev, "Master timed out. stat = %04x, "
+				"cntrl = %04x. Resetting master...\n",
+				ioread32(I2C_REG_STS(alg_data)),
+				ioread32(I2C_REG_CTL(alg_data)));
+			i2c_pnx_reset(alg_data);
+			return -ETIMEDOUT;
 		}
+		udelay(1);
 	}
 
-	/* Clear TDI and AFI bits */
-	stat = ioread32(I2C_REG_STS(alg_data));
-	iowrite32(stat | mstatus_tdi | mstatus_afi, I2C_REG_STS(alg_data));
-
-	dev_dbg(&adap->dev, "%s(): exiting, stat = %x ctrl = %x.\n",
-		 __func__, ioread32(I2C_REG_STS(alg_data)),
-		 ioread32(I2C_REG_CTL(alg_data)));
-
-	return IRQ_HANDLED;
+	return alg_data->mif.ret;
 }
 
-static void i2c_pnx_timeout(unsigned long data)
+static int i2c_pnx_wait(struct i2c_adapter *adap)
 {
-	struct i2c_adapter *adap = (struct i2c_adapter *)data;
 	struct i2c_pnx_algo_data *alg_data = adap->algo_data;
-	u32 ctl;
-
-	dev_err(&adap->dev, "Master timed out. stat = %04x, cntrl = %04x. "
-	       "Resetting master...\n",
-	       ioread32(I2C_REG_STS(alg_data)),
-	       ioread32(I2C_REG_CTL(alg_data)));
 
-	/* Reset master and disable interrupts */
-	ctl = ioread32(I2C_REG_CTL(alg_data));
-	ctl &= ~(mcntrl_afie | mcntrl_naie | mcntrl_rffie | mcntrl_drmie);
-	iowrite32(ctl, I2C_REG_CTL(alg_data));
+	i2c_pnx_set_ie(alg_data, i2c_pnx_ie(&alg_data->mif));
+
+	if (!wait_for_completion_timeout(&alg_data->mif.complete,
+					 adap->timeout)) {
+		/* Make sure the handler is not running behind our back */
+		disable_irq(alg_data->irq);
+		if (!completion_done(&alg_data->mif.complete)) {
+			dev_err(&adap->dev, "Master timed out. stat = %04x, "
+				"cntrl = %04x. Resetting master...\n",
+				ioread32(I2C_REG_STS(alg_data)),
+				ioread32(I2C_REG_CTL(alg_data)));
+			i2c_pnx_reset(alg_data);
+			alg_data->mif.ret = -ETIMEDOUT;
+		}
+		enable_irq(alg_data->irq);
+	}
 
-	ctl |= mcntrl_reset;
-	iowrite32(ctl, I2C_REG_CTL(alg_data));
-	wait_reset(I2C_PNX_TIMEOUT, alg_data);
-	alg_data->mif.ret = -EIO;
-	complete(&alg_data->mif.complete);
+	return alg_data->mif.ret;
 }
 
 static inline void bus_reset_if_active(struct i2c_adapter *adap)
@@ -430,104 +397,91 @@ static inline void bus_reset_if_active(struct i2c_adapter *adap)
 	}
 }
 
-/**
- * i2c_pnx_xfer - generic transfer entry point
- * @adap:		pointer to I2C adapter structure
- * @msgs:		array of messages
- * @num:		number of messages
- *
- * Initiates the transfer
+/*
+ * Runs all messages as one transaction, with repeated STARTs between
+ * them and a single STOP at the end. The Tx FIFO is kept filled from the
+ * interrupt handler, or by polling for an atomic transfer.
  */
 static int
-i2c_pnx_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+__i2c_pnx_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num,
+	       int atomic)
 {
-	struct i2c_msg *pmsg;
-	int rc = 0, completed = 0, i;
 	struct i2c_pnx_algo_data *alg_data = adap->algo_data;
-	u32 stat = ioread32(I2C_REG_STS(alg_data));
+	struct i2c_pnx_mif *mif = &alg_data->mif;
+	int rc, i;
 
 	dev_dbg(&adap->dev, "%s(): entering: %d messages, stat = %04x.\n",
 		__func__, num, ioread32(I2C_REG_STS(alg_data)));
 
-	bus_reset_if_active(adap);
-
-	/* Process transactions in a loop. */
-	for (i = 0; rc >= 0 && i < num; i++) {
-		u8 addr;
-
-		pmsg = &msgs[i];
-		addr = pmsg->addr;
-
-		if (pmsg->flags & I2C_M_TEN) {
+	mif->rx_left = 0;
+	for (i = 0; i < num; i++) {
+		if (msgs[i].flags & I2C_M_TEN) {
 			dev_err(&adap->dev,
 				"%s: 10 bits addr not supported!\n",
 				adap->name);
-			rc = -EINVAL;
-			break;
+			return -EINVAL;
 		}
 
-		alg_data->mif.buf = pmsg->buf;
-		alg_data->mif.len = pmsg->len;
-		alg_data->mif.mode = (pmsg->flags & I2C_M_RD) ?
-			I2C_SMBUS_READ : I2C_SMBUS_WRITE;
-		alg_data->mif.ret = 0;
-		alg_data->last = (i == num - 1);
-
-		dev_dbg(&adap->dev, "%s(): mode %d, %d bytes\n", __func__,
-			alg_data->mif.mode,
-			alg_data->mif.len);
-
-		i2c_pnx_arm_timer(adap);
+		/* Check for 7 bit slave addresses only */
+		if (msgs[i].addr & ~0x7f) {
+			dev_err(&adap->dev, "%s: Invalid slave address %x. "
+			       "Only 7-bit addresses are supported\n",
+			       adap->name, msgs[i].addr);
+			return -EINVAL;
+		}
 
-		/* initialize the completion var */
-		init_completion(&alg_data->mif.complete);
+		if (msgs[i].flags & I2C_M_RD)
+			mif->rx_left += msgs[i].len;
+	}
 
-		/* Enable master interrupt */
-		iowrite32(ioread32(I2C_REG_CTL(alg_data)) | mcntrl_afie |
-				mcntrl_naie | mcntrl_drmie,
-			  I2C_REG_CTL(alg_data));
+	bus_reset_if_active(adap);
 
-		/* Put start-code and slave-address on the bus. */
-		rc = i2c_pnx_start(addr, adap);
-		if (rc < 0)
-			break;
-
-		/* Wait for completion */
-		wait_for_completion(&alg_data->mif.complete);
-
-		if (!(rc = alg_data->mif.ret))
-			completed++;
-		dev_dbg(&adap->dev, "%s(): Complete, return code = %d.\n",
-			__func__, rc);
-
-		/* Clear TDI and AFI bits in case they are set. */
-		if ((stat = ioread32(I2C_REG_STS(alg_data))) & mstatus_tdi) {
-			dev_dbg(&adap->dev,
-				"%s: TDI still set... clearing now.\n",
-			       adap->name);
-			iowrite32(stat, I2C_REG_STS(alg_data));
-		}
-		if ((stat = ioread32(I2C_REG_STS(alg_data))) & mstatus_afi) {
-			dev_dbg(&adap->dev,
-				"%s: AFI still set... clearing now.\n",
-			       adap->name);
-			iowrite32(stat, I2C_REG_STS(alg_data));
-		}
+	mif->msgs = msgs;
+	mif->num = num;
+	mif->tx_msg = 0;
+	mif->tx_pos = -1;
+	mif->rx_msg = 0;
+	mif->rx_pos = 0;
+	mif->ret = 0;
+	init_completion(&mif->complete);
+
+	rc = i2c_pnx_start(adap);
+	if (!rc) {
+		if (atomic)
+			rc = i2c_pnx_poll(adap);
+		else
+			rc = i2c_pnx_wait(adap);
 	}
 
 	bus_reset_if_active(adap);
 
 	/* Cleanup to be sure... */
-	alg_data->mif.buf = NULL;
-	alg_data->mif.len = 0;
+	mif->msgs = NULL;
+	mif->num = 0;
 
-	dev_dbg(&adap->dev, "%s(): exiting, stat = %x\n",
-		__func__, ioread32(I2C_REG_STS(alg_data)));
+	dev_dbg(&adap->dev, "%s(): exiting, rc = %d, stat = %x\n",
+		__func__, rc, ioread32(I2C_REG_STS(alg_data)));
 
-	if (completed != num)
-		return ((rc < 0) ? rc : -EREMOTEIO);
+	return rc < 0 ? rc : num;
+}
 
-	return num;
+/**
+ * i2c_pnx_xfer - generic transfer entry point
+ * @adap:		pointer to I2C adapter structure
+ * @msgs:		array of messages
+ * @num:		number of messages
+ *
+ * Sleeps until the transfer is done. Callers that can't sleep must use
+ * i2c_pnx_xfer_atomic() instead.
+ */
+static int
+i2c_pnx_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	/* Don't hang in wait_for_completion(), but do tell the caller */
+	if (WARN_ON_ONCE(irqs_disabled()))
+		return __i2c_pnx_xfer(adap, msgs, num, 1);
+
+	return __i2c_pnx_xfer(adap, msgs, num, 0);
 }
 
 static u32 i2c_pnx_func(struct i2c_adapter *adapter)
@@ -540,6 +494,36 @@ static struct i2c_algorithm pnx_algorithm = {
 	.functionality = i2c_pnx_func,
 };
 
+/**
+ * i2c_pnx_xfer_atomic - transfer without sleeping
+ * @adap:		pointer to I2C adapter structure
+ * @msgs:		array of messages
+ * @num:		number of messages
+ *
+ * For callers that run with interrupts or preemption disabled, like a
+ * PMIC driver switching the power off at shutdown. The controller is
+ * polled instead of waiting for its interrupt. Returns the number of
+ * messages transferred, -EAGAIN if the adapter is in use, or another
+ * negative errno.
+ */
+int i2c_pnx_xfer_atomic(struct i2c_adapter *adap, struct i2c_msg *msgs,
+			int num)
+{
+	int ret;
+
+	if (adap->algo != &pnx_algorithm)
+		return -EINVAL;
+
+	if (!rt_mutex_trylock(&adap->bus_lock))
+		return -EAGAIN;
+
+	ret = __i2c_pnx_xfer(adap, msgs, num, 1);
+	rt_mutex_unlock(&adap->bus_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(i2c_pnx_xfer_atomic);
+
 static int i2c_pnx_controller_suspend(struct platform_device *pdev,
 				      pm_message_t state)
 {
@@ -581,9 +565,6 @@ static int __devinit i2c_pnx_probe(struct platform_device *pdev)
 	i2c_pnx->adapter->algo = &pnx_algorithm;
 
 	alg_data = i2c_pnx->adapter->algo_data;
-	init_timer(&alg_data->mif.timer);
-	alg_data->mif.timer.function = i2c_pnx_timeout;
-	alg_data->mif.timer.data = (unsigned long)i2c_pnx->adapter;
 
 	/* Register I/O resource */
 	if (!request_mem_region(alg_data->base, I2C_PNX_REGION_SIZE,
@@ -36,6 +36,7 @@
 #include <linux/stat.h>
 #include <linux/delay.h>
 #include <linux/irq.h>
+#include <linux/cpufreq.h>
 
 #include "lpc313x_mmc.h"
 #include <mach/irqs.h>
@@ -54,6 +55,22 @@
 #define LPC313x_MCI_RECV_STATUS		2
 #define LPC313x_MCI_DMA_THRESHOLD	16
 
+/* Bytes moved per DMA transfer unit, segments must be a multiple of it */
+#ifdef BURST_DMA
+#define LPC313x_MCI_DMA_UNIT		16
+#else
+#define LPC313x_MCI_DMA_UNIT		4
+#endif
+/* Largest segment covered by a single SG descriptor */
+#define LPC313x_MCI_DMA_SEG_MAX		((DMA_MAX_TRANSFERS + 1) * LPC313x_MCI_DMA_UNIT)
+/* SG descriptors in a (one page) table, the last one raises the IRQ */
+#define LPC313x_MCI_DMA_DESC_MAX	(PAGE_SIZE / sizeof(dma_sg_ll_t))
+/* Descriptor tables: the running transfer and the one prepared next */
+#define LPC313x_MCI_DMA_TABLES		2
+/* Request limits, one descriptor per segment always fits the table */
+#define LPC313x_MCI_MAX_SEGS		128
+#define LPC313x_MCI_MAX_REQ_SIZE	(512 * 1024)
+
 enum {
 	EVENT_CMD_COMPLETE = 0,
 	EVENT_XFER_COMPLETE,
@@ -90,6 +107,8 @@ struct lpc313x_mci {
 	int			dma_chn;
 	dma_addr_t		sg_dma;
 	dma_sg_ll_t		*sg_cpu;
+	unsigned long		sg_busy;	/* descriptor tables in use */
+	int			cur_table;	/* table of the running transfer */
 #endif
 	u32			cmd_status;
 	u32			data_status;
@@ -103,6 +122,9 @@ struct lpc313x_mci {
 
 	u32			bus_hz;
 	u32			current_speed;
+#ifdef CONFIG_CPU_FREQ
+	struct notifier_block	freq_transition;
+#endif
 	struct platform_device	*pdev;
 	struct lpc313x_mci_board *pdata;
 	struct lpc313x_mci_slot	*slot[MAX_MCI_SLOTS];
@@ -355,14 +377,26 @@ static void send_stop_cmd(struct lpc313x_mci *host, struct mmc_data *data)
 
 #ifdef USE_DMA
 
+static void lpc313x_mci_dma_unmap(struct lpc313x_mci *host, struct mmc_data *data)
+{
+	dma_unmap_sg(&host->pdev->dev, data->sg, data->sg_len,
+	     ((data->flags & MMC_DATA_WRITE)
+	      ? DMA_TO_DEVICE : DMA_FROM_DEVICE));
+}
+
 static void lpc313x_mci_dma_cleanup(struct lpc313x_mci *host)
 {
 	struct mmc_data			*data = host->data;
 
-	if (data)
-		dma_unmap_sg(&host->pdev->dev, data->sg, data->sg_len,
-		     ((data->flags & MMC_DATA_WRITE)
-		      ? DMA_TO_DEVICE : DMA_FROM_DEVICE));
+	if (host->cur_table < 0)
+		return;
+
+	/* Data prepared by pre_req is released by post_req */
+	if (data && !data->host_cookie) {
+		lpc313x_mci_dma_unmap(host, data);
+		clear_bit(host->cur_table, &host->sg_busy);
+	}
+	host->cur_table = -1;
 }
 
 static void lpc313x_mci_stop_dma(struct lpc313x_mci *host)
@@ -398,11 +432,20 @@ static void lpc313x_mci_dma_complete(int chn, dma_irq_type_t type, void *arg)
 	spin_unlock(&host->lock);
 }
 
-static int lpc313x_mci_submit_data_dma(struct lpc313x_mci *host, struct mmc_data *data)
+/*
+ * Map the data and build its SG descriptor chain in a free table. This
+ * does not touch the controller, so it can run while another transfer
+ * is in progress. Returns the table index, or a negative error when the
+ * transfer has to be done by PIO.
+ */
+static int lpc313x_mci_dma_prep(struct lpc313x_mci *host, struct mmc_data *data)
 {
 	struct scatterlist		*sg;
 	unsigned int			i, direction, sg_len;
-	unsigned int			j, trans_len;
+	unsigned int			j, trans_len, nr_desc;
+	dma_sg_ll_t			*sg_cpu;
+	dma_addr_t			sg_dma;
+	int				table;
 
 	/* If we don't have a channel, we can't do DMA */
 	if (host->dma_chn < 0)
@@ -418,11 +461,22 @@ static int lpc313x_mci_submit_data_dma(struct lpc313x_mci *host, struct mmc_data
 	if (data->blksz & 3)
 		return -EINVAL;
 
+	/* Burst transfers move 16 bytes at a time, a shorter tail
+	   would silently be dropped */
 	for_each_sg(data->sg, sg, data->sg_len, i) {
-		if (sg->offset & 3 || sg->length & 3)
+		if (sg->offset & 3 || sg->length & (LPC313x_MCI_DMA_UNIT - 1))
 			return -EINVAL;
 	}
 
+	for (table = 0; table < LPC313x_MCI_DMA_TABLES; table++)
+		if (!test_and_set_bit(table, &host->sg_busy))
+			break;
+	if (table == LPC313x_MCI_DMA_TABLES)
+		return -EBUSY;
+
+	sg_cpu = host->sg_cpu + table * LPC313x_MCI_DMA_DESC_MAX;
+	sg_dma = host->sg_dma + table * PAGE_SIZE;
+
 	if (data->flags & MMC_DATA_READ)
 		direction = DMA_FROM_DEVICE;
 	else
@@ -431,8 +485,19 @@ static int lpc313x_mci_submit_data_dma(struct lpc313x_mci *host, struct mmc_data
 	sg_len = dma_map_sg(&host->pdev->dev, data->sg, data->sg_len,
 				   direction);
 
+	/* The whole request must fit the descriptor table */
+	nr_desc = 0;
+	for_each_sg(data->sg, sg, sg_len, i)
+		nr_desc += DIV_ROUND_UP(sg_dma_len(sg), LPC313x_MCI_DMA_SEG_MAX);
+	if (nr_desc >= LPC313x_MCI_DMA_DESC_MAX) {
+		dma_unmap_sg(&host->pdev->dev, data->sg, data->sg_len,
+			direction);
+		clear_bit(table, &host->sg_busy);
+		return -EINVAL;
+	}
+
 	dev_vdbg(&host->pdev->dev, "sd sg_cpu: 0x%08x sg_dma:0x%08x sg_len:%d \n",
-		(u32)host->sg_cpu, (u32)host->sg_dma, sg_len);
+		(u32)sg_cpu, (u32)sg_dma, sg_len);
 
 	for (i = 0, j = 0; i < sg_len; i++) {
 		unsigned int length = sg_dma_len(&data->sg[i]);
@@ -440,22 +505,22 @@ static int lpc313x_mci_submit_data_dma(struct lpc313x_mci *host, struct mmc_data
 
 		while (length) {
 
-			host->sg_cpu[j].setup.cfg = DMA_CFG_CMP_CH_EN | DMA_CFG_CMP_CH_NR(host->dma_chn);
+			sg_cpu[j].setup.cfg = DMA_CFG_CMP_CH_EN | DMA_CFG_CMP_CH_NR(host->dma_chn);
 
 			if (data->flags & MMC_DATA_READ) {
-				host->sg_cpu[j].setup.src_address = SDMMC_DATA_ADR;
-				host->sg_cpu[j].setup.dest_address = mem_addr;
-				host->sg_cpu[j].setup.cfg |= DMA_CFG_RD_SLV_NR(DMA_SLV_SDMMC);
+				sg_cpu[j].setup.src_address = SDMMC_DATA_ADR;
+				sg_cpu[j].setup.dest_address = mem_addr;
+				sg_cpu[j].setup.cfg |= DMA_CFG_RD_SLV_NR(DMA_SLV_SDMMC);
 			} else {
-				host->sg_cpu[j].setup.src_address = mem_addr;
-				host->sg_cpu[j].setup.dest_address = SDMMC_DATA_ADR;
-				host->sg_cpu[j].setup.cfg |= DMA_CFG_WR_SLV_NR(DMA_SLV_SDMMC);
+				sg_cpu[j].setup.src_address = mem_addr;
+				sg_cpu[j].setup.dest_address = SDMMC_DATA_ADR;
+				sg_cpu[j].setup.cfg |= DMA_CFG_WR_SLV_NR(DMA_SLV_SDMMC);
 			}
-			host->sg_cpu[j].next_entry = host->sg_dma + (j + 1) *
+			sg_cpu[j].next_entry = sg_dma + (j + 1) *
 						sizeof(dma_sg_ll_t);
 
 #ifdef BURST_DMA
-			host->sg_cpu[j].setup.cfg |= DMA_CFG_TX_BURST;
+			sg_cpu[j].setup.cfg |= DMA_CFG_TX_BURST;
       /* 16 bytes per transfer */
 			trans_len = (length >> 4) - 1;
 #else
@@ -478,25 +543,43 @@ static int lpc313x_mci_submit_data_dma(struct lpc313x_mci *host, struct mmc_data
 				length = 0;
 			}
 
-			host->sg_cpu[j].setup.trans_length = trans_len;
+			sg_cpu[j].setup.trans_length = trans_len;
 
 			dev_vdbg(&host->pdev->dev, "sd src: 0x%08x dest:0x%08x cfg:0x%08x nxt:0x%08x len:%d \n",
-				host->sg_cpu[j].setup.src_address, host->sg_cpu[j].setup.dest_address,
-				host->sg_cpu[j].setup.cfg, host->sg_cpu[j].next_entry,
-				host->sg_cpu[j].setup.trans_length);
+				sg_cpu[j].setup.src_address, sg_cpu[j].setup.dest_address,
+				sg_cpu[j].setup.cfg, sg_cpu[j].next_entry,
+				sg_cpu[j].setup.trans_length);
 
 			/* move to next transfer descriptor */
 			j++;
 		}
 	}
-	host->sg_cpu[j].setup.src_address = host->sg_dma;
-	host->sg_cpu[j].setup.dest_address = DMACH_SOFT_INT_PHYS;
-	host->sg_cpu[j].setup.trans_length = 1;
-	host->sg_cpu[j].setup.cfg = 0;
+	sg_cpu[j].setup.src_address = sg_dma;
+	sg_cpu[j].setup.dest_address = DMACH_SOFT_INT_PHYS;
+	sg_cpu[j].setup.trans_length = 1;
+	sg_cpu[j].setup.cfg = 0;
+
+	return table;
+}
+
+static int lpc313x_mci_submit_data_dma(struct lpc313x_mci *host, struct mmc_data *data)
+{
+	int table;
+
+	/* Use the chain built by pre_req if there is one */
+	if (data->host_cookie) {
+		table = data->host_cookie - 1;
+	} else {
+		table = lpc313x_mci_dma_prep(host, data);
+		if (table < 0)
+			return table;
+	}
+	host->cur_table = table;
+
 	// disable irq of RX & TX, let DMA handle it
-	//SDMMC_INTMASK &= ~(SDMMC_INT_RXDR | SDMMC_INT_TXDR);
+	mci_writel(INTMASK, mci_readl(INTMASK) & ~(SDMMC_INT_RXDR | SDMMC_INT_TXDR));
 	SDMMC_CTRL |= SDMMC_CTRL_DMA_ENABLE; // enable dma
-	dma_prog_sg_channel(host->dma_chn, host->sg_dma);
+	dma_prog_sg_channel(host->dma_chn, host->sg_dma + table * PAGE_SIZE);
 	wmb();
 	/* Go! */
 	dma_start_channel(host->dma_chn);
@@ -504,6 +587,40 @@ static int lpc313x_mci_submit_data_dma(struct lpc313x_mci *host, struct mmc_data
 	return 0;
 }
 
+static void lpc313x_mci_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+				bool is_first_req)
+{
+	struct lpc313x_mci_slot	*slot = mmc_priv(mmc);
+	struct mmc_data		*data = mrq->data;
+	int			table;
+
+	if (!data)
+		return;
+
+	/* Nothing to overlap, the request does its own preparation */
+	if (is_first_req) {
+		data->host_cookie = 0;
+		return;
+	}
+
+	table = lpc313x_mci_dma_prep(slot->host, data);
+	data->host_cookie = (table < 0) ? 0 : (table + 1);
+}
+
+static void lpc313x_mci_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+				 int err)
+{
+	struct lpc313x_mci_slot	*slot = mmc_priv(mmc);
+	struct mmc_data		*data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	lpc313x_mci_dma_unmap(slot->host, data);
+	clear_bit(data->host_cookie - 1, &slot->host->sg_busy);
+	data->host_cookie = 0;
+}
+
 #else
 static int lpc313x_mci_submit_data_dma(struct lpc313x_mci *host, struct mmc_data *data)
 {
@@ -533,8 +650,8 @@ static void lpc313x_mci_submit_data(struct lpc313x_mci *host, struct mmc_data *d
 		else
 			host->dir_status = LPC313x_MCI_SEND_STATUS;
 
-		//SDMMC_INTMASK |= (SDMMC_INT_RXDR | SDMMC_INT_TXDR);
-		SDMMC_CTRL &= ~SDMMC_CTRL_DMA_ENABLE; // enable dma
+		mci_writel(INTMASK, mci_readl(INTMASK) | SDMMC_INT_RXDR | SDMMC_INT_TXDR);
+		SDMMC_CTRL &= ~SDMMC_CTRL_DMA_ENABLE; // disable dma
 	}
 
 }
@@ -747,6 +864,10 @@ static void lpc313x_mci_enable_sdio_irq(struct mmc_host *host, int enable)
 
 static const struct mmc_host_ops lpc313x_mci_ops = {
 	.request	= lpc313x_mci_request,
+#ifdef USE_DMA
+	.pre_req	= lpc313x_mci_pre_req,
+	.post_req	= lpc313x_mci_post_req,
+#endif
 	.set_ios	= lpc313x_mci_set_ios,
 	.get_ro		= lpc313x_mci_get_ro,
 	.get_cd		= lpc313x_mci_get_cd,
@@ -1354,17 +1475,22 @@ lpc313x_mci_init_slot(struct lpc313x_mci *host, unsigned int id)
 	if (host->pdata->setpower)
 		host->pdata->setpower(id, 0);
 
-	mmc->caps = MMC_CAP_SDIO_IRQ;
+	/*
+	 * The controller does not wait for busy after R1b responses, the
+	 * core polls the card status after an erase instead.
+	 */
+	mmc->caps = MMC_CAP_SDIO_IRQ | MMC_CAP_ERASE;
 	if (host->pdata->get_bus_wd)
 		if (host->pdata->get_bus_wd(slot->id) >= 4)
 			mmc->caps |= MMC_CAP_4_BIT_DATA;
 
-	mmc->max_phys_segs = 64;
-	mmc->max_hw_segs = 64;
+	mmc->max_phys_segs = LPC313x_MCI_MAX_SEGS;
+	mmc->max_hw_segs = LPC313x_MCI_MAX_SEGS;
 	mmc->max_blk_size = 65536; /* BLKSIZ is 16 bits*/
-	mmc->max_blk_count = 512;
-	mmc->max_req_size = mmc->max_blk_size * mmc->max_blk_count;
-	mmc->max_seg_size = mmc->max_req_size;
+	mmc->max_blk_count = LPC313x_MCI_MAX_REQ_SIZE / 512;
+	mmc->max_req_size = LPC313x_MCI_MAX_REQ_SIZE;
+	/* one SG descriptor per segment */
+	mmc->max_seg_size = LPC313x_MCI_DMA_SEG_MAX;
 
 	/* call board init */
 	slot->irq = host->pdata->init(id, lpc313x_mci_detect_interrupt, slot);
@@ -1405,6 +1531,92 @@ static void lpc313x_mci_cleanup_slot(struct lpc313x_mci_slot *slot,
 	mmc_free_host(slot->mmc);
 }
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * CCLK_IN may share its fractional divider with the ARM/AHB clocks that
+ * cpufreq scales. The card clock divider is set from bus_hz, so pick a
+ * rate before speeding up that keeps the card within its limit, and the
+ * real one once the change is done.
+ */
+static int lpc313x_mci_cpufreq_transition(struct notifier_block *nb,
+					  unsigned long val, void *data)
+{
+	struct lpc313x_mci *host;
+	struct cpufreq_freqs *freqs = data;
+	unsigned long flags;
+	u32 bus_hz;
+	int i;
+
+	host = container_of(nb, struct lpc313x_mci, freq_transition);
+
+	if (val == CPUFREQ_PRECHANGE && freqs->new > freqs->old) {
+		u64 rate = (u64)host->bus_hz * freqs->new;
+
+		do_div(rate, freqs->old);
+		bus_hz = rate;
+	} else if (val == CPUFREQ_POSTCHANGE) {
+		bus_hz = cgu_get_clk_freq(CGU_SB_SD_MMC_CCLK_IN_ID);
+	} else {
+		return 0;
+	}
+
+	spin_lock_irqsave(&host->lock, flags);
+	if (bus_hz == host->bus_hz)
+		goto out;
+
+	host->bus_hz = bus_hz;
+	/* recompute the divider from the clock the core asked for */
+	for (i = 0; i < host->pdata->num_slots; i++) {
+		if (host->slot[i])
+			host->slot[i]->clock = host->slot[i]->mmc->ios.clock;
+	}
+	/* requests started from now on pick up the new divider */
+	host->current_speed = 0;
+
+	/*
+	 * The divider can only change between requests. The notifier can't
+	 * veto the change, so hold it off until the request in flight is
+	 * done, however long a write or erase takes: speeding up under it
+	 * would overclock the card. The next request starts with the new
+	 * divider, which ends the wait as well.
+	 */
+	while (host->state != STATE_IDLE && !host->current_speed) {
+		spin_unlock_irqrestore(&host->lock, flags);
+		msleep(1);
+		spin_lock_irqsave(&host->lock, flags);
+	}
+	if (host->state == STATE_IDLE && !host->current_speed &&
+	    host->cur_slot && host->cur_slot->clock)
+		lpc313x_mci_setup_bus(host->cur_slot);
+out:
+	spin_unlock_irqrestore(&host->lock, flags);
+
+	return 0;
+}
+
+static int lpc313x_mci_cpufreq_register(struct lpc313x_mci *host)
+{
+	host->freq_transition.notifier_call = lpc313x_mci_cpufreq_transition;
+
+	return cpufreq_register_notifier(&host->freq_transition,
+					 CPUFREQ_TRANSITION_NOTIFIER);
+}
+
+static void lpc313x_mci_cpufreq_deregister(struct lpc313x_mci *host)
+{
+	cpufreq_unregister_notifier(&host->freq_transition,
+				    CPUFREQ_TRANSITION_NOTIFIER);
+}
+#else
+static inline int lpc313x_mci_cpufreq_register(struct lpc313x_mci *host)
+{
+	return 0;
+}
+
+static inline void lpc313x_mci_cpufreq_deregister(struct lpc313x_mci *host)
+{
+}
+#endif
 
 static int lpc313x_mci_probe(struct platform_device *pdev)
 {
@@ -1474,7 +1686,9 @@ static int lpc313x_mci_probe(struct platform_device *pdev)
 		goto err_freemap;
 	}
 
-	host->sg_cpu = dma_alloc_coherent(&pdev->dev, PAGE_SIZE, &host->sg_dma, GFP_KERNEL);
+	host->sg_cpu = dma_alloc_coherent(&pdev->dev,
+			LPC313x_MCI_DMA_TABLES * PAGE_SIZE, &host->sg_dma, GFP_KERNEL);
+	host->cur_table = -1;
 	if (host->sg_cpu == NULL) {
 		dev_err(&pdev->dev,
 			 "%s: could not alloc dma memory \n", __func__);
@@ -1538,6 +1752,8 @@ static int lpc313x_mci_probe(struct platform_device *pdev)
 	mci_writel(INTMASK,SDMMC_INT_CMD_DONE | SDMMC_INT_DATA_OVER | SDMMC_INT_TXDR | SDMMC_INT_RXDR | LPC313x_MCI_ERROR_FLAGS);
 	mci_writel(CTRL,SDMMC_CTRL_INT_ENABLE); // enable mci interrupt
 
+	if (lpc313x_mci_cpufreq_register(host))
+		dev_warn(&pdev->dev, "failed to register cpufreq notifier\n");
 
 	dev_info(&pdev->dev, "LPC313x MMC controller at irq %d\n", irq);
 
@@ -1553,7 +1769,8 @@ err_init_slot:
 	free_irq(irq, host);
 err_dmaunmap:
 #ifdef USE_DMA
-	dma_free_coherent(&pdev->dev, PAGE_SIZE, host->sg_cpu, host->sg_dma);
+	dma_free_coherent(&pdev->dev, LPC313x_MCI_DMA_TABLES * PAGE_SIZE,
+			host->sg_cpu, host->sg_dma);
 	dma_release_sg_channel(host->dma_chn);
 err_freemap:
 #endif
@@ -1575,6 +1792,8 @@ static int __exit lpc313x_mci_remove(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, NULL);
 
+	lpc313x_mci_cpufreq_deregister(host);
+
 	for (i = 0; i < host->pdata->num_slots; i++) {
 		dev_dbg(&pdev->dev, "remove slot %d\n", i);
 		if (host->slot[i])
@@ -1591,7 +1810,8 @@ static int __exit lpc313x_mci_remove(struct platform_device *pdev)
 
 	free_irq(platform_get_irq(pdev, 0), host);
 #ifdef USE_DMA
-	dma_free_coherent(&pdev->dev, PAGE_SIZE, host->sg_cpu, host->sg_dma);
+	dma_free_coherent(&pdev->dev, LPC313x_MCI_DMA_TABLES * PAGE_SIZE,
+			host->sg_cpu, host->sg_dma);
 	dma_release_sg_channel(host->dma_chn);
 #endif
 	iounmap(host->regs);
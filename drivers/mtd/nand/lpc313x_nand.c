@@ -60,9 +60,10 @@
  * */
 #define USE_DMA
 
-/* Maximum number of DMA descritpors in SG table
+/* Maximum number of DMA descritpors in SG table. Two descriptors
+ * (payload + OOB) are used per ECC step, enough for a 4K page.
  * */
-#define NAND_DMA_MAX_DESC 4
+#define NAND_DMA_MAX_DESC 16
 
 /* Register access macros */
 #define nand_readl(reg)		__raw_readl(&NAND_##reg)
@@ -100,7 +101,6 @@ struct lpc313x_nand_info {
 	int	dma_chn;
 	dma_addr_t sg_dma;
 	dma_sg_ll_t *sg_cpu;
-	wait_queue_head_t dma_waitq;
 	volatile u32 dmapending;
 #endif
 	int irq;
@@ -257,9 +257,15 @@ static void lpc313x_nand_dma_irq(int chn, dma_irq_type_t type,
 	/* SG Table ended */
 	if (type == DMA_IRQ_FINISHED)
 	{
-		/* Flag event and wakeup */
+		/* The payload entry raises FINISHED too. The step is only
+		   complete once the last entry (no companion reload) is done */
+		if ((DMACH_EN(chn) & 1) || (DMACH_CFG(chn) & DMA_CFG_CMP_CH_EN))
+			return;
+
+		/* Flag event and wakeup, the NAND wait queue is shared so
+		   a read can wait for decode and DMA completion at once */
 		host->dmapending = 1;
-		wake_up(&host->dma_waitq);
+		wake_up(&host->irq_waitq);
 	}
 	else if (type == DMA_IRQS_ABORT)
 	{
@@ -325,50 +331,82 @@ static dma_addr_t lpc313x_nand_dma_map(struct lpc313x_nand_info *host,
 }
 
 /*
- * DMA Scatter Gather transfer function
+ * Build the DMA Scatter Gather table for consecutive ECC steps
  * mtd : Pointer to mtd_info structure
  * chip : Pointer to nand_chip structure
- * bufrdy : SRAM buffer index
+ * steps : Number of ECC steps
+ * bufnum : SRAM buffer index of the first step
  * pay_load : Pay load buffer physical address
  * oob_data : OOB data buffer physical address
  * rd : read flag (1: read operation 0: write operation)
+ *
+ * Step n uses SG entries 2n (pay load) and 2n + 1 (OOB) and the SRAM
+ * buffers alternate, so a step is started with a single channel program.
  */
-static void lpc313x_nand_dma_sg_tfr(struct mtd_info *mtd,
-		struct nand_chip *chip, int bufrdy,	u32 pay_load, u32 oob_data, int rd)
+static void lpc313x_nand_dma_sg_build(struct mtd_info *mtd,
+		struct nand_chip *chip, int steps, int bufnum, u32 pay_load,
+		u32 oob_data, int rd)
 {
 	struct lpc313x_nand_mtd *nmtd;
 	struct lpc313x_nand_info *host;
-	int eccsize = chip->ecc.size;
+	int i, bufrdy, eccsize = chip->ecc.size;
 	int oob_size = rd ? chip->ecc.bytes : OOB_FREE_OFFSET;
+	dma_sg_ll_t *sg;
 
 	nmtd = chip->priv;
 	host = nmtd->host;
 
-	/* SG entry to transfer pay load */
-	host->sg_cpu[0].setup.src_address = rd ? nand_buff_phys_addr[bufrdy] :
-			pay_load;
-	host->sg_cpu[0].setup.dest_address = rd ? pay_load :
-			nand_buff_phys_addr[bufrdy];
-	host->sg_cpu[0].setup.trans_length = (eccsize >> 2) - 1;
-	host->sg_cpu[0].setup.cfg = DMA_CFG_CMP_CH_EN |
-			DMA_CFG_CMP_CH_NR(host->dma_chn) | DMA_CFG_TX_WORD;
-	host->sg_cpu[0].next_entry = host->sg_dma + sizeof(dma_sg_ll_t);
-
-	/* SG entry to transfer OOB data */
-	host->sg_cpu[1].setup.src_address = rd ? (nand_buff_phys_addr[bufrdy] +
-			eccsize) : oob_data;
-	host->sg_cpu[1].setup.dest_address = rd ? oob_data :
-			(nand_buff_phys_addr[bufrdy] + eccsize);
-	host->sg_cpu[1].setup.trans_length = (oob_size >> 2) - 1;
-	host->sg_cpu[1].setup.cfg = DMA_CFG_TX_WORD;
-	host->sg_cpu[1].next_entry = 0;
+	for (i = 0; i < steps; i++) {
+		sg = &host->sg_cpu[2 * i];
+		bufrdy = (bufnum + i) & 1;
+
+		/* SG entry to transfer pay load */
+		sg[0].setup.src_address = rd ? nand_buff_phys_addr[bufrdy] :
+				pay_load;
+		sg[0].setup.dest_address = rd ? pay_load :
+				nand_buff_phys_addr[bufrdy];
+		sg[0].setup.trans_length = (eccsize >> 2) - 1;
+		sg[0].setup.cfg = DMA_CFG_CMP_CH_EN |
+				DMA_CFG_CMP_CH_NR(host->dma_chn) | DMA_CFG_TX_WORD;
+		sg[0].next_entry = host->sg_dma +
+				(2 * i + 1) * sizeof(dma_sg_ll_t);
+
+		/* SG entry to transfer OOB data */
+		sg[1].setup.src_address = rd ? (nand_buff_phys_addr[bufrdy] +
+				eccsize) : oob_data;
+		sg[1].setup.dest_address = rd ? oob_data :
+				(nand_buff_phys_addr[bufrdy] + eccsize);
+		sg[1].setup.trans_length = (oob_size >> 2) - 1;
+		sg[1].setup.cfg = DMA_CFG_TX_WORD;
+		sg[1].next_entry = 0;
+
+		pay_load += eccsize;
+		oob_data += chip->ecc.bytes;
+	}
+}
 
-	/* Program the SG channel */
-	dma_prog_sg_channel(host->dma_chn, host->sg_dma);
+/*
+ * Enable or disable the DMA FINISHED interrupt for a page transfer
+ */
+static void lpc313x_nand_dma_irq_en(struct lpc313x_nand_info *host, int en)
+{
+	dma_set_irq_mask((host->dma_chn - 1), 1, !en);
+
+	/* Stop the channel */
+	if (!en)
+		dma_stop_channel(host->dma_chn);
+}
 
-	/* Enable FINISHED interrupt */
-	dma_set_irq_mask(host->dma_chn, 1, 0);
-	dma_set_irq_mask((host->dma_chn - 1), 1, 0);
+/*
+ * Start the DMA transfer of one ECC step, completion is flagged in
+ * host->dmapending
+ */
+static void lpc313x_nand_dma_sg_start(struct lpc313x_nand_info *host,
+		int step)
+{
+	/* Program the SG channel */
+	dma_prog_sg_channel(host->dma_chn,
+			host->sg_dma + 2 * step * sizeof(dma_sg_ll_t));
 
 	/* Set counter to 0 */
 	dma_write_counter((host->dma_chn - 1), 0);
@@ -376,18 +414,14 @@ static void lpc313x_nand_dma_sg_tfr(struct mtd_info *mtd,
 	/* Start the transfer */
 	host->dmapending = 0;
 	dma_start_channel(host->dma_chn);
+}
 
-	/* Wait for FINISHED interrupt */
-	wait_event(host->dma_waitq, host->dmapending);
-
-	/* Mask all the interrupts for the channel */
-	dma_set_irq_mask(host->dma_chn, 1, 1);
-	dma_set_irq_mask((host->dma_chn - 1), 1, 1);
-
-	/* Stop the channel */
-	dma_stop_channel(host->dma_chn);
-
-	return;
+/*
+ * Wait for the DMA transfer of an ECC step
+ */
+static inline void lpc313x_nand_dma_wait(struct lpc313x_nand_info *host)
+{
+	wait_event(host->irq_waitq, host->dmapending);
 }
 #endif
 
@@ -842,23 +876,21 @@ static void lpc313x_nand_write_buf16(struct mtd_info *mtd, const u_char *buf,
 }
 
 /*
- * Read the payload and OOB data from the device in the hardware storage format
+ * Read consecutive ECC steps (payload and OOB data) from the current
+ * column of the device in the hardware storage format
  */
-static int lpc313x_nand_read_page_syndrome(struct mtd_info *mtd, struct nand_chip *chip,
-				   uint8_t *buf)
+static void lpc313x_nand_read_steps(struct mtd_info *mtd, struct nand_chip *chip,
+				   int eccsteps, uint8_t *buf, uint8_t *oob)
 {
-	int i, curbuf = 0, bufrdy = -1, eccsize = chip->ecc.size;
+	int i, curbuf = 0, eccsize = chip->ecc.size;
 	int eccbytes = chip->ecc.bytes;
-	int eccsteps = chip->ecc.steps;
 	uint8_t *p = buf;
-	uint8_t *oob = chip->oob_poi;
 #ifdef USE_DMA
 	int use_dma = 0;
 	dma_addr_t pmapped = 0, oobmapped = 0;
-	u32 p1 = 0, oob1 = 0;
 #endif
 
-#if !defined(STATUS_POLLING)
+#if !defined(STATUS_POLLING) || defined(USE_DMA)
 	struct lpc313x_nand_mtd *nmtd;
 	struct lpc313x_nand_info *host;
 
@@ -871,88 +903,139 @@ static int lpc313x_nand_read_page_syndrome(struct mtd_info *mtd, struct nand_chi
 	pmapped = lpc313x_nand_dma_map(host, (u32) p, (eccsize * eccsteps), 1);
 	oobmapped = lpc313x_nand_dma_map(host, (u32) oob, (eccbytes * eccsteps), 1);
 	if((oobmapped) && (pmapped)) {
-		p1 = pmapped;
-		oob1 = oobmapped;
+		/* The SG table for all the steps is built once, each step
+		   then only needs to start the channel */
+		lpc313x_nand_dma_sg_build(mtd, chip, eccsteps, 0, pmapped,
+				oobmapped, 1);
+		lpc313x_nand_dma_irq_en(host, 1);
 		use_dma = 1;
 	}
-#endif
-
-	for (i = eccsteps; i > 0; i--) {
-		/* Clear all current statuses */
-		lpc313x_nand_int_clear(~0);
 
-		/* Start read into RAM0 or RAM1 */
-#if !defined(STATUS_POLLING)
-		host->intspending = 0;
+	/* No transfer in flight yet */
+	host->dmapending = 1;
 #endif
-		lpc313x_ram_read(curbuf);
-
-		/* Read current buffer while next buffer is loading */
-		if (bufrdy >= 0) {
 
-#ifdef USE_DMA
-			/* If DMA mapping succesful, use DMA for transfer.
-			 * Else use memcpy for transfer
-			 * */
-			if(use_dma) {
-				/* Read payload & oob using DMA */
-				lpc313x_nand_dma_sg_tfr(mtd, chip, bufrdy, p1, oob1, 1);
-
-				/* Update buffers offsets */
-				p1 += eccsize;
-				oob1 += eccbytes;
-			}
-			else
+	/* Start decoding the first step into RAM0 */
+	lpc313x_nand_int_clear(~0);
+#if !defined(STATUS_POLLING)
+	host->intspending = 0;
 #endif
-			{
-				/* Read payload portion of the transfer */
-				memcpy((void *)p, nand_buff_addr[bufrdy], eccsize);
-				p += eccsize;
-
-				/* Read OOB data portion of the transfer */
-				memcpy((void *)oob, nand_buff_addr[bufrdy] + eccsize, eccbytes);
-				oob += eccbytes;
-			}
-		}
-
+	lpc313x_ram_read(curbuf);
+
+	/*
+	 * The ECC decode of step N + 1 into one SRAM buffer overlaps the
+	 * transfer of step N out of the other one. Before a buffer is reused
+	 * both its decode and the transfer out of it must have completed.
+	 */
+	for (i = 0; i < eccsteps; i++) {
 #if defined(STATUS_POLLING)
 		/* Polling for buffer loaded and decoded */
 		while (!((nand_readl(IRQSTATUSRAW1)) & nand_buff_dec_mask[curbuf]));
+#ifdef USE_DMA
+		lpc313x_nand_dma_wait(host);
+#endif
 
 #else
-		/* Interrupt based wait operation */
+		/* Interrupt based wait operation, the previous DMA transfer
+		   completes on the same wait queue */
+#ifdef USE_DMA
+		wait_event(host->irq_waitq, host->intspending && host->dmapending);
+#else
 		lpc313x_wait_irq(host);
+#endif
 #endif
 
-		bufrdy = curbuf;
-		curbuf = 1 - curbuf;
+		/* Data is corrected in the SRAM buffer, check the status */
+		chip->ecc.correct(mtd, p, (u_char *) nand_buff_addr[curbuf] + eccsize,
+			NULL);
 
-		chip->ecc.correct(mtd, p, oob, NULL);
+		/* Start decoding the next step into the other buffer */
+		if (i < eccsteps - 1) {
+			lpc313x_nand_int_clear(~0);
+#if !defined(STATUS_POLLING)
+			host->intspending = 0;
+#endif
+			lpc313x_ram_read(1 - curbuf);
+		}
+
+#ifdef USE_DMA
+		/* If DMA mapping succesful, use DMA for transfer.
+		 * Else use memcpy for transfer
+		 * */
+		if(use_dma) {
+			/* Read payload & oob using DMA, completion is
+			   checked before the buffer is reused */
+			lpc313x_nand_dma_sg_start(host, i);
+		}
+		else
+#endif
+		{
+			/* Read payload portion of the transfer */
+			memcpy((void *)p, nand_buff_addr[curbuf], eccsize);
+
+			/* Read OOB data portion of the transfer */
+			memcpy((void *)oob, nand_buff_addr[curbuf] + eccsize, eccbytes);
+		}
+
+		p += eccsize;
+		oob += eccbytes;
+		curbuf = 1 - curbuf;
 	}
 
 #ifdef USE_DMA
 	if(use_dma) {
-		/* Transfer payload & oob using DMA */
-		lpc313x_nand_dma_sg_tfr(mtd, chip, bufrdy, p1, oob1, 1);
+		/* Wait for the last transfer */
+		lpc313x_nand_dma_wait(host);
+		lpc313x_nand_dma_irq_en(host, 0);
+	}
 
-		/* Unmap DMA mappings */
+	/* Unmap DMA mappings */
+	if (pmapped)
 		dma_unmap_single(host->dev, pmapped, (eccsize * eccsteps),
 				DMA_FROM_DEVICE);
+	if (oobmapped)
 		dma_unmap_single(host->dev, oobmapped, (eccbytes * eccsteps),
 				DMA_FROM_DEVICE);
-	}
-	else
 #endif
-	{
-		/* Read payload portion of the transfer */
-		memcpy((void *)p, nand_buff_addr[bufrdy], eccsize);
-
-		/* Read OOB data portion of the transfer */
-		memcpy((void *)oob, nand_buff_addr[bufrdy] + eccsize, eccbytes);
-	}
 
 	/* Disable all interrupts */
 	lpc313x_nand_int_dis(~0);
+}
+
+/*
+ * Read the payload and OOB data from the device in the hardware storage format
+ */
+static int lpc313x_nand_read_page_syndrome(struct mtd_info *mtd, struct nand_chip *chip,
+				   uint8_t *buf)
+{
+	lpc313x_nand_read_steps(mtd, chip, chip->ecc.steps, buf, chip->oob_poi);
+
+	return 0;
+}
+
+/*
+ * Read only the ECC steps covering a part of the page. The data lands at
+ * its page offset in buf and the OOB data at its place in oob_poi. A
+ * sub-page is one 512 byte ECC step on 2K pages but two on 4K pages,
+ * every step in the range is decoded with its own ECC bytes.
+ */
+static int lpc313x_nand_read_subpage(struct mtd_info *mtd, struct nand_chip *chip,
+				   uint32_t data_offs, uint32_t readlen, uint8_t *buf)
+{
+	int start_step, end_step;
+
+	start_step = data_offs / chip->ecc.size;
+	end_step = (data_offs + readlen - 1) / chip->ecc.size;
+
+	/* Steps are stored interleaved with their OOB data, move the
+	   column to the first step if needed */
+	if (start_step)
+		chip->cmdfunc(mtd, NAND_CMD_RNDOUT,
+			start_step * (chip->ecc.size + chip->ecc.bytes), -1);
+
+	lpc313x_nand_read_steps(mtd, chip, end_step - start_step + 1,
+		buf + start_step * chip->ecc.size,
+		chip->oob_poi + start_step * chip->ecc.bytes);
 
 	return 0;
 }
@@ -994,24 +1077,110 @@ static int lpc313x_nand_read_oob_syndrome(struct mtd_info *mtd, struct nand_chip
 	return 1;
 }
 
+/*
+ * Check if an ECC step only holds erased (0xFF) payload and free OOB bytes
+ */
+static int lpc313x_nand_step_blank(struct nand_chip *chip, const uint8_t *p,
+				   const uint8_t *oob)
+{
+	int i;
+
+	for (i = 0; i < chip->ecc.size; i++)
+		if (p[i] != 0xFF)
+			return 0;
+
+	for (i = 0; i < OOB_FREE_OFFSET; i++)
+		if (oob[i] != 0xFF)
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Return the next ECC step to program from step onwards, or
+ * chip->ecc.steps if the rest of the page is blank. Blank sub-pages are
+ * skipped as a whole, every step of a sub-page that holds data is
+ * programmed.
+ */
+static int lpc313x_nand_next_step(struct nand_chip *chip, const uint8_t *buf,
+				  int step)
+{
+	int i, substeps = chip->subpagesize / chip->ecc.size;
+
+	if (substeps < 1)
+		substeps = 1;
+
+	/* Inside a sub-page that is being programmed */
+	if (step % substeps)
+		return step;
+
+	for (; step < chip->ecc.steps; step += substeps) {
+		for (i = step; i < step + substeps; i++)
+			if (!lpc313x_nand_step_blank(chip,
+					buf + i * chip->ecc.size,
+					chip->oob_poi + i * chip->ecc.bytes))
+				return step;
+	}
+
+	return chip->ecc.steps;
+}
+
+/*
+ * Load the payload and free OOB bytes of an ECC step into a SRAM buffer
+ * and wait for the hardware ECC encode
+ */
+static void lpc313x_nand_load_step(struct mtd_info *mtd, struct nand_chip *chip,
+		int bufnum, int step, const uint8_t *buf, u32 p1, u32 oob1)
+{
+	int eccsize = chip->ecc.size, eccbytes = chip->ecc.bytes;
+
+#ifdef USE_DMA
+	/* If DMA mapping succesful, use DMA for transfer.
+	 * Else use memcpy for transfer
+	 * */
+	if (p1) {
+		struct lpc313x_nand_mtd *nmtd = chip->priv;
+
+		/* Transfer pay load & OOB using DMA */
+		lpc313x_nand_dma_sg_build(mtd, chip, 1, bufnum,
+			p1 + step * eccsize, oob1 + step * eccbytes, 0);
+		lpc313x_nand_dma_sg_start(nmtd->host, 0);
+		lpc313x_nand_dma_wait(nmtd->host);
+	}
+	else
+#endif
+	{
+		/* Copy payload and OOB data to the buffer */
+		memcpy((void *) nand_buff_addr[bufnum], buf + step * eccsize,
+			eccsize);
+		memcpy((void *) nand_buff_addr[bufnum] + eccsize,
+			chip->oob_poi + step * eccbytes, OOB_FREE_OFFSET);
+	}
+
+	while(!((nand_readl(IRQSTATUSRAW1)) & nand_buff_enc_mask[bufnum]));
+}
+
 /*
  * Write the payload and OOB data to the device in the hardware storage format
+ *
+ * Blank sub-pages are not programmed. They stay erased, which lets
+ * nand_do_write_ops() program a page one sub-page at a time (one ECC step
+ * on 2K pages, two on 4K pages): the 0xFF padding never gets ECC bytes
+ * that a later sub-page write would have to overwrite.
  */
 static void lpc313x_nand_write_page_syndrome(struct mtd_info *mtd,
 				    struct nand_chip *chip, const uint8_t *buf)
 {
-	int i, curbuf = 0, bufrdy = 0, eccsize = chip->ecc.size;
+	int i, step, next, col = 0, curbuf = 0, eccsize = chip->ecc.size;
 	int eccbytes = chip->ecc.bytes;
 	int eccsteps = chip->ecc.steps;
-	const uint8_t *p = buf;
-	uint8_t *oob = chip->oob_poi;
+	int chunk = eccsize + eccbytes;
+	u32 p1 = 0, oob1 = 0;
 #ifdef USE_DMA
 	dma_addr_t pmapped, oobmapped;
-	u32 p1 = 0, oob1 = 0;
-	int use_dma = 0;
 #endif
 
-#if !defined(STATUS_POLLING)
+#if !defined(STATUS_POLLING) || defined(USE_DMA)
 	struct lpc313x_nand_mtd *nmtd;
 	struct lpc313x_nand_info *host;
 
@@ -1020,45 +1189,27 @@ static void lpc313x_nand_write_page_syndrome(struct mtd_info *mtd,
 #endif
 
 #ifdef USE_DMA
-	pmapped = lpc313x_nand_dma_map(host, (u32) p, (eccsize * eccsteps), 0);
-	oobmapped = lpc313x_nand_dma_map(host, (u32) oob, (eccbytes * eccsteps), 0);
+	pmapped = lpc313x_nand_dma_map(host, (u32) buf, (eccsize * eccsteps), 0);
+	oobmapped = lpc313x_nand_dma_map(host, (u32) chip->oob_poi,
+			(eccbytes * eccsteps), 0);
 	if((pmapped) && (oobmapped)) {
-		use_dma = 1;
 		p1 = pmapped;
 		oob1 = oobmapped;
+		lpc313x_nand_dma_irq_en(host, 1);
 	}
 #endif
 
 	/* Clear all current statuses */
 	lpc313x_nand_int_clear(~0);
-#ifdef USE_DMA
-	/* If DMA mapping succesful, use DMA for transfer.
-	 * Else use memcpy for transfer
-	 * */
-	if(use_dma) {
-		/* Transfer pay load & OOB using DMA */
-		lpc313x_nand_dma_sg_tfr(mtd, chip, bufrdy, p1, oob1, 0);
 
-		/* Update buffer offsets */
-		p1 += eccsize;
-		oob1 += eccbytes;
-	}
-	else
-#endif
-	{
-		/* Copy payload and OOB data to the buffer */
-		memcpy((void *) nand_buff_addr[bufrdy], p, eccsize);
-		memcpy((void *) nand_buff_addr[bufrdy] + eccsize, oob, OOB_FREE_OFFSET);
-		p += eccsize;
-		oob += eccbytes;
-	}
+	step = lpc313x_nand_next_step(chip, buf, 0);
+	if (step < eccsteps)
+		lpc313x_nand_load_step(mtd, chip, curbuf, step, buf, p1, oob1);
 
-	while(!((nand_readl(IRQSTATUSRAW1)) & nand_buff_enc_mask[bufrdy]));
-
-	for (i = eccsteps; i > 0; i--) {
-		/* Buffer management */
-		curbuf = bufrdy;
-		bufrdy = 1 - bufrdy;
+	while (step < eccsteps) {
+		/* Skip over blank steps */
+		if (step * chunk != col)
+			chip->cmdfunc(mtd, NAND_CMD_RNDIN, step * chunk, -1);
 
 		/* Start the transfer to the device */
 		lpc313x_nand_int_clear(~0);
@@ -1069,30 +1220,10 @@ static void lpc313x_nand_write_page_syndrome(struct mtd_info *mtd,
 
 		/* Copy next payload and OOB data to the buffer while current
 		   buffer is transferring */
-		if (i > 1) {
-
-#ifdef USE_DMA
-			/* If DMA mapping succesful, use DMA for transfer.
-			 * Else use memcpy for transfer
-			 * */
-			if(use_dma) {
-				/* Transfer pay load & OOB using DMA */
-				lpc313x_nand_dma_sg_tfr(mtd, chip, bufrdy, p1, oob1, 0);
-
-				/* Update buffer offsets */
-				p1 += eccsize;
-				oob1 += eccbytes;
-			}
-			else
-#endif
-			{
-				memcpy((void *) nand_buff_addr[bufrdy], p, eccsize);
-				memcpy((void *) nand_buff_addr[bufrdy] + eccsize, oob, OOB_FREE_OFFSET);
-				p += eccsize;
-				oob += eccbytes;
-			}
-			while(!((nand_readl(IRQSTATUSRAW1)) & nand_buff_enc_mask[bufrdy]));
-		}
+		next = lpc313x_nand_next_step(chip, buf, step + 1);
+		if (next < eccsteps)
+			lpc313x_nand_load_step(mtd, chip, 1 - curbuf, next, buf,
+				p1, oob1);
 
 #if defined(STATUS_POLLING)
 		/* Polling for buffer loaded and decoded */
@@ -1102,21 +1233,30 @@ static void lpc313x_nand_write_page_syndrome(struct mtd_info *mtd,
 		/* Interrupt based wait operation */
 		lpc313x_wait_irq(host);
 #endif
+
+		col = (step + 1) * chunk;
+		step = next;
+		curbuf = 1 - curbuf;
 	}
 
 	/* Calculate remaining oob bytes */
-	i = mtd->oobsize - (oob - chip->oob_poi);
-	if (i)
-		chip->write_buf(mtd, oob, i);
+	i = mtd->oobsize - (eccsteps * eccbytes);
+	if (i) {
+		if (eccsteps * chunk != col)
+			chip->cmdfunc(mtd, NAND_CMD_RNDIN, eccsteps * chunk, -1);
+		chip->write_buf(mtd, chip->oob_poi + (eccsteps * eccbytes), i);
+	}
 
 #ifdef USE_DMA
 	/* Unmap DMA mappings */
-	if(use_dma) {
+	if (p1)
+		lpc313x_nand_dma_irq_en(host, 0);
+	if (pmapped)
 		dma_unmap_single(host->dev, pmapped, (eccsize * eccsteps),
 				DMA_TO_DEVICE);
+	if (oobmapped)
 		dma_unmap_single(host->dev, oobmapped, (eccbytes * eccsteps),
 				DMA_TO_DEVICE);
-	}
 #endif
 
 	/* Disable all interrupts */
@@ -1244,6 +1384,7 @@ static void lpc313x_nand_init_chip(struct lpc313x_nand_info *host,
 	chip->ecc.mode = NAND_ECC_HW_SYNDROME;
 	chip->ecc.read_page_raw = lpc313x_nand_read_page_syndrome;
 	chip->ecc.read_page = lpc313x_nand_read_page_syndrome;
+	chip->ecc.read_subpage = lpc313x_nand_read_subpage;
 	chip->ecc.write_page = lpc313x_nand_write_page_syndrome;
 	chip->ecc.write_oob = lpc313x_nand_write_oob_syndrome;
 	chip->ecc.read_oob = lpc313x_nand_read_oob_syndrome;
@@ -1252,7 +1393,7 @@ static void lpc313x_nand_init_chip(struct lpc313x_nand_info *host,
 	chip->ecc.hwctl = lpc313x_nand_enable_hwecc;
 
 	chip->verify_buf = lpc313x_nand_verify_hwecc;
-	chip->options |= NAND_USE_FLASH_BBT;
+	chip->options |= NAND_USE_FLASH_BBT | NAND_HWECC_SUBPAGE_READ;
 	if (host->platform->support_16bit) {
 		chip->options |= NAND_BUSWIDTH_16;
 	}
@@ -1412,9 +1553,6 @@ static int lpc313x_nand_probe(struct platform_device *pdev) {
 		dev_err(&pdev->dev, "could not alloc dma memory\n");
 		goto exit_error4;
 	}
-
-	/* Initialise DMA wait queue */
-	init_waitqueue_head(&host->dma_waitq);
 #endif
 
 	/* Add MTDs and partitions */
@@ -54,6 +54,11 @@ static int watchdog = 5000;
 module_param(watchdog, int, 0400);
 MODULE_PARM_DESC(watchdog, "transmit timeout in milliseconds");
 
+/*
+ * Packets received per NAPI poll.
+ */
+#define DM9000_NAPI_WEIGHT	64
+
 /* DM9000 register address locking.
  *
  * The DM9000 uses an address register to control where data written
@@ -124,6 +129,9 @@ typedef struct board_info {
 	struct delayed_work phy_poll;
 	struct net_device  *ndev;
 
+	struct napi_struct napi;
+	int		rx_polling;	/* RX left to NAPI, IMR_PRM off */
+
 	spinlock_t	lock;
 
 	struct mii_if_info mii;
@@ -820,6 +828,7 @@ dm9000_init_dm9000(struct net_device *dev)
 	db->imr_all = imr;
 
 	/* Enable TX/RX interrupt mask */
+	db->rx_polling = 0;
 	iow(db, DM9000_IMR, imr);
 
 	/* Init Driver variable */
@@ -949,10 +958,11 @@ struct dm9000_rxhdr {
 } __attribute__((__packed__));
 
 /*
- *  Received a packet and pass to upper layer
+ *  Received packets and pass to upper layer, at most budget of them.
+ *  Returns the number of packets taken out of the RX SRAM.
  */
-static void
-dm9000_rx(struct net_device *dev)
+static int
+dm9000_rx(struct net_device *dev, int budget)
 {
 	board_info_t *db = netdev_priv(dev);
 	struct dm9000_rxhdr rxhdr;
@@ -960,9 +970,19 @@ dm9000_rx(struct net_device *dev)
 	u8 rxbyte, *rdptr;
 	bool GoodPacket;
 	int RxLen;
+	int work_done = 0;
+	unsigned long flags;
+	u8 reg_save;
 
 	/* Check packet ready or not */
-	do {
+	while (work_done < budget) {
+		/* The lock is only held for one packet, so the interrupt
+		 * handler and TX get in between packets */
+		spin_lock_irqsave(&db->lock, flags);
+
+		/* Save previous register address */
+		reg_save = readb(db->io_addr);
+
 		ior(db, DM9000_MRCMDX);	/* Dummy read */
 
 		/* Get most updated data */
@@ -973,11 +993,13 @@ dm9000_rx(struct net_device *dev)
 			dev_warn(db->dev, "status check fail: %d\n", rxbyte);
 			iow(db, DM9000_RCR, 0x00);	/* Stop Device */
 			iow(db, DM9000_ISR, IMR_PAR);	/* Stop INT request */
-			return;
 		}
 
-		if (!(rxbyte & DM9000_PKT_RDY))
-			return;
+		if (!(rxbyte & DM9000_PKT_RDY) || (rxbyte & DM9000_PKT_ERR)) {
+			writeb(reg_save, db->io_addr);
+			spin_unlock_irqrestore(&db->lock, flags);
+			break;
+		}
 
 		/* A packet ready now  & Get status/length */
 		GoodPacket = true;
@@ -1025,6 +1047,7 @@ dm9000_rx(struct net_device *dev)
 		}
 
 		/* Move data from DM9000 */
+		skb = NULL;
 		if (GoodPacket &&
 		    ((skb = dev_alloc_skb(RxLen + 4)) != NULL)) {
 			skb_reserve(skb, 2);
@@ -1034,24 +1057,62 @@ dm9000_rx(struct net_device *dev)
 
 			(db->inblk)(db->io_data, rdptr, RxLen);
 			dev->stats.rx_bytes += RxLen;
-
-			/* Pass to upper layer */
-			skb->protocol = eth_type_trans(skb, dev);
-			if (db->rx_csum) {
-				if ((((rxbyte & 0x1c) << 3) & rxbyte) == 0)
-					skb->ip_summed = CHECKSUM_UNNECESSARY;
-				else
-					skb->ip_summed = CHECKSUM_NONE;
-			}
-			netif_rx(skb);
-			dev->stats.rx_packets++;
-
 		} else {
 			/* need to dump the packet's data */
 
 			(db->dumpblk)(db->io_data, RxLen);
 		}
-	} while (rxbyte & DM9000_PKT_RDY);
+
+		/* Restore previous register address */
+		writeb(reg_save, db->io_addr);
+		spin_unlock_irqrestore(&db->lock, flags);
+
+		work_done++;
+		if (!skb)
+			continue;
+
+		/* Pass to upper layer */
+		skb->protocol = eth_type_trans(skb, dev);
+		if (db->rx_csum) {
+			if ((((rxbyte & 0x1c) << 3) & rxbyte) == 0)
+				skb->ip_summed = CHECKSUM_UNNECESSARY;
+			else
+				skb->ip_summed = CHECKSUM_NONE;
+		}
+		napi_gro_receive(&db->napi, skb);
+		dev->stats.rx_packets++;
+	}
+
+	return work_done;
+}
+
+/*
+ *  NAPI poll: receive packets with the RX interrupt masked
+ */
+static int dm9000_poll(struct napi_struct *napi, int budget)
+{
+	board_info_t *db = container_of(napi, board_info_t, napi);
+	unsigned long flags;
+	int work_done;
+	u8 reg_save;
+
+	work_done = dm9000_rx(db->ndev, budget);
+
+	if (work_done < budget) {
+		napi_complete(napi);
+
+		/* A packet received since the RX SRAM was found empty has
+		 * left ISR_PRS set, so it interrupts as soon as IMR_PRM is
+		 * back on. */
+		spin_lock_irqsave(&db->lock, flags);
+		reg_save = readb(db->io_addr);
+		db->rx_polling = 0;
+		iow(db, DM9000_IMR, db->imr_all);
+		writeb(reg_save, db->io_addr);
+		spin_unlock_irqrestore(&db->lock, flags);
+	}
+
+	return work_done;
 }
 
 static irqreturn_t dm9000_interrupt(int irq, void *dev_id)
@@ -1082,9 +1143,12 @@ static irqreturn_t dm9000_interrupt(int irq, void *dev_id)
 	if (netif_msg_intr(db))
 		dev_dbg(db->dev, "interrupt status %02x\n", int_status);
 
-	/* Received the coming packet */
-	if (int_status & ISR_PRS)
-		dm9000_rx(dev);
+	/* Received the coming packet, keep RX interrupts off until the
+	 * NAPI poll has emptied the RX SRAM */
+	if (int_status & ISR_PRS) {
+		db->rx_polling = 1;
+		napi_schedule(&db->napi);
+	}
 
 	/* Trnasmit Interrupt check */
 	if (int_status & ISR_PTS)
@@ -1098,7 +1162,10 @@ static irqreturn_t dm9000_interrupt(int irq, void *dev_id)
 	}
 
 	/* Re-enable interrupt mask */
-	iow(db, DM9000_IMR, db->imr_all);
+	if (db->rx_polling)
+		iow(db, DM9000_IMR, db->imr_all & ~IMR_PRM);
+	else
+		iow(db, DM9000_IMR, db->imr_all);
 
 	/* Restore previous register address */
 	writeb(reg_save, db->io_addr);
@@ -1176,8 +1243,12 @@ dm9000_open(struct net_device *dev)
 
 	irqflags |= IRQF_SHARED;
 
-	if (request_irq(dev->irq, dm9000_interrupt, irqflags, dev->name, dev))
+	napi_enable(&db->napi);
+
+	if (request_irq(dev->irq, dm9000_interrupt, irqflags, dev->name, dev)) {
+		napi_disable(&db->napi);
 		return -EAGAIN;
+	}
 
 	/* Initialize DM9000 board */
 	dm9000_reset(db);
@@ -1326,6 +1397,8 @@ dm9000_stop(struct net_device *ndev)
 	netif_stop_queue(ndev);
 	netif_carrier_off(ndev);
 
+	napi_disable(&db->napi);
+
 	/* free interrupt */
 	free_irq(ndev->irq, ndev);
 
@@ -1549,6 +1622,9 @@ dm9000_probe(struct platform_device *pdev)
 	ndev->watchdog_timeo	= msecs_to_jiffies(watchdog);
 	ndev->ethtool_ops	= &dm9000_ethtool_ops;
 
+	netif_napi_add(ndev, &db->napi, dm9000_poll, DM9000_NAPI_WEIGHT);
+	ndev->features |= NETIF_F_GRO;
+
 	db->msg_enable       = NETIF_MSG_LINK;
 	db->mii.phy_id_mask  = 0x1f;
 	db->mii.reg_num_mask = 0x1f;
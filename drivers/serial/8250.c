@@ -2138,14 +2138,14 @@ static int serial_link_irq_chain(struct uart_8250_port *up)
 	   but its ok for a single UART */
 
 	/* Setup DMA channels */
-	up->dma_tx.dmach = dma_request_channel("uart_tx",
+	up->dma_tx.dmach = lpc313x_dma_request_channel("uart_tx",
 		lpc31xx_dma_tx_interrupt, up);
 	if (up->dma_tx.dmach < 0)
 	{
 		printk(KERN_ERR "serial: error getting TX DMA channel.\n");
 		return -EBUSY;
 	}
-	up->dma_rx.dmach = dma_request_channel("uart_rx",
+	up->dma_rx.dmach = lpc313x_dma_request_channel("uart_rx",
 		lpc31xx_dma_rx_interrupt, up);
 	if (up->dma_rx.dmach < 0)
 	{
@@ -2222,8 +2222,8 @@ static void serial_unlink_irq_chain(struct uart_8250_port *up)
 	dma_set_irq_mask(up->dma_rx.dmach, 0, 0);
 	dma_stop_channel(up->dma_tx.dmach);
 	dma_stop_channel(up->dma_rx.dmach);
-	dma_release_channel(up->dma_tx.dmach);
-	dma_release_channel(up->dma_rx.dmach);
+	lpc313x_dma_release_channel(up->dma_tx.dmach);
+	lpc313x_dma_release_channel(up->dma_rx.dmach);
 
 	dma_unmap_single(up->port.dev, up->dma_tx.dma_buff_p, UART_XMIT_SIZE,
 		DMA_TO_DEVICE);
@@ -23,6 +23,13 @@
  * (hardware chip selects are not supported due to timing constraints), clock
  * speeds up to 45MBps, data widths from 4 to 16 bits, DMA support, and full
  * power management.
+ *
+ * Messages that can be done entirely with DMA are run by an interrupt driven
+ * message pump: the next transfer is started from the RX DMA completion
+ * interrupt, and its DMA setup is built while the previous transfer is still
+ * on the wire. Chip select changes are done from the interrupt and transfer
+ * delays use a hrtimer, so such messages never wait for the workqueue. Other
+ * messages still go through the workqueue.
  */
 
 #include <linux/init.h>
@@ -31,6 +38,7 @@
 #include <linux/interrupt.h>
 #include <linux/platform_device.h>
 #include <linux/sched.h>
+#include <linux/hrtimer.h>
 #include <linux/spinlock.h>
 #include <linux/workqueue.h>
 #include <linux/spi/spi.h>
@@ -47,6 +55,20 @@
 #define spi_readl(reg) __raw_readl(&SPI_##reg)
 #define spi_writel(reg,value) __raw_writel((value),&SPI_##reg)
 
+/* Size of the dummy TX and RX DMA buffers, and the largest DMA transfer */
+#define SPI_DMA_BUF_SIZE 4096
+
+/*
+ * DMA setup of a single transfer. The message pump keeps two of these, one
+ * for the transfer on the wire and one prebuilt for the transfer after it.
+ */
+struct lpc313x_spi_dma
+{
+	dma_setup_t rx, tx;
+	u32 srcmapped, destmapped;
+	u32 len;
+};
+
 struct lpc313xspi
 {
 	spinlock_t lock;
@@ -75,6 +97,18 @@ struct lpc313xspi
 
 	/* DMA event flah */
 	volatile int rxdmaevent;
+
+	/* A message is being processed, by the pump or the workqueue */
+	int busy;
+
+	/* Interrupt driven message pump state */
+	struct spi_message *pump_msg;
+	struct spi_transfer *pump_xfer;
+	struct lpc313x_spi_dma pump_dma[2];
+	int pump_cur;
+	int pump_cs_change;
+	int pump_status;
+	struct hrtimer pump_timer;
 };
 
 /*
@@ -183,6 +217,39 @@ static void lpc313x_set_cs_clock(struct lpc313xspi *spidat, u8 cs, u32 clockrate
 	}
 }
 
+/*
+ * Setup clock, data width and SPI mode for a transfer and enable the SPI
+ */
+static void lpc313x_spi_setup_xfer(struct lpc313xspi *spidat, struct spi_device *spi,
+				   u32 speed_hz, u8 bits_per_word)
+{
+	u32 tmp;
+
+	/* Setup the appropriate chip select */
+	lpc313x_set_cs_clock(spidat, spi->chip_select, speed_hz);
+	lpc313x_set_cs_data_bits(spidat, spi->chip_select, bits_per_word);
+
+	/* Setup timing and levels before initial chip select */
+	tmp = spi_readl(SLV_SET2_REG(0)) & ~(SPI_SLV2_SPO | SPI_SLV2_SPH);
+	if (spidat->psppcfg->spics_cfg[spi->chip_select].spi_spo != 0)
+	{
+		/* Clock high between transfers */
+		tmp |= SPI_SLV2_SPO;
+	}
+	if (spidat->psppcfg->spics_cfg[spi->chip_select].spi_sph != 0)
+	{
+		/* Data captured on 2nd clock edge */
+		tmp |= SPI_SLV2_SPH;
+	}
+	spi_writel(SLV_SET2_REG(0), tmp);
+
+	lpc313x_int_clr(spidat, SPI_ALL_INTS);  /****fix from JPP*** */
+
+	/* Make sure FIFO is flushed, clear pending interrupts, DMA
+	   initially disabled, and then enable SPI interface */
+	spi_writel(CONFIG_REG, (spi_readl(CONFIG_REG) | SPI_CFG_ENABLE));
+}
+
 /*
  * Setup the initial state of the SPI interface
  */
@@ -265,6 +332,9 @@ static int lpc313x_spi_setup(struct spi_device *spi)
 	return 0;
 }
 
+static void lpc313x_pump_msg_done(struct lpc313xspi *spidat, int status);
+static void lpc313x_pump_xfer_done(struct lpc313xspi *spidat);
+
 /*
  * Handle the SPI interrupt
  */
@@ -274,6 +344,18 @@ static irqreturn_t lpc313x_spi_irq(int irq, void *dev_id)
 
 	/* Disable interrupts for now, do not clear the interrupt states */
 	lpc313x_int_dis(spidat, SPI_ALL_INTS);
+
+	spin_lock(&spidat->lock);
+	if (spidat->pump_msg)
+	{
+		/* RX FIFO overflow, the RX DMA will never complete */
+		dev_err(&spidat->pdev->dev, "RX FIFO overflow.\n");
+		lpc313x_pump_msg_done(spidat, -EIO);
+		spin_unlock(&spidat->lock);
+		return IRQ_HANDLED;
+	}
+	spin_unlock(&spidat->lock);
+
 	spidat->rxdmaevent = 1;
 
 	wake_up(&spidat->waitq);
@@ -298,12 +380,23 @@ static void lpc313x_dma_tx_spi_irq(int ch, dma_irq_type_t dtype, void *handle)
 static void lpc313x_dma_rx_spi_irq(int ch, dma_irq_type_t dtype, void *handle)
 {
 	struct lpc313xspi *spidat = (struct lpc313xspi *) handle;
+	unsigned long flags;
 
 	if (dtype == DMA_IRQ_FINISHED)
 	{
 		/* Disable interrupts for now */
 		dma_set_irq_mask(spidat->rx_dma_ch, 1, 1);
 
+		spin_lock_irqsave(&spidat->lock, flags);
+		if (spidat->pump_msg)
+		{
+			/* Pump transfer, start the next one from here */
+			lpc313x_pump_xfer_done(spidat);
+			spin_unlock_irqrestore(&spidat->lock, flags);
+			return;
+		}
+		spin_unlock_irqrestore(&spidat->lock, flags);
+
 		/* Flag event and wakeup */
 		spidat->rxdmaevent = 1;
 		wake_up(&spidat->waitq);
@@ -317,36 +410,52 @@ static void lpc313x_dma_rx_spi_irq(int ch, dma_irq_type_t dtype, void *handle)
 }
 
 /*
- * Handle a DMA transfer
+ * Unmap the buffers of a DMA transfer setup
  */
-static int lpc313x_spi_dma_transfer(struct lpc313xspi *spidat, struct spi_transfer *t,
-					u8 bits_per_word, int dmamapped)
+static void lpc313x_spi_dma_unmap(struct lpc313xspi *spidat, struct lpc313x_spi_dma *d)
 {
-	dma_setup_t dmarx, dmatx;
-	int status = 0;
-	u32 src, dest, srcmapped = 0, destmapped = 0;
 	struct device *dev = &spidat->pdev->dev;
 
-	/* Set the FIFO trip level to the transfer size */
-	spi_writel(INT_TRSH_REG, (SPI_INT_TSHLD_TX(16) |
-		SPI_INT_TSHLD_RX(1)));
-	spi_writel(DMA_SET_REG, (SPI_DMA_TX_EN | SPI_DMA_RX_EN));
-	lpc313x_int_dis(spidat, SPI_ALL_INTS);
-	lpc313x_int_en(spidat, SPI_OVR_INT);
+	if (d->srcmapped != 0)
+	{
+		dma_unmap_single(dev, d->srcmapped, d->len, DMA_TO_DEVICE);
+	}
+	if (d->destmapped != 0)
+	{
+		dma_unmap_single(dev, d->destmapped, d->len, DMA_FROM_DEVICE);
+	}
+
+	d->srcmapped = d->destmapped = 0;
+	d->len = 0;
+}
+
+/*
+ * Build the DMA setup for a transfer, mapping the buffers if needed. This
+ * does not touch the hardware, so it can be done while another transfer
+ * is in progress.
+ */
+static int lpc313x_spi_dma_prep(struct lpc313xspi *spidat, struct spi_transfer *t,
+				u8 bits_per_word, int dmamapped, struct lpc313x_spi_dma *d)
+{
+	u32 src, dest;
+	struct device *dev = &spidat->pdev->dev;
+
+	d->srcmapped = d->destmapped = 0;
+	d->len = t->len;
 
 	/* Setup transfer */
 	if (bits_per_word > 8)
 	{
-		dmarx.cfg = DMA_CFG_TX_HWORD | DMA_CFG_RD_SLV_NR(DMA_SLV_SPI_RX) |
+		d->rx.cfg = DMA_CFG_TX_HWORD | DMA_CFG_RD_SLV_NR(DMA_SLV_SPI_RX) |
 			DMA_CFG_WR_SLV_NR(0);
-		dmatx.cfg = DMA_CFG_TX_HWORD | DMA_CFG_RD_SLV_NR(0) |
+		d->tx.cfg = DMA_CFG_TX_HWORD | DMA_CFG_RD_SLV_NR(0) |
 			DMA_CFG_WR_SLV_NR(DMA_SLV_SPI_TX);
 	}
 	else
 	{
-		dmarx.cfg = DMA_CFG_TX_BYTE | DMA_CFG_RD_SLV_NR(DMA_SLV_SPI_RX) |
+		d->rx.cfg = DMA_CFG_TX_BYTE | DMA_CFG_RD_SLV_NR(DMA_SLV_SPI_RX) |
 			DMA_CFG_WR_SLV_NR(0);
-		dmatx.cfg = DMA_CFG_TX_BYTE | DMA_CFG_RD_SLV_NR(0) |
+		d->tx.cfg = DMA_CFG_TX_BYTE | DMA_CFG_RD_SLV_NR(0) |
 			DMA_CFG_WR_SLV_NR(DMA_SLV_SPI_TX);
 	}
 
@@ -359,17 +468,16 @@ static int lpc313x_spi_dma_transfer(struct lpc313xspi *spidat, struct spi_transf
 		if ((src == 0) && (dest == 0))
 		{
 			/* DMA mapped flag set, but not mapped */
-			status = -ENOMEM;
-			goto exit;
+			return -ENOMEM;
 		}
 
-		/* At least one of the DMA buffers are already mapped */
+		/* At least one of the DMA buffers are already mapped, use
+		   the temporary buffer for the other one */
 		if (src == 0)
 		{
-			/* Use temporary buffer for TX */
 			src = spidat->dma_tx_base_p;
 		}
-		else
+		if (dest == 0)
 		{
 			dest = spidat->dma_rx_base_p;
 		}
@@ -389,11 +497,10 @@ static int lpc313x_spi_dma_transfer(struct lpc313xspi *spidat, struct spi_transf
 				t->len, DMA_TO_DEVICE);
 			if (dma_mapping_error(dev, src))
 			{
-				status = -ENOMEM;
-				goto exit;
+				return -ENOMEM;
 			}
 
-			srcmapped = src;
+			d->srcmapped = src;
 		}
 
 		/* Does RX buffer need to be DMA mapped */
@@ -409,25 +516,40 @@ static int lpc313x_spi_dma_transfer(struct lpc313xspi *spidat, struct spi_transf
 				t->len, DMA_FROM_DEVICE);
 			if (dma_mapping_error(dev, dest))
 			{
-				status = -ENOMEM;
-				goto exit;
+				lpc313x_spi_dma_unmap(spidat, d);
+				return -ENOMEM;
 			}
 
-			destmapped = dest;
+			d->destmapped = dest;
 		}
 	}
 
 	/* Setup transfer data for DMA */
-	dmarx.trans_length = (t->len - 1);
-	dmarx.src_address = (SPI_PHYS + 0x0C);
-	dmarx.dest_address = dest;
-	dmatx.trans_length = (t->len - 1);
-	dmatx.src_address = src;
-	dmatx.dest_address = (SPI_PHYS + 0x0C);
+	d->rx.trans_length = (t->len - 1);
+	d->rx.src_address = (SPI_PHYS + 0x0C);
+	d->rx.dest_address = dest;
+	d->tx.trans_length = (t->len - 1);
+	d->tx.src_address = src;
+	d->tx.dest_address = (SPI_PHYS + 0x0C);
+
+	return 0;
+}
+
+/*
+ * Program the DMA channels from a prepared setup and start them
+ */
+static void lpc313x_spi_dma_start(struct lpc313xspi *spidat, struct lpc313x_spi_dma *d)
+{
+	/* Set the FIFO trip level to the transfer size */
+	spi_writel(INT_TRSH_REG, (SPI_INT_TSHLD_TX(16) |
+		SPI_INT_TSHLD_RX(1)));
+	spi_writel(DMA_SET_REG, (SPI_DMA_TX_EN | SPI_DMA_RX_EN));
+	lpc313x_int_dis(spidat, SPI_ALL_INTS);
+	lpc313x_int_en(spidat, SPI_OVR_INT);
 
 	/* Setup the channels */
-	dma_prog_channel(spidat->rx_dma_ch, &dmarx);
-	dma_prog_channel(spidat->tx_dma_ch, &dmatx);
+	dma_prog_channel(spidat->rx_dma_ch, &d->rx);
+	dma_prog_channel(spidat->tx_dma_ch, &d->tx);
 
 	/* Make sure the completion interrupt is enabled for RX, TX disabled */
 	dma_set_irq_mask(spidat->rx_dma_ch, 1, 0);
@@ -437,25 +559,268 @@ static int lpc313x_spi_dma_transfer(struct lpc313xspi *spidat, struct spi_transf
 	spidat->rxdmaevent = 0;
 	dma_start_channel(spidat->rx_dma_ch);
 	dma_start_channel(spidat->tx_dma_ch);
+}
+
+/*
+ * Handle a DMA transfer
+ */
+static int lpc313x_spi_dma_transfer(struct lpc313xspi *spidat, struct spi_transfer *t,
+					u8 bits_per_word, int dmamapped)
+{
+	struct lpc313x_spi_dma d;
+	int status;
 
-	/* Wait for DMA to complete */
-	wait_event_interruptible(spidat->waitq, spidat->rxdmaevent);
+	status = lpc313x_spi_dma_prep(spidat, t, bits_per_word, dmamapped, &d);
+	if (status == 0)
+	{
+		lpc313x_spi_dma_start(spidat, &d);
+
+		/* Wait for DMA to complete */
+		wait_event_interruptible(spidat->waitq, spidat->rxdmaevent);
+	}
 
-exit:
 	dma_stop_channel(spidat->tx_dma_ch);
 	dma_stop_channel(spidat->rx_dma_ch);
 
 	/* Unmap buffers */
-	if (srcmapped != 0)
+	if (status == 0)
 	{
-		dma_unmap_single(dev, srcmapped, t->len, DMA_TO_DEVICE);
+		lpc313x_spi_dma_unmap(spidat, &d);
 	}
-	if (destmapped != 0)
+
+	return status;
+}
+
+/*
+ * Returns the transfer after t in message m, or NULL if t is the last one
+ */
+static inline struct spi_transfer *lpc313x_next_xfer(struct spi_message *m,
+						     struct spi_transfer *t)
+{
+	if (t->transfer_list.next == &m->transfers)
+		return NULL;
+
+	return list_entry(t->transfer_list.next, struct spi_transfer,
+		transfer_list);
+}
+
+static inline u8 lpc313x_xfer_bits(struct spi_device *spi, struct spi_transfer *t)
+{
+	u8 bits_per_word = t->bits_per_word ? : spi->bits_per_word;
+
+	return bits_per_word ? : 8;
+}
+
+/*
+ * Check that every transfer of a message can be done with DMA and prepare
+ * the DMA setup of the first one. Returns 0 if the pump can run the message.
+ */
+static int lpc313x_pump_prep_msg(struct lpc313xspi *spidat, struct spi_message *m)
+{
+	struct spi_transfer *t;
+
+	list_for_each_entry (t, &m->transfers, transfer_list)
 	{
-		dma_unmap_single(dev, destmapped, t->len, DMA_FROM_DEVICE);
+		if ((t->len == 0) || (t->len > SPI_DMA_BUF_SIZE))
+		{
+			return -EINVAL;
+		}
 	}
 
-	return status;
+	t = list_first_entry(&m->transfers, struct spi_transfer, transfer_list);
+	return lpc313x_spi_dma_prep(spidat, t, lpc313x_xfer_bits(m->spi, t),
+		m->is_dma_mapped, &spidat->pump_dma[0]);
+}
+
+/*
+ * Start the pump transfer whose DMA setup is in the current slot, then build
+ * the DMA setup of the following transfer while this one runs. Called with
+ * the lock held.
+ */
+static void lpc313x_pump_start_xfer(struct lpc313xspi *spidat)
+{
+	struct spi_message *m = spidat->pump_msg;
+	struct spi_device *spi = m->spi;
+	struct spi_transfer *t = spidat->pump_xfer, *next;
+
+	lpc313x_spi_setup_xfer(spidat, spi, t->speed_hz ? : spi->max_speed_hz,
+		lpc313x_xfer_bits(spi, t));
+
+	if (spidat->pump_cs_change)
+	{
+		/* Force CS assertion */
+		spi_force_cs(spidat, spi->chip_select, 0);
+	}
+
+	lpc313x_spi_dma_start(spidat, &spidat->pump_dma[spidat->pump_cur]);
+
+	next = lpc313x_next_xfer(m, t);
+	if (next)
+	{
+		spidat->pump_status = lpc313x_spi_dma_prep(spidat, next,
+			lpc313x_xfer_bits(spi, next), m->is_dma_mapped,
+			&spidat->pump_dma[!spidat->pump_cur]);
+	}
+}
+
+static void lpc313x_spi_next_msg(struct lpc313xspi *spidat);
+
+/*
+ * Finish the message run by the pump and start the next one. Called with
+ * the lock held and interrupts disabled.
+ */
+static void lpc313x_pump_msg_done(struct lpc313xspi *spidat, int status)
+{
+	struct spi_message *m = spidat->pump_msg;
+
+	dma_stop_channel(spidat->tx_dma_ch);
+	dma_stop_channel(spidat->rx_dma_ch);
+	lpc313x_spi_dma_unmap(spidat, &spidat->pump_dma[0]);
+	lpc313x_spi_dma_unmap(spidat, &spidat->pump_dma[1]);
+
+	if (!(status == 0 && spidat->pump_xfer->cs_change))
+	{
+		spi_force_cs(spidat, m->spi->chip_select, 1);
+	}
+
+	/* Disable SPI, stop SPI clock to save power */
+	spi_writel(CONFIG_REG, (spi_readl(CONFIG_REG) & ~SPI_CFG_ENABLE));
+	lpc313x_int_dis(spidat, SPI_ALL_INTS);
+	disable_irq_nosync(spidat->irq);
+	lpc313x_spi_clks_disen(spidat, 0);
+
+	spidat->pump_msg = NULL;
+
+	/* The completion callback may queue another message */
+	spin_unlock(&spidat->lock);
+	m->status = status;
+	m->complete(m->context);
+	spin_lock(&spidat->lock);
+
+	lpc313x_spi_next_msg(spidat);
+}
+
+/*
+ * Move the pump on to the next transfer once the delay of the previous
+ * one has passed. Called with the lock held and interrupts disabled.
+ */
+static void lpc313x_pump_next_xfer(struct lpc313xspi *spidat)
+{
+	struct spi_message *m = spidat->pump_msg;
+	struct spi_transfer *t = spidat->pump_xfer;
+	struct spi_transfer *next = lpc313x_next_xfer(m, t);
+
+	if ((next == NULL) || (spidat->pump_status != 0))
+	{
+		lpc313x_pump_msg_done(spidat, spidat->pump_status);
+		return;
+	}
+
+	spidat->pump_cs_change = t->cs_change;
+	if (t->cs_change)
+	{
+		/* Deselect, the next transfer selects again */
+		spi_force_cs(spidat, m->spi->chip_select, 1);
+	}
+
+	spidat->pump_xfer = next;
+	spidat->pump_cur = !spidat->pump_cur;
+	lpc313x_pump_start_xfer(spidat);
+}
+
+/*
+ * A pump transfer has completed. Called from the RX DMA interrupt with the
+ * lock held.
+ */
+static void lpc313x_pump_xfer_done(struct lpc313xspi *spidat)
+{
+	struct spi_transfer *t = spidat->pump_xfer;
+
+	dma_stop_channel(spidat->tx_dma_ch);
+	dma_stop_channel(spidat->rx_dma_ch);
+	lpc313x_spi_dma_unmap(spidat, &spidat->pump_dma[spidat->pump_cur]);
+
+	spidat->pump_msg->actual_length += t->len;
+
+	if (t->delay_usecs)
+	{
+		hrtimer_start(&spidat->pump_timer,
+			ktime_set(0, t->delay_usecs * NSEC_PER_USEC),
+			HRTIMER_MODE_REL);
+		return;
+	}
+
+	lpc313x_pump_next_xfer(spidat);
+}
+
+/*
+ * Transfer delay timer for the pump
+ */
+static enum hrtimer_restart lpc313x_pump_timer(struct hrtimer *timer)
+{
+	struct lpc313xspi *spidat = container_of(timer, struct lpc313xspi,
+		pump_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&spidat->lock, flags);
+	if (spidat->pump_msg)
+	{
+		lpc313x_pump_next_xfer(spidat);
+	}
+	spin_unlock_irqrestore(&spidat->lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Start a message on the pump. The DMA setup of its first transfer is
+ * already in slot 0. Called with the lock held.
+ */
+static void lpc313x_pump_msg_start(struct lpc313xspi *spidat, struct spi_message *m)
+{
+	/* Enable SPI clock and interrupts */
+	lpc313x_spi_clks_disen(spidat, 1);
+	enable_irq(spidat->irq);
+
+	/* Make sure FIFO is flushed */
+	lpc313x_fifo_flush(spidat);
+
+	spidat->pump_msg = m;
+	spidat->pump_xfer = list_first_entry(&m->transfers, struct spi_transfer,
+		transfer_list);
+	spidat->pump_cur = 0;
+	spidat->pump_cs_change = 1;
+	spidat->pump_status = 0;
+
+	lpc313x_pump_start_xfer(spidat);
+}
+
+/*
+ * Start the next queued message once the controller is idle. The pump runs
+ * it directly if it can, otherwise it is left to the workqueue. Called with
+ * the lock held.
+ */
+static void lpc313x_spi_next_msg(struct lpc313xspi *spidat)
+{
+	struct spi_message *m;
+
+	if (list_empty(&spidat->queue))
+	{
+		spidat->busy = 0;
+		return;
+	}
+
+	spidat->busy = 1;
+	m = container_of(spidat->queue.next, struct spi_message, queue);
+	if (lpc313x_pump_prep_msg(spidat, m) == 0)
+	{
+		list_del_init(&m->queue);
+		lpc313x_pump_msg_start(spidat, m);
+	}
+	else
+	{
+		queue_work(spidat->workqueue, &spidat->work);
+	}
 }
 
 /*
@@ -469,7 +834,6 @@ static void lpc313x_work_one(struct lpc313xspi *spidat, struct spi_message *m)
 	unsigned int wsize, cs_change = 1;
 	int status = 0;
 	unsigned long flags;
-	u32 tmp;
 
 	/* Enable SPI clock and interrupts */
 	spin_lock_irqsave(&spidat->lock, flags);
@@ -487,36 +851,13 @@ static void lpc313x_work_one(struct lpc313xspi *spidat, struct spi_message *m)
 		u32 data;
 		unsigned int rlen, tlen = t->len;
 		u32 speed_hz = t->speed_hz ? : spi->max_speed_hz;
-		u8 bits_per_word = t->bits_per_word ? : spi->bits_per_word;
+		u8 bits_per_word = lpc313x_xfer_bits(spi, t);
 
-		/* Bits per word, data transfer size, and transfer counter */
-		bits_per_word = bits_per_word ? : 8;
+		/* Data transfer size and transfer counter */
 		wsize = bits_per_word >> 3;
 		rlen = tlen;
 
-		/* Setup the appropriate chip select */
-		lpc313x_set_cs_clock(spidat, spi->chip_select, speed_hz);
-		lpc313x_set_cs_data_bits(spidat, spi->chip_select, bits_per_word);
- 
-		/* Setup timing and levels before initial chip select */
-		tmp = spi_readl(SLV_SET2_REG(0)) & ~(SPI_SLV2_SPO | SPI_SLV2_SPH);
-		if (spidat->psppcfg->spics_cfg[spi->chip_select].spi_spo != 0)
-		{
-			/* Clock high between transfers */
-			tmp |= SPI_SLV2_SPO;
-		}
-		if (spidat->psppcfg->spics_cfg[spi->chip_select].spi_sph != 0)
-		{
-			/* Data captured on 2nd clock edge */
-			tmp |= SPI_SLV2_SPH;
-		}
-		spi_writel(SLV_SET2_REG(0), tmp);
-
-		lpc313x_int_clr(spidat, SPI_ALL_INTS);  /****fix from JPP*** */
-
-		/* Make sure FIFO is flushed, clear pending interrupts, DMA
-		   initially disabled, and then enable SPI interface */
-		spi_writel(CONFIG_REG, (spi_readl(CONFIG_REG) | SPI_CFG_ENABLE));
+		lpc313x_spi_setup_xfer(spidat, spi, speed_hz, bits_per_word);
 
 		/* Assert selected chip select */
 		if (cs_change)
@@ -649,7 +990,8 @@ exit:
 }
 
 /*
- * Work queue function
+ * Work queue function, runs the message at the head of the queue that the
+ * pump could not take
  */
 static void lpc313x_work(struct work_struct *work)
 {
@@ -658,7 +1000,7 @@ static void lpc313x_work(struct work_struct *work)
 
 	spin_lock_irqsave(&spidat->lock, flags);
 
-	while (!list_empty(&spidat->queue))
+	if (!list_empty(&spidat->queue))
 	{
 		struct spi_message *m;
 
@@ -670,6 +1012,8 @@ static void lpc313x_work(struct work_struct *work)
 		spin_lock_irqsave(&spidat->lock, flags);
 	}
 
+	lpc313x_spi_next_msg(spidat);
+
 	spin_unlock_irqrestore(&spidat->lock, flags);
 }
 
@@ -709,7 +1053,10 @@ static int lpc313x_spi_transfer(struct spi_device *spi, struct spi_message *m)
 
 	spin_lock_irqsave(&spidat->lock, flags);
 	list_add_tail(&m->queue, &spidat->queue);
-	queue_work(spidat->workqueue, &spidat->work);
+	if (!spidat->busy)
+	{
+		lpc313x_spi_next_msg(spidat);
+	}
 	spin_unlock_irqrestore(&spidat->lock, flags);
 
 	return 0;
@@ -773,6 +1120,8 @@ static int __init lpc313x_spi_probe(struct platform_device *pdev)
 	INIT_WORK(&spidat->work, lpc313x_work);
 	INIT_LIST_HEAD(&spidat->queue);
 	init_waitqueue_head(&spidat->waitq);
+	hrtimer_init(&spidat->pump_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	spidat->pump_timer.function = lpc313x_pump_timer;
 	spidat->workqueue = create_singlethread_workqueue(dev_name(master->dev.parent));	//***MOD:Fix from JPP to compile to latest versions of Linux
 	if (!spidat->workqueue)
 	{
@@ -802,7 +1151,7 @@ static int __init lpc313x_spi_probe(struct platform_device *pdev)
 	/* Setup several work DMA buffers for dummy TX and RX data. These buffers just
 	   hold the temporary TX or RX data for the unused half of the transfer and have
 	   a size of 4K (the maximum size of a transfer) */
-	spidat->dma_base_v = (u32) dma_alloc_coherent(&pdev->dev, (4096 << 1),
+	spidat->dma_base_v = (u32) dma_alloc_coherent(&pdev->dev, (SPI_DMA_BUF_SIZE << 1),
 		&dma_handle, GFP_KERNEL);
 	if (spidat->dma_base_v == (u32) NULL)
 	{
@@ -814,11 +1163,11 @@ static int __init lpc313x_spi_probe(struct platform_device *pdev)
 
 	spidat->dma_tx_base_p = (u32) spidat->dma_base_p;
 	spidat->dma_tx_base_v = spidat->dma_base_v;
-	spidat->dma_rx_base_p = (u32) spidat->dma_base_p + 4096;
-	spidat->dma_rx_base_v = spidat->dma_base_v + 4096;
+	spidat->dma_rx_base_p = (u32) spidat->dma_base_p + SPI_DMA_BUF_SIZE;
+	spidat->dma_rx_base_v = spidat->dma_base_v + SPI_DMA_BUF_SIZE;
 
 	/* Fill dummy TX buffer with 0 */
-	memset((void *) spidat->dma_tx_base_v, 0, 4096);
+	memset((void *) spidat->dma_tx_base_v, 0, SPI_DMA_BUF_SIZE);
 
 	/* Initial setup of SPI */
 	spidat->spi_base_clock = cgu_get_clk_freq(CGU_SB_SPI_CLK_ID);
@@ -829,14 +1178,14 @@ static int __init lpc313x_spi_probe(struct platform_device *pdev)
 
 	/* Request RX and TX DMA channels */
 	spidat->tx_dma_ch = spidat->rx_dma_ch = -1;
-	spidat->tx_dma_ch = dma_request_channel("spi_tx", lpc313x_dma_tx_spi_irq, spidat);
+	spidat->tx_dma_ch = lpc313x_dma_request_channel("spi_tx", lpc313x_dma_tx_spi_irq, spidat);
 	if (spidat->tx_dma_ch < 0)
 	{
 		dev_err(&pdev->dev, "error getting TX DMA channel.\n");
 		ret = -EBUSY;
 		goto errout4;
 	}
-	spidat->rx_dma_ch = dma_request_channel("spi_rx", lpc313x_dma_rx_spi_irq, spidat);
+	spidat->rx_dma_ch = lpc313x_dma_request_channel("spi_rx", lpc313x_dma_rx_spi_irq, spidat);
 	if (spidat->rx_dma_ch < 0)
 	{
 		dev_err(&pdev->dev, "error getting RX DMA channel.\n");
@@ -856,10 +1205,10 @@ static int __init lpc313x_spi_probe(struct platform_device *pdev)
 
 errout4:
 	if (spidat->tx_dma_ch != -1)
-		dma_release_channel(spidat->tx_dma_ch);
+		lpc313x_dma_release_channel(spidat->tx_dma_ch);
 	if (spidat->rx_dma_ch != -1)
-		dma_release_channel(spidat->rx_dma_ch);
-	dma_free_coherent(&pdev->dev, (4096 << 1), (void *) spidat->dma_base_v,
+		lpc313x_dma_release_channel(spidat->rx_dma_ch);
+	dma_free_coherent(&pdev->dev, (SPI_DMA_BUF_SIZE << 1), (void *) spidat->dma_base_v,
 		spidat->dma_base_p);
 errout3:
 	free_irq(spidat->irq, pdev);
@@ -887,13 +1236,14 @@ static int __devexit lpc313x_spi_remove(struct platform_device *pdev)
 
 	spi_unregister_master(master);
 	platform_set_drvdata(pdev, NULL);
+	hrtimer_cancel(&spidat->pump_timer);
 
 	if (spidat->tx_dma_ch != -1)
-		dma_release_channel(spidat->tx_dma_ch);
+		lpc313x_dma_release_channel(spidat->tx_dma_ch);
 	if (spidat->rx_dma_ch != -1)
-		dma_release_channel(spidat->rx_dma_ch);
+		lpc313x_dma_release_channel(spidat->rx_dma_ch);
 
-	dma_free_coherent(&pdev->dev, (4096 << 1), (void *) spidat->dma_base_v,
+	dma_free_coherent(&pdev->dev, (SPI_DMA_BUF_SIZE << 1), (void *) spidat->dma_base_v,
 		spidat->dma_base_p);
 
 	/* Free resources */
@@ -915,7 +1265,7 @@ static int lpc313x_spi_suspend(struct platform_device *pdev, pm_message_t state)
 	struct lpc313xspi *spidat = spi_master_get_devdata(master);
 
 	/* Check if SPI is idle before we pull off the clock */
-	if (unlikely(!list_empty(&spidat->queue)))
+	if (unlikely(!list_empty(&spidat->queue) || spidat->busy))
 		return 0;
 
 	/* Pull the clocks off */
@@ -0,0 +1,493 @@
+/*
+ * lpc313x_adc.c - LPC313x/LPC315x 10 bit ADC driver
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The four channels can be read one at a time through sysfs (adc_N), or
+ * streamed into the software ring buffer. In ring mode each trigger
+ * starts one scan of the enabled channels from the trigger interrupt;
+ * the scan done interrupt queues the results, along with the trigger
+ * timestamp, into a kfifo. Pushing to the ring is not possible from
+ * interrupt context so a work item moves the queued scans over in
+ * batches, at the latest LPC313X_ADC_FLUSH_MS after the first one.
+ */
+
+#include <linux/platform_device.h>
+#include <linux/interrupt.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/kfifo.h>
+#include <linux/device.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sysfs.h>
+#include <linux/jiffies.h>
+
+#include <mach/hardware.h>
+#include <mach/irqs.h>
+
+#include "../iio.h"
+#include "../sysfs.h"
+#include "../ring_generic.h"
+#include "../ring_sw.h"
+#include "../trigger.h"
+#include "adc.h"
+
+#define LPC313X_ADC_BITS		10
+#define LPC313X_ADC_FIFO_SIZE		8192
+#define LPC313X_ADC_FLUSH_MS		10
+#define LPC313X_ADC_RING_LENGTH		1024
+/* All channels plus an 8 byte aligned timestamp */
+#define LPC313X_ADC_MAX_DATUM		(ADC_MAX_CHANNELS * 2 + sizeof(s64))
+
+/**
+ * struct lpc313x_adc_state - driver instance specific data
+ * @indio_dev:		industrial I/O device structure
+ * @conv_done:		direct mode conversion completion
+ * @flush_work:		moves queued scans from @fifo to the ring
+ * @fifo:		completed scans, filled from the scan done interrupt
+ * @csel:		ADC_CSEL_RES value for the ring mode scan
+ * @d_size:		bytes per datum in ring mode
+ * @scan_ts:		timestamp of the scan in progress
+ * @scan_busy:		a ring mode scan is in progress
+ * @overruns:		scans dropped since the ring was enabled
+ **/
+struct lpc313x_adc_state {
+	struct iio_dev			*indio_dev;
+	struct completion		conv_done;
+	struct delayed_work		flush_work;
+	struct kfifo			fifo;
+	u32				csel;
+	size_t				d_size;
+	s64				scan_ts;
+	bool				scan_busy;
+	unsigned long			overruns;
+};
+
+static void lpc313x_adc_power(int on)
+{
+	if (on) {
+		cgu_clk_en_dis(CGU_SB_ADC_PCLK_ID, 1);
+		cgu_clk_en_dis(CGU_SB_ADC_CLK_ID, 1);
+		SYS_ADC_PD = 0;
+		ADC_CON_REG = ADC_CON_ENABLE;
+		ADC_INT_CLEAR_REG = ADC_INT_SCAN_DONE;
+		ADC_INT_ENABLE_REG = ADC_INT_SCAN_DONE;
+	} else {
+		ADC_INT_ENABLE_REG = 0;
+		ADC_CON_REG = 0;
+		SYS_ADC_PD = 1;
+		cgu_clk_en_dis(CGU_SB_ADC_CLK_ID, 0);
+		cgu_clk_en_dis(CGU_SB_ADC_PCLK_ID, 0);
+	}
+}
+
+static inline void lpc313x_adc_start_scan(u32 csel)
+{
+	ADC_CSEL_RES_REG = csel;
+	ADC_CON_REG = ADC_CON_ENABLE | ADC_CON_START;
+}
+
+static ssize_t lpc313x_adc_read_raw(struct device *dev,
+				    struct device_attribute *attr,
+				    char *buf)
+{
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct lpc313x_adc_state *st = indio_dev->dev_data;
+	struct iio_dev_attr *this_attr = to_iio_dev_attr(attr);
+	int ch = this_attr->address;
+	u32 val;
+	int ret;
+
+	mutex_lock(&indio_dev->mlock);
+	if (iio_ring_enabled(indio_dev)) {
+		ret = -EBUSY;
+		goto error_unlock;
+	}
+
+	lpc313x_adc_power(1);
+	INIT_COMPLETION(st->conv_done);
+	lpc313x_adc_start_scan(ADC_CSEL_RES(ch, LPC313X_ADC_BITS));
+	if (!wait_for_completion_timeout(&st->conv_done, HZ / 10))
+		ret = -ETIMEDOUT;
+	else
+		ret = 0;
+	val = ADC_R_REG(ch) & ADC_R_MASK;
+	lpc313x_adc_power(0);
+	if (ret)
+		goto error_unlock;
+	mutex_unlock(&indio_dev->mlock);
+
+	return sprintf(buf, "%u\n", val);
+
+error_unlock:
+	mutex_unlock(&indio_dev->mlock);
+	return ret;
+}
+
+static IIO_DEV_ATTR_ADC(0, lpc313x_adc_read_raw, 0);
+static IIO_DEV_ATTR_ADC(1, lpc313x_adc_read_raw, 1);
+static IIO_DEV_ATTR_ADC(2, lpc313x_adc_read_raw, 2);
+static IIO_DEV_ATTR_ADC(3, lpc313x_adc_read_raw, 3);
+
+static ssize_t lpc313x_adc_show_name(struct device *dev,
+				     struct device_attribute *attr,
+				     char *buf)
+{
+	return sprintf(buf, "lpc313x_adc\n");
+}
+
+static IIO_DEVICE_ATTR(name, S_IRUGO, lpc313x_adc_show_name, NULL, 0);
+
+static struct attribute *lpc313x_adc_attributes[] = {
+	&iio_dev_attr_adc_0.dev_attr.attr,
+	&iio_dev_attr_adc_1.dev_attr.attr,
+	&iio_dev_attr_adc_2.dev_attr.attr,
+	&iio_dev_attr_adc_3.dev_attr.attr,
+	&iio_dev_attr_name.dev_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group lpc313x_adc_attribute_group = {
+	.attrs = lpc313x_adc_attributes,
+};
+
+static IIO_SCAN_EL_C(adc_0, 0, IIO_UNSIGNED(LPC313X_ADC_BITS), 0, NULL);
+static IIO_SCAN_EL_C(adc_1, 1, IIO_UNSIGNED(LPC313X_ADC_BITS), 1, NULL);
+static IIO_SCAN_EL_C(adc_2, 2, IIO_UNSIGNED(LPC313X_ADC_BITS), 2, NULL);
+static IIO_SCAN_EL_C(adc_3, 3, IIO_UNSIGNED(LPC313X_ADC_BITS), 3, NULL);
+static IIO_SCAN_EL_TIMESTAMP;
+
+static struct attribute *lpc313x_adc_scan_el_attrs[] = {
+	&iio_scan_el_adc_0.dev_attr.attr,
+	&iio_scan_el_adc_1.dev_attr.attr,
+	&iio_scan_el_adc_2.dev_attr.attr,
+	&iio_scan_el_adc_3.dev_attr.attr,
+	&iio_scan_el_timestamp.dev_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lpc313x_adc_scan_el_group = {
+	.attrs = lpc313x_adc_scan_el_attrs,
+	.name = "scan_elements",
+};
+
+/* Caller makes sure nothing else pulls from the fifo */
+static void lpc313x_adc_flush(struct lpc313x_adc_state *st)
+{
+	struct iio_dev *indio_dev = st->indio_dev;
+	struct iio_ring_buffer *ring = indio_dev->ring;
+	u8 datum[LPC313X_ADC_MAX_DATUM] __aligned(8);
+	s64 time_ns;
+
+	while (kfifo_len(&st->fifo) >= st->d_size) {
+		if (kfifo_out(&st->fifo, datum, st->d_size) != st->d_size)
+			break;
+		if (indio_dev->scan_timestamp)
+			memcpy(&time_ns, datum + st->d_size - sizeof(s64),
+			       sizeof(time_ns));
+		else
+			time_ns = iio_get_time_ns();
+		ring->access.store_to(ring, datum, time_ns);
+	}
+}
+
+static void lpc313x_adc_flush_work(struct work_struct *work_s)
+{
+	struct lpc313x_adc_state *st = container_of(work_s,
+						    struct lpc313x_adc_state,
+						    flush_work.work);
+	lpc313x_adc_flush(st);
+}
+
+/**
+ * lpc313x_adc_poll_func_th() start a scan on a trigger
+ *
+ * Runs in the trigger's interrupt, so the conversion starts right away
+ * and the trigger timestamp describes when it was sampled.
+ **/
+static void lpc313x_adc_poll_func_th(struct iio_dev *indio_dev)
+{
+	struct lpc313x_adc_state *st = indio_dev->dev_data;
+
+	/* The trigger outran the ADC, drop this one */
+	if (st->scan_busy) {
+		st->overruns++;
+		iio_trigger_notify_done(indio_dev->trig);
+		return;
+	}
+	st->scan_busy = true;
+	st->scan_ts = indio_dev->trig->timestamp;
+	lpc313x_adc_start_scan(st->csel);
+}
+
+/* Queue the results of a finished ring mode scan */
+static void lpc313x_adc_push_scan(struct lpc313x_adc_state *st)
+{
+	struct iio_dev *indio_dev = st->indio_dev;
+	u8 datum[LPC313X_ADC_MAX_DATUM] __aligned(8);
+	u16 *data = (u16 *)datum;
+	int ch, i = 0;
+
+	for (ch = 0; ch < ADC_MAX_CHANNELS; ch++)
+		if (indio_dev->scan_mask & (1 << ch))
+			data[i++] = ADC_R_REG(ch) & ADC_R_MASK;
+	if (indio_dev->scan_timestamp)
+		memcpy(datum + st->d_size - sizeof(s64), &st->scan_ts,
+		       sizeof(st->scan_ts));
+
+	if (kfifo_avail(&st->fifo) >= st->d_size)
+		kfifo_in(&st->fifo, datum, st->d_size);
+	else
+		st->overruns++;
+
+	/* No-op while a flush is already pending, this batches the scans */
+	schedule_delayed_work(&st->flush_work,
+			      msecs_to_jiffies(LPC313X_ADC_FLUSH_MS));
+}
+
+static irqreturn_t lpc313x_adc_interrupt(int irq, void *private)
+{
+	struct lpc313x_adc_state *st = private;
+	struct iio_dev *indio_dev = st->indio_dev;
+
+	if (!(ADC_INT_STATUS_REG & ADC_INT_SCAN_DONE))
+		return IRQ_NONE;
+	ADC_INT_CLEAR_REG = ADC_INT_SCAN_DONE;
+	ADC_CON_REG = ADC_CON_ENABLE;
+
+	if (st->scan_busy) {
+		lpc313x_adc_push_scan(st);
+		st->scan_busy = false;
+		iio_trigger_notify_done(indio_dev->trig);
+	} else
+		complete(&st->conv_done);
+
+	return IRQ_HANDLED;
+}
+
+static int lpc313x_adc_ring_preenable(struct iio_dev *indio_dev)
+{
+	struct lpc313x_adc_state *st = indio_dev->dev_data;
+	size_t d_size;
+	int ch;
+
+	/* A timestamp on its own needs no conversion, not worth a scan */
+	if (!indio_dev->scan_count)
+		return -EINVAL;
+
+	st->csel = 0;
+	for (ch = 0; ch < ADC_MAX_CHANNELS; ch++)
+		if (indio_dev->scan_mask & (1 << ch))
+			st->csel |= ADC_CSEL_RES(ch, LPC313X_ADC_BITS);
+
+	d_size = indio_dev->scan_count * sizeof(u16);
+	if (indio_dev->scan_timestamp)
+		d_size = ALIGN(d_size, sizeof(s64)) + sizeof(s64);
+	st->d_size = d_size;
+	if (indio_dev->ring->access.set_bpd)
+		indio_dev->ring->access.set_bpd(indio_dev->ring, d_size);
+
+	kfifo_reset(&st->fifo);
+	st->scan_busy = false;
+	st->overruns = 0;
+
+	return 0;
+}
+
+static int lpc313x_adc_ring_postenable(struct iio_dev *indio_dev)
+{
+	int ret;
+
+	lpc313x_adc_power(1);
+	ret = indio_dev->trig
+		? iio_trigger_attach_poll_func(indio_dev->trig,
+					       indio_dev->pollfunc)
+		: 0;
+	if (ret)
+		lpc313x_adc_power(0);
+
+	return ret;
+}
+
+static int lpc313x_adc_ring_predisable(struct iio_dev *indio_dev)
+{
+	struct lpc313x_adc_state *st = indio_dev->dev_data;
+	int ret;
+
+	ret = indio_dev->trig
+		? iio_trigger_dettach_poll_func(indio_dev->trig,
+						indio_dev->pollfunc)
+		: 0;
+
+	/* Abandon a scan still in flight and push out what is queued */
+	lpc313x_adc_power(0);
+	synchronize_irq(IRQ_ADC);
+	if (st->scan_busy) {
+		st->scan_busy = false;
+		iio_trigger_notify_done(indio_dev->trig);
+	}
+	cancel_delayed_work_sync(&st->flush_work);
+	lpc313x_adc_flush(st);
+
+	if (st->overruns)
+		dev_warn(&indio_dev->dev, "%lu scans dropped\n", st->overruns);
+
+	return ret;
+}
+
+static int lpc313x_adc_configure_ring(struct iio_dev *indio_dev)
+{
+	struct iio_ring_buffer *ring;
+	int ch;
+
+	/* Default to all channels with timestamps */
+	for (ch = 0; ch < ADC_MAX_CHANNELS; ch++)
+		iio_scan_mask_set(indio_dev, ch);
+	indio_dev->scan_timestamp = true;
+	indio_dev->scan_el_attrs = &lpc313x_adc_scan_el_group;
+
+	ring = iio_sw_rb_allocate(indio_dev);
+	if (!ring)
+		return -ENOMEM;
+	indio_dev->ring = ring;
+	/* Effectively select the ring buffer implementation */
+	iio_ring_sw_register_funcs(&ring->access);
+	ring->preenable = &lpc313x_adc_ring_preenable;
+	ring->postenable = &lpc313x_adc_ring_postenable;
+	ring->predisable = &lpc313x_adc_ring_predisable;
+	ring->owner = THIS_MODULE;
+	if (ring->access.set_length)
+		ring->access.set_length(ring, LPC313X_ADC_RING_LENGTH);
+
+	indio_dev->pollfunc = kzalloc(sizeof(*indio_dev->pollfunc), GFP_KERNEL);
+	if (indio_dev->pollfunc == NULL) {
+		iio_sw_rb_free(ring);
+		return -ENOMEM;
+	}
+	indio_dev->pollfunc->poll_func_immediate = &lpc313x_adc_poll_func_th;
+	indio_dev->pollfunc->private_data = indio_dev;
+	indio_dev->modes |= INDIO_RING_TRIGGERED;
+
+	return 0;
+}
+
+static void lpc313x_adc_unconfigure_ring(struct iio_dev *indio_dev)
+{
+	kfree(indio_dev->pollfunc);
+	iio_sw_rb_free(indio_dev->ring);
+}
+
+static int __devinit lpc313x_adc_probe(struct platform_device *pdev)
+{
+	struct lpc313x_adc_state *st;
+	int ret, regdone = 0;
+
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (st == NULL) {
+		ret = -ENOMEM;
+		goto error_ret;
+	}
+	platform_set_drvdata(pdev, st);
+	init_completion(&st->conv_done);
+	INIT_DELAYED_WORK(&st->flush_work, lpc313x_adc_flush_work);
+
+	ret = kfifo_alloc(&st->fifo, LPC313X_ADC_FIFO_SIZE, GFP_KERNEL);
+	if (ret)
+		goto error_free_st;
+
+	st->indio_dev = iio_allocate_device();
+	if (st->indio_dev == NULL) {
+		ret = -ENOMEM;
+		goto error_free_fifo;
+	}
+	st->indio_dev->dev.parent = &pdev->dev;
+	st->indio_dev->attrs = &lpc313x_adc_attribute_group;
+	st->indio_dev->dev_data = (void *)(st);
+	st->indio_dev->driver_module = THIS_MODULE;
+	st->indio_dev->modes = INDIO_DIRECT_MODE;
+
+	ret = lpc313x_adc_configure_ring(st->indio_dev);
+	if (ret)
+		goto error_free_device;
+
+	/* Left powered down whenever nobody is converting */
+	lpc313x_adc_power(0);
+	ret = request_irq(IRQ_ADC, lpc313x_adc_interrupt, IRQF_DISABLED,
+			  "lpc313x_adc", st);
+	if (ret)
+		goto error_unconfigure_ring;
+
+	ret = iio_device_register(st->indio_dev);
+	if (ret)
+		goto error_free_irq;
+	regdone = 1;
+
+	ret = iio_ring_buffer_register(st->indio_dev->ring);
+	if (ret) {
+		dev_err(&pdev->dev, "failed to initialize the ring\n");
+		goto error_free_irq;
+	}
+
+	return 0;
+
+error_free_irq:
+	free_irq(IRQ_ADC, st);
+error_unconfigure_ring:
+	lpc313x_adc_unconfigure_ring(st->indio_dev);
+error_free_device:
+	if (regdone)
+		iio_device_unregister(st->indio_dev);
+	else
+		iio_free_device(st->indio_dev);
+error_free_fifo:
+	kfifo_free(&st->fifo);
+error_free_st:
+	kfree(st);
+error_ret:
+	return ret;
+}
+
+static int __devexit lpc313x_adc_remove(struct platform_device *pdev)
+{
+	struct lpc313x_adc_state *st = platform_get_drvdata(pdev);
+	struct iio_dev *indio_dev = st->indio_dev;
+
+	iio_ring_buffer_unregister(indio_dev->ring);
+	lpc313x_adc_power(0);
+	free_irq(IRQ_ADC, st);
+	cancel_delayed_work_sync(&st->flush_work);
+	lpc313x_adc_unconfigure_ring(indio_dev);
+	iio_device_unregister(indio_dev);
+	kfifo_free(&st->fifo);
+	kfree(st);
+
+	return 0;
+}
+
+static struct platform_driver lpc313x_adc_driver = {
+	.probe = lpc313x_adc_probe,
+	.remove = __devexit_p(lpc313x_adc_remove),
+	.driver = {
+		.name = "lpc313x-adc",
+		.owner = THIS_MODULE,
+	},
+};
+
+static int __init lpc313x_adc_init(void)
+{
+	return platform_driver_register(&lpc313x_adc_driver);
+}
+
+static void __exit lpc313x_adc_exit(void)
+{
+	platform_driver_unregister(&lpc313x_adc_driver);
+}
+
+module_init(lpc313x_adc_init);
+module_exit(lpc313x_adc_exit);
+
+MODULE_DESCRIPTION("LPC313x/LPC315x 10 bit ADC driver");
+MODULE_LICENSE("GPL v2");
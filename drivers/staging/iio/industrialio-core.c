@@ -349,8 +349,26 @@ int iio_event_chrdev_open(struct inode *inode, struct file *filep)
 	return 0;
 }
 
+/* Lets userspace wait for ring buffer fill events along with other fds */
+static unsigned int iio_event_chrdev_poll(struct file *filep,
+					  struct poll_table_struct *wait)
+{
+	struct iio_event_interface *ev_int = filep->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(filep, &ev_int->wait, wait);
+
+	mutex_lock(&ev_int->event_list_lock);
+	if (!list_empty(&ev_int->det_events.list))
+		mask |= POLLIN | POLLRDNORM;
+	mutex_unlock(&ev_int->event_list_lock);
+
+	return mask;
+}
+
 static const struct file_operations iio_event_chrdev_fileops = {
 	.read =  iio_event_chrdev_read,
+	.poll = iio_event_chrdev_poll,
 	.release = iio_event_chrdev_release,
 	.open = iio_event_chrdev_open,
 	.owner = THIS_MODULE,
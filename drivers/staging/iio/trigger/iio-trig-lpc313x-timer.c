@@ -0,0 +1,244 @@
+/* The industrial I/O LPC313x hardware timer trigger driver
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * Runs TIMER2 in periodic mode and fires the trigger from its interrupt.
+ * The timestamp is taken in the interrupt handler, so consumers that
+ * sample from their immediate poll function get timestamps with only
+ * interrupt latency as jitter.
+ */
+
+#include <linux/platform_device.h>
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include <mach/hardware.h>
+#include <mach/irqs.h>
+
+#include "../iio.h"
+#include "../trigger.h"
+
+#define LPC313X_TMR_TRIG_BASE		TIMER2_PHYS
+#define LPC313X_TMR_TRIG_DEF_FREQ	1000
+
+struct iio_lpc313x_tmr_trigger_info {
+	struct iio_trigger *trig;
+	struct mutex lock;
+	unsigned int frequency;
+	u32 rate;
+	bool enabled;
+};
+
+/* Caller holds trig_info->lock */
+static void iio_trig_lpc313x_tmr_start(struct iio_lpc313x_tmr_trigger_info
+				       *trig_info)
+{
+	TIMER_CONTROL(LPC313X_TMR_TRIG_BASE) = 0;
+	TIMER_LOAD(LPC313X_TMR_TRIG_BASE) = trig_info->rate
+		/ trig_info->frequency;
+	TIMER_CLEAR(LPC313X_TMR_TRIG_BASE) = 0;
+	TIMER_CONTROL(LPC313X_TMR_TRIG_BASE) =
+		TM_CTRL_ENABLE | TM_CTRL_PERIODIC | TM_CTRL_PS1;
+}
+
+static void iio_trig_lpc313x_tmr_stop(void)
+{
+	TIMER_CONTROL(LPC313X_TMR_TRIG_BASE) = 0;
+	TIMER_CLEAR(LPC313X_TMR_TRIG_BASE) = 0;
+}
+
+static int iio_trig_lpc313x_tmr_set_state(struct iio_trigger *trig,
+					  bool state)
+{
+	struct iio_lpc313x_tmr_trigger_info *trig_info = trig->private_data;
+
+	mutex_lock(&trig_info->lock);
+	if (state && !trig_info->enabled) {
+		cgu_clk_en_dis(CGU_SB_TIMER2_PCLK_ID, 1);
+		iio_trig_lpc313x_tmr_start(trig_info);
+	} else if (!state && trig_info->enabled) {
+		iio_trig_lpc313x_tmr_stop();
+		cgu_clk_en_dis(CGU_SB_TIMER2_PCLK_ID, 0);
+	}
+	trig_info->enabled = state;
+	mutex_unlock(&trig_info->lock);
+
+	return 0;
+}
+
+static irqreturn_t iio_trig_lpc313x_tmr_handler(int irq, void *private)
+{
+	struct iio_trigger *trig = private;
+
+	TIMER_CLEAR(LPC313X_TMR_TRIG_BASE) = 0;
+	trig->timestamp = iio_get_time_ns();
+	iio_trigger_poll(trig);
+
+	return IRQ_HANDLED;
+}
+
+static ssize_t iio_trig_lpc313x_tmr_read_freq(struct device *dev,
+					      struct device_attribute *attr,
+					      char *buf)
+{
+	struct iio_trigger *trig = dev_get_drvdata(dev);
+	struct iio_lpc313x_tmr_trigger_info *trig_info = trig->private_data;
+	return sprintf(buf, "%u\n", trig_info->frequency);
+}
+
+static ssize_t iio_trig_lpc313x_tmr_write_freq(struct device *dev,
+					       struct device_attribute *attr,
+					       const char *buf,
+					       size_t len)
+{
+	struct iio_trigger *trig = dev_get_drvdata(dev);
+	struct iio_lpc313x_tmr_trigger_info *trig_info = trig->private_data;
+	unsigned long val;
+	int ret;
+
+	ret = strict_strtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+	/* Keep at least two timer ticks per period */
+	if (val == 0 || val > trig_info->rate / 2)
+		return -EINVAL;
+
+	mutex_lock(&trig_info->lock);
+	trig_info->frequency = val;
+	if (trig_info->enabled)
+		iio_trig_lpc313x_tmr_start(trig_info);
+	mutex_unlock(&trig_info->lock);
+
+	return len;
+}
+
+static ssize_t iio_trig_lpc313x_tmr_read_name(struct device *dev,
+					      struct device_attribute *attr,
+					      char *buf)
+{
+	struct iio_trigger *trig = dev_get_drvdata(dev);
+	return sprintf(buf, "%s\n", trig->name);
+}
+
+static DEVICE_ATTR(name, S_IRUGO,
+		   iio_trig_lpc313x_tmr_read_name,
+		   NULL);
+static DEVICE_ATTR(frequency, S_IRUGO | S_IWUSR,
+		   iio_trig_lpc313x_tmr_read_freq,
+		   iio_trig_lpc313x_tmr_write_freq);
+
+static struct attribute *iio_trig_lpc313x_tmr_attrs[] = {
+	&dev_attr_frequency.attr,
+	&dev_attr_name.attr,
+	NULL,
+};
+static const struct attribute_group iio_trig_lpc313x_tmr_attr_group = {
+	.attrs = iio_trig_lpc313x_tmr_attrs,
+};
+
+static int __devinit iio_trig_lpc313x_tmr_probe(struct platform_device *pdev)
+{
+	struct iio_lpc313x_tmr_trigger_info *trig_info;
+	struct iio_trigger *trig;
+	int ret;
+
+	trig_info = kzalloc(sizeof(*trig_info), GFP_KERNEL);
+	if (!trig_info) {
+		ret = -ENOMEM;
+		goto error_ret;
+	}
+	mutex_init(&trig_info->lock);
+	trig_info->frequency = LPC313X_TMR_TRIG_DEF_FREQ;
+
+	/* The timer runs from its PCLK without prescaling */
+	cgu_clk_en_dis(CGU_SB_TIMER2_PCLK_ID, 1);
+	trig_info->rate = cgu_get_clk_freq(CGU_SB_TIMER2_PCLK_ID);
+	iio_trig_lpc313x_tmr_stop();
+	cgu_clk_en_dis(CGU_SB_TIMER2_PCLK_ID, 0);
+
+	trig = iio_allocate_trigger();
+	if (!trig) {
+		ret = -ENOMEM;
+		goto error_free_trig_info;
+	}
+	trig_info->trig = trig;
+	trig->private_data = trig_info;
+	trig->owner = THIS_MODULE;
+	trig->set_trigger_state = &iio_trig_lpc313x_tmr_set_state;
+	trig->control_attrs = &iio_trig_lpc313x_tmr_attr_group;
+	trig->dev.parent = &pdev->dev;
+	trig->name = kmalloc(IIO_TRIGGER_NAME_LENGTH, GFP_KERNEL);
+	if (trig->name == NULL) {
+		ret = -ENOMEM;
+		goto error_free_trigger;
+	}
+	snprintf((char *)trig->name, IIO_TRIGGER_NAME_LENGTH,
+		 "lpc313x_timer2");
+
+	ret = request_irq(IRQ_TIMER2, iio_trig_lpc313x_tmr_handler,
+			  IRQF_DISABLED, "iio_lpc313x_timer", trig);
+	if (ret)
+		goto error_free_name;
+
+	ret = iio_trigger_register(trig);
+	if (ret)
+		goto error_free_irq;
+
+	platform_set_drvdata(pdev, trig_info);
+	return 0;
+
+error_free_irq:
+	free_irq(IRQ_TIMER2, trig);
+error_free_name:
+	kfree(trig->name);
+error_free_trigger:
+	iio_free_trigger(trig);
+error_free_trig_info:
+	kfree(trig_info);
+error_ret:
+	return ret;
+}
+
+static int __devexit iio_trig_lpc313x_tmr_remove(struct platform_device *pdev)
+{
+	struct iio_lpc313x_tmr_trigger_info *trig_info
+		= platform_get_drvdata(pdev);
+	struct iio_trigger *trig = trig_info->trig;
+	const char *name = trig->name;
+
+	iio_trig_lpc313x_tmr_set_state(trig, false);
+	free_irq(IRQ_TIMER2, trig);
+	/* Drops the last reference, trig is gone afterwards */
+	iio_trigger_unregister(trig);
+	kfree(name);
+	kfree(trig_info);
+
+	return 0;
+}
+
+static struct platform_driver iio_trig_lpc313x_tmr_driver = {
+	.probe = iio_trig_lpc313x_tmr_probe,
+	.remove = __devexit_p(iio_trig_lpc313x_tmr_remove),
+	.driver = {
+		.name = "iio_lpc313x_timer_trigger",
+		.owner = THIS_MODULE,
+	},
+};
+
+static int __init iio_trig_lpc313x_tmr_init(void)
+{
+	return platform_driver_register(&iio_trig_lpc313x_tmr_driver);
+}
+
+static void __exit iio_trig_lpc313x_tmr_exit(void)
+{
+	platform_driver_unregister(&iio_trig_lpc313x_tmr_driver);
+}
+
+module_init(iio_trig_lpc313x_tmr_init);
+module_exit(iio_trig_lpc313x_tmr_exit);
+MODULE_DESCRIPTION("LPC313x hardware timer trigger for the iio subsystem");
+MODULE_LICENSE("GPL v2");
@@ -280,6 +280,7 @@
 #include <linux/kthread.h>
 #include <linux/limits.h>
 #include <linux/rwsem.h>
+#include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
@@ -302,7 +303,6 @@ static const char fsg_string_interface[] = "Mass Storage";
 
 
 #define FSG_NO_INTR_EP 1
-#define FSG_BUFFHD_STATIC_BUFFER 1
 #define FSG_NO_DEVICE_STRINGS    1
 #define FSG_NO_OTG               1
 #define FSG_NO_INTR_EP           1
@@ -334,7 +334,8 @@ struct fsg_common {
 
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
-	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
+	struct fsg_buffhd	*buffhds;
+	u32			buflen;		/* READ/WRITE data per buffer */
 
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
@@ -543,6 +544,9 @@ static void bulk_in_complete(struct usb_ep *ep, struct usb_request *req)
 	if (req->status == -ECONNRESET)		/* Request was cancelled */
 		usb_ep_fifo_flush(ep);
 
+	/* The next use of the request is linear unless set up otherwise */
+	req->num_sgs = 0;
+
 	/* Hold the lock while we update the request and buffer states */
 	smp_wmb();
 	spin_lock(&common->lock);
@@ -557,7 +561,8 @@ static void bulk_out_complete(struct usb_ep *ep, struct usb_request *req)
 	struct fsg_common	*common = ep->driver_data;
 	struct fsg_buffhd	*bh = req->context;
 
-	dump_msg(common, "bulk-out", req->buf, req->actual);
+	if (!req->num_sgs)
+		dump_msg(common, "bulk-out", req->buf, req->actual);
 	if (req->status || req->actual != bh->bulk_out_intended_length)
 		DBG(common, "%s --> %d, %u/%u\n", __func__,
 				req->status, req->actual,
@@ -565,6 +570,9 @@ static void bulk_out_complete(struct usb_ep *ep, struct usb_request *req)
 	if (req->status == -ECONNRESET)		/* Request was cancelled */
 		usb_ep_fifo_flush(ep);
 
+	/* The data stays in the pages, do_write() knows where to look */
+	req->num_sgs = 0;
+
 	/* Hold the lock while we update the request and buffer states */
 	smp_wmb();
 	spin_lock(&common->lock);
@@ -575,6 +583,88 @@ static void bulk_out_complete(struct usb_ep *ep, struct usb_request *req)
 }
 
 
+/*-------------------------------------------------------------------------*/
+
+/* SG-capable controllers get the READ and WRITE data in FSG_SG_PAGES
+ * separate pages per buffer, so a buffer can be larger than FSG_BUFLEN
+ * without a high-order allocation. All pages but the last one of a
+ * transfer are full, which keeps every entry a multiple of maxpacket. */
+
+static int fsg_sg_alloc(struct fsg_buffhd *bh)
+{
+	struct page *page;
+	int i;
+
+	bh->sg = kmalloc(FSG_SG_PAGES * sizeof *bh->sg, GFP_KERNEL);
+	if (unlikely(!bh->sg))
+		return -ENOMEM;
+
+	sg_init_table(bh->sg, FSG_SG_PAGES);
+	for (i = 0; i < FSG_SG_PAGES; i++) {
+		page = alloc_page(GFP_KERNEL);
+		if (unlikely(!page))
+			return -ENOMEM;
+		sg_set_page(&bh->sg[i], page, PAGE_SIZE, 0);
+	}
+	return 0;
+}
+
+static void fsg_sg_free(struct fsg_buffhd *bh)
+{
+	int i;
+
+	if (!bh->sg)
+		return;
+	for (i = 0; i < FSG_SG_PAGES; i++)
+		if (sg_page(&bh->sg[i]))
+			__free_page(sg_page(&bh->sg[i]));
+	kfree(bh->sg);
+	bh->sg = NULL;
+}
+
+/* Describe the first length bytes of the pages in req */
+static void fsg_sg_set_length(struct usb_request *req,
+		struct fsg_buffhd *bh, unsigned length)
+{
+	struct scatterlist *sg;
+	unsigned n = 0;
+
+	req->sg = bh->sg;
+	for (sg = bh->sg; length; sg = sg_next(sg), n++) {
+		sg->length = min_t(unsigned, length, PAGE_SIZE);
+		length -= sg->length;
+	}
+	req->num_sgs = n;
+}
+
+/* Read (rw == READ) or write amount bytes of the backing file from or to
+ * the pages. Returns what vfs_read() or vfs_write() would. */
+static ssize_t fsg_sg_file_rw(struct fsg_lun *curlun, struct fsg_buffhd *bh,
+		unsigned amount, loff_t *pos, int rw)
+{
+	struct scatterlist *sg;
+	ssize_t done = 0, n;
+	unsigned len;
+
+	for (sg = bh->sg; amount; sg = sg_next(sg)) {
+		len = min_t(unsigned, amount, PAGE_SIZE);
+		if (rw == READ)
+			n = vfs_read(curlun->filp, (char __user *) sg_virt(sg),
+					len, pos);
+		else
+			n = vfs_write(curlun->filp,
+					(char __user *) sg_virt(sg), len, pos);
+		if (n < 0)
+			return done ? done : n;
+		done += n;
+		if (n < len)
+			break;
+		amount -= len;
+	}
+	return done;
+}
+
+
 /*-------------------------------------------------------------------------*/
 
 /* Ep0 class-specific handlers.  These always run in_irq. */
@@ -638,7 +728,7 @@ static void start_transfer(struct fsg_dev *fsg, struct usb_ep *ep,
 {
 	int	rc;
 
-	if (ep == fsg->bulk_in)
+	if (ep == fsg->bulk_in && !req->num_sgs)
 		dump_msg(fsg, "bulk-in", req->buf, req->length);
 
 	spin_lock_irq(&fsg->common->lock);
@@ -649,6 +739,7 @@ static void start_transfer(struct fsg_dev *fsg, struct usb_ep *ep,
 	if (rc != 0) {
 		*pbusy = 0;
 		*state = BUF_STATE_EMPTY;
+		req->num_sgs = 0;
 
 		/* We can't do much more than wait for a reset */
 
@@ -744,7 +835,7 @@ static int do_read(struct fsg_common *common)
 		 *	the next page.
 		 * If this means reading 0 then we were asked to read past
 		 *	the end of file. */
-		amount = min(amount_left, FSG_BUFLEN);
+		amount = min(amount_left, common->buflen);
 		amount = min((loff_t) amount,
 				curlun->file_length - file_offset);
 		partial_page = file_offset & (PAGE_CACHE_SIZE - 1);
@@ -774,9 +865,13 @@ static int do_read(struct fsg_common *common)
 
 		/* Perform the read */
 		file_offset_tmp = file_offset;
-		nread = vfs_read(curlun->filp,
-				(char __user *) bh->buf,
-				amount, &file_offset_tmp);
+		if (bh->sg)
+			nread = fsg_sg_file_rw(curlun, bh, amount,
+					&file_offset_tmp, READ);
+		else
+			nread = vfs_read(curlun->filp,
+					(char __user *) bh->buf,
+					amount, &file_offset_tmp);
 		VLDBG(curlun, "file read %u @ %llu -> %d\n", amount,
 				(unsigned long long) file_offset,
 				(int) nread);
@@ -796,6 +891,8 @@ static int do_read(struct fsg_common *common)
 		amount_left  -= nread;
 		common->residue -= nread;
 		bh->inreq->length = nread;
+		if (bh->sg)
+			fsg_sg_set_length(bh->inreq, bh, nread);
 		bh->state = BUF_STATE_FULL;
 
 		/* If an error occurred, report it and its position */
@@ -893,7 +990,7 @@ static int do_write(struct fsg_common *common)
 			 * If this means getting 0, then we were asked
 			 *	to write past the end of file.
 			 * Finally, round down to a block boundary. */
-			amount = min(amount_left_to_req, FSG_BUFLEN);
+			amount = min(amount_left_to_req, common->buflen);
 			amount = min((loff_t) amount, curlun->file_length -
 					usb_offset);
 			partial_page = usb_offset & (PAGE_CACHE_SIZE - 1);
@@ -928,6 +1025,8 @@ static int do_write(struct fsg_common *common)
 			/* amount is always divisible by 512, hence by
 			 * the bulk-out maxpacket size */
 			bh->outreq->length = amount;
+			if (bh->sg)
+				fsg_sg_set_length(bh->outreq, bh, amount);
 			bh->bulk_out_intended_length = amount;
 			bh->outreq->short_not_ok = 1;
 			START_TRANSFER_OR(common, bulk_out, bh->outreq,
@@ -967,9 +1066,13 @@ static int do_write(struct fsg_common *common)
 
 			/* Perform the write */
 			file_offset_tmp = file_offset;
-			nwritten = vfs_write(curlun->filp,
-					(char __user *) bh->buf,
-					amount, &file_offset_tmp);
+			if (bh->sg)
+				nwritten = fsg_sg_file_rw(curlun, bh, amount,
+						&file_offset_tmp, WRITE);
+			else
+				nwritten = vfs_write(curlun->filp,
+						(char __user *) bh->buf,
+						amount, &file_offset_tmp);
 			VLDBG(curlun, "file write %u @ %llu -> %d\n", amount,
 					(unsigned long long) file_offset,
 					(int) nwritten);
@@ -1505,9 +1608,15 @@ static int pad_with_zeros(struct fsg_dev *fsg)
 				return rc;
 		}
 
-		nsend = min(fsg->common->usb_amount_left, FSG_BUFLEN);
-		memset(bh->buf + nkeep, 0, nsend - nkeep);
-		bh->inreq->length = nsend;
+		/* Data read into the pages goes out as it is, it is whole
+		 * blocks, and the zeros follow in the next buffers */
+		if (bh->inreq->num_sgs) {
+			nsend = nkeep;
+		} else {
+			nsend = min(fsg->common->usb_amount_left, FSG_BUFLEN);
+			memset(bh->buf + nkeep, 0, nsend - nkeep);
+			bh->inreq->length = nsend;
+		}
 		bh->inreq->zero = 0;
 		start_transfer(fsg, fsg->bulk_in, bh->inreq,
 				&bh->inreq_busy, &bh->state);
@@ -2272,7 +2381,7 @@ reset:
 	if (common->prev_fsg) {
 		struct fsg_dev *fsg = common->prev_fsg;
 
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < fsg_num_buffers; ++i) {
 			struct fsg_buffhd *bh = &common->buffhds[i];
 
 			if (bh->inreq) {
@@ -2326,7 +2435,7 @@ reset:
 		clear_bit(IGNORE_BULK_OUT, &fsg->atomic_bitflags);
 
 		/* Allocate the requests */
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < fsg_num_buffers; ++i) {
 			struct fsg_buffhd	*bh = &common->buffhds[i];
 
 			rc = alloc_request(common, fsg->bulk_in, &bh->inreq);
@@ -2433,7 +2542,7 @@ static void handle_exception(struct fsg_common *common)
 
 	/* Cancel all the pending transfers */
 	if (fsg_is_set(common)) {
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < fsg_num_buffers; ++i) {
 			bh = &common->buffhds[i];
 			if (bh->inreq_busy)
 				usb_ep_dequeue(common->fsg->bulk_in, bh->inreq);
@@ -2445,7 +2554,7 @@ static void handle_exception(struct fsg_common *common)
 		/* Wait until everything is idle */
 		for (;;) {
 			int num_active = 0;
-			for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+			for (i = 0; i < fsg_num_buffers; ++i) {
 				bh = &common->buffhds[i];
 				num_active += bh->inreq_busy + bh->outreq_busy;
 			}
@@ -2466,9 +2575,12 @@ static void handle_exception(struct fsg_common *common)
 	 * state, and the exception.  Then invoke the handler. */
 	spin_lock_irq(&common->lock);
 
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg_num_buffers; ++i) {
 		bh = &common->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
+		/* Data that was never sent doesn't stick to the request */
+		if (bh->inreq)
+			bh->inreq->num_sgs = 0;
 	}
 	common->next_buffhd_to_fill = &common->buffhds[0];
 	common->next_buffhd_to_drain = &common->buffhds[0];
@@ -2661,6 +2773,10 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	int nluns, i, rc;
 	char *pathbuf;
 
+	rc = fsg_num_buffers_validate();
+	if (rc)
+		return ERR_PTR(rc);
+
 	/* Find out how many LUNs there should be */
 	nluns = cfg->nluns;
 	if (nluns < 1 || nluns > FSG_MAX_LUNS) {
@@ -2675,7 +2791,7 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 			return ERR_PTR(-ENOMEM);
 		common->free_storage_on_release = 1;
 	} else {
-		memset(common, 0, sizeof common);
+		memset(common, 0, sizeof *common);
 		common->free_storage_on_release = 0;
 	}
 
@@ -2749,13 +2865,30 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 
 
 	/* Data buffers cyclic list */
-	/* Buffers in buffhds are static -- no need for additional
-	 * allocation. */
-	bh = common->buffhds;
-	i = FSG_NUM_BUFFERS - 1;
+	bh = kcalloc(fsg_num_buffers, sizeof *bh, GFP_KERNEL);
+	if (unlikely(!bh)) {
+		rc = -ENOMEM;
+		goto error_release;
+	}
+	common->buffhds = bh;
+	i = fsg_num_buffers;
+	goto buffhds_first_it;
 	do {
 		bh->next = bh + 1;
-	} while (++bh, --i);
+		++bh;
+buffhds_first_it:
+		bh->buf = kmalloc(FSG_BUFLEN, GFP_KERNEL);
+		if (unlikely(!bh->buf)) {
+			rc = -ENOMEM;
+			goto error_release;
+		}
+		if (gadget->sg_supported) {
+			rc = fsg_sg_alloc(bh);
+			if (unlikely(rc))
+				goto error_release;
+		}
+	} while (--i);
+	common->buflen = gadget->sg_supported ? FSG_SG_BUFLEN : FSG_BUFLEN;
 	bh->next = common->buffhds;
 
 
@@ -2884,6 +3017,17 @@ static void fsg_common_release(struct kref *ref)
 	}
 
 	kfree(common->luns);
+
+	if (common->buffhds) {
+		struct fsg_buffhd *bh = common->buffhds;
+
+		for (i = fsg_num_buffers; i; --i, ++bh) {
+			fsg_sg_free(bh);
+			kfree(bh->buf);
+		}
+		kfree(common->buffhds);
+	}
+
 	if (common->free_storage_on_release)
 		kfree(common);
 }
@@ -0,0 +1,1329 @@
+/*
+ * f_ncm.c -- USB CDC Network (NCM) link function driver
+ *
+ * Based on f_ecm.c, Copyright (C) 2003-2005,2008 David Brownell
+ * Copyright (C) 2008 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* #define VERBOSE_DEBUG */
+
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/etherdevice.h>
+#include <linux/netdevice.h>
+#include <linux/interrupt.h>
+#include <linux/hrtimer.h>
+
+#include <asm/unaligned.h>
+
+#include "u_ether.h"
+
+
+/*
+ * This function is a "CDC Network Control Model" (CDC NCM) Ethernet link.
+ * The control model is the same as with ECM, but the data model packs
+ * many Ethernet frames ("datagrams") into each bulk transfer, called an
+ * NCM Transfer Block (NTB).  That cuts the per-packet USB overhead which
+ * limits ECM with small packets.
+ *
+ * Received NTBs are split into frames in unwrap().  Frames to send are
+ * collected into an NTB by wrap(), which is handed to u_ether when it is
+ * full; a timer sends a partly filled NTB once its oldest frame has
+ * waited tx_timeout microseconds.
+ *
+ * Only 16 bit NTBs are supported, and datagrams never carry a CRC.
+ *
+ * Note that NCM requires the use of "alternate settings" for its data
+ * interface.  This means that the set_alt() method has real work to do,
+ * and also means that a get_alt() method is required.
+ */
+
+/* NTB sizes just below 16 kB, so each NTB buffer (plus the skb overhead)
+ * still fits a 16 kB allocation.  Both are module parameters.
+ */
+#define NTB_DEFAULT_IN_SIZE	15872
+#define NTB_DEFAULT_OUT_SIZE	15872
+#define NTB_MAX_SIZE		0xffff		/* 16 bit NTBs */
+
+/* Datagrams (and the NDP) start on 4 byte boundaries in both directions */
+#define NCM_NDP_DIVISOR		4
+#define NCM_NDP_ALIGN		4
+
+/* Frames packed into one NTB towards the host */
+#define TX_MAX_NUM_DPE		32
+
+#define TX_TIMEOUT_USECS	300
+
+static unsigned ntb_in_size = NTB_DEFAULT_IN_SIZE;
+module_param(ntb_in_size, uint, S_IRUGO);
+MODULE_PARM_DESC(ntb_in_size, "Largest NTB sent to the host, in bytes");
+
+static unsigned ntb_out_size = NTB_DEFAULT_OUT_SIZE;
+module_param(ntb_out_size, uint, S_IRUGO);
+MODULE_PARM_DESC(ntb_out_size, "Largest NTB accepted from the host, in bytes");
+
+static unsigned tx_timeout = TX_TIMEOUT_USECS;
+module_param(tx_timeout, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tx_timeout, "Longest delay of a frame sent to the host, "
+		 "in usecs (0 sends each frame on its own)");
+
+struct ncm_ep_descs {
+	struct usb_endpoint_descriptor	*in;
+	struct usb_endpoint_descriptor	*out;
+	struct usb_endpoint_descriptor	*notify;
+};
+
+enum ncm_notify_state {
+	NCM_NOTIFY_NONE,		/* don't notify */
+	NCM_NOTIFY_CONNECT,		/* issue CONNECT next */
+	NCM_NOTIFY_SPEED,		/* issue SPEED_CHANGE next */
+};
+
+struct f_ncm {
+	struct gether			port;
+	u8				ctrl_id, data_id;
+
+	char				ethaddr[14];
+
+	struct ncm_ep_descs		fs;
+	struct ncm_ep_descs		hs;
+
+	struct usb_ep			*notify;
+	struct usb_endpoint_descriptor	*notify_desc;
+	struct usb_request		*notify_req;
+	u8				notify_state;
+	bool				is_open;
+
+	struct net_device		*netdev;
+
+	/* NTB being assembled for the host; protected by the u_ether
+	 * lock, wrap() is only called with it held
+	 */
+	struct sk_buff			*tx_skb;
+	struct usb_cdc_ncm_dpe16	tx_dpe[TX_MAX_NUM_DPE];
+	unsigned			tx_ndgrams;
+	u16				tx_seq;
+
+	struct hrtimer			tx_timer;
+	struct tasklet_struct		tx_tasklet;
+};
+
+static inline struct f_ncm *func_to_ncm(struct usb_function *f)
+{
+	return container_of(f, struct f_ncm, port.func);
+}
+
+/* peak (theoretical) bulk transfer rate in bits-per-second */
+static inline unsigned ncm_bitrate(struct usb_gadget *g)
+{
+	if (gadget_is_dualspeed(g) && g->speed == USB_SPEED_HIGH)
+		return 13 * 512 * 8 * 1000 * 8;
+	else
+		return 19 *  64 * 1 * 1000 * 8;
+}
+
+/*-------------------------------------------------------------------------*/
+
+/* sizes are patched from the module parameters at bind time */
+static struct usb_cdc_ncm_ntb_parameters ntb_parameters = {
+	.wLength =		cpu_to_le16(sizeof ntb_parameters),
+	.bmNtbFormatsSupported = cpu_to_le16(USB_CDC_NCM_NTB16_SUPPORTED),
+	.dwNtbInMaxSize =	cpu_to_le32(NTB_DEFAULT_IN_SIZE),
+	.wNdpInDivisor =	cpu_to_le16(NCM_NDP_DIVISOR),
+	.wNdpInPayloadRemainder = cpu_to_le16(0),
+	.wNdpInAlignment =	cpu_to_le16(NCM_NDP_ALIGN),
+
+	.dwNtbOutMaxSize =	cpu_to_le32(NTB_DEFAULT_OUT_SIZE),
+	.wNdpOutDivisor =	cpu_to_le16(NCM_NDP_DIVISOR),
+	.wNdpOutPayloadRemainder = cpu_to_le16(0),
+	.wNdpOutAlignment =	cpu_to_le16(NCM_NDP_ALIGN),
+	.wNtbOutMaxDatagrams =	cpu_to_le16(0),	/* no limit */
+};
+
+/*
+ * Use wMaxPacketSize big enough to fit CDC_NOTIFY_SPEED_CHANGE in one
+ * packet, to simplify cancellation; and a big transfer interval, to
+ * waste less bandwidth.
+ */
+
+#define LOG2_STATUS_INTERVAL_MSEC	5	/* 1 << 5 == 32 msec */
+#define NCM_STATUS_BYTECOUNT		16	/* 8 byte header + data */
+
+static struct usb_interface_assoc_descriptor ncm_iad_desc __initdata = {
+	.bLength =		sizeof ncm_iad_desc,
+	.bDescriptorType =	USB_DT_INTERFACE_ASSOCIATION,
+
+	/* .bFirstInterface =	DYNAMIC, */
+	.bInterfaceCount =	2,	/* control + data */
+	.bFunctionClass =	USB_CLASS_COMM,
+	.bFunctionSubClass =	USB_CDC_SUBCLASS_NCM,
+	.bFunctionProtocol =	USB_CDC_PROTO_NONE,
+	/* .iFunction =		DYNAMIC */
+};
+
+/* interface descriptor: */
+
+static struct usb_interface_descriptor ncm_control_intf __initdata = {
+	.bLength =		sizeof ncm_control_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	/* .bInterfaceNumber = DYNAMIC */
+	.bNumEndpoints =	1,
+	.bInterfaceClass =	USB_CLASS_COMM,
+	.bInterfaceSubClass =	USB_CDC_SUBCLASS_NCM,
+	.bInterfaceProtocol =	USB_CDC_PROTO_NONE,
+	/* .iInterface = DYNAMIC */
+};
+
+static struct usb_cdc_header_desc ncm_header_desc __initdata = {
+	.bLength =		sizeof ncm_header_desc,
+	.bDescriptorType =	USB_DT_CS_INTERFACE,
+	.bDescriptorSubType =	USB_CDC_HEADER_TYPE,
+
+	.bcdCDC =		cpu_to_le16(0x0110),
+};
+
+static struct usb_cdc_union_desc ncm_union_desc __initdata = {
+	.bLength =		sizeof(ncm_union_desc),
+	.bDescriptorType =	USB_DT_CS_INTERFACE,
+	.bDescriptorSubType =	USB_CDC_UNION_TYPE,
+	/* .bMasterInterface0 =	DYNAMIC */
+	/* .bSlaveInterface0 =	DYNAMIC */
+};
+
+static struct usb_cdc_ether_desc ecm_desc __initdata = {
+	.bLength =		sizeof ecm_desc,
+	.bDescriptorType =	USB_DT_CS_INTERFACE,
+	.bDescriptorSubType =	USB_CDC_ETHERNET_TYPE,
+
+	/* this descriptor actually adds value, surprise! */
+	/* .iMACAddress = DYNAMIC */
+	.bmEthernetStatistics =	cpu_to_le32(0), /* no statistics */
+	.wMaxSegmentSize =	cpu_to_le16(ETH_FRAME_LEN),
+	.wNumberMCFilters =	cpu_to_le16(0),
+	.bNumberPowerFilters =	0,
+};
+
+/* SET_NTB_INPUT_SIZE (4 byte form) is mandatory, so not advertised */
+#define NCAPS	(USB_CDC_NCM_NCAP_ETH_FILTER)
+
+static struct usb_cdc_ncm_desc ncm_desc __initdata = {
+	.bLength =		sizeof ncm_desc,
+	.bDescriptorType =	USB_DT_CS_INTERFACE,
+	.bDescriptorSubType =	USB_CDC_NCM_TYPE,
+
+	.bcdNcmVersion =	cpu_to_le16(0x0100),
+	/* can process SetEthernetPacketFilter */
+	.bmNetworkCapabilities = NCAPS,
+};
+
+/* the default data interface has no endpoints ... */
+
+static struct usb_interface_descriptor ncm_data_nop_intf __initdata = {
+	.bLength =		sizeof ncm_data_nop_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	.bInterfaceNumber =	1,
+	.bAlternateSetting =	0,
+	.bNumEndpoints =	0,
+	.bInterfaceClass =	USB_CLASS_CDC_DATA,
+	.bInterfaceSubClass =	0,
+	.bInterfaceProtocol =	USB_CDC_NCM_PROTO_NTB,
+	/* .iInterface = DYNAMIC */
+};
+
+/* ... but the "real" data interface has two bulk endpoints */
+
+static struct usb_interface_descriptor ncm_data_intf __initdata = {
+	.bLength =		sizeof ncm_data_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	.bInterfaceNumber =	1,
+	.bAlternateSetting =	1,
+	.bNumEndpoints =	2,
+	.bInterfaceClass =	USB_CLASS_CDC_DATA,
+	.bInterfaceSubClass =	0,
+	.bInterfaceProtocol =	USB_CDC_NCM_PROTO_NTB,
+	/* .iInterface = DYNAMIC */
+};
+
+/* full speed support: */
+
+static struct usb_endpoint_descriptor fs_ncm_notify_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_INT,
+	.wMaxPacketSize =	cpu_to_le16(NCM_STATUS_BYTECOUNT),
+	.bInterval =		1 << LOG2_STATUS_INTERVAL_MSEC,
+};
+
+static struct usb_endpoint_descriptor fs_ncm_in_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+};
+
+static struct usb_endpoint_descriptor fs_ncm_out_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_OUT,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+};
+
+static struct usb_descriptor_header *ncm_fs_function[] __initdata = {
+	(struct usb_descriptor_header *) &ncm_iad_desc,
+	/* CDC NCM control descriptors */
+	(struct usb_descriptor_header *) &ncm_control_intf,
+	(struct usb_descriptor_header *) &ncm_header_desc,
+	(struct usb_descriptor_header *) &ncm_union_desc,
+	(struct usb_descriptor_header *) &ecm_desc,
+	(struct usb_descriptor_header *) &ncm_desc,
+	(struct usb_descriptor_header *) &fs_ncm_notify_desc,
+	/* data interface, altsettings 0 and 1 */
+	(struct usb_descriptor_header *) &ncm_data_nop_intf,
+	(struct usb_descriptor_header *) &ncm_data_intf,
+	(struct usb_descriptor_header *) &fs_ncm_in_desc,
+	(struct usb_descriptor_header *) &fs_ncm_out_desc,
+	NULL,
+};
+
+/* high speed support: */
+
+static struct usb_endpoint_descriptor hs_ncm_notify_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_INT,
+	.wMaxPacketSize =	cpu_to_le16(NCM_STATUS_BYTECOUNT),
+	.bInterval =		LOG2_STATUS_INTERVAL_MSEC + 4,
+};
+static struct usb_endpoint_descriptor hs_ncm_in_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize =	cpu_to_le16(512),
+};
+
+static struct usb_endpoint_descriptor hs_ncm_out_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_OUT,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize =	cpu_to_le16(512),
+};
+
+static struct usb_descriptor_header *ncm_hs_function[] __initdata = {
+	(struct usb_descriptor_header *) &ncm_iad_desc,
+	/* CDC NCM control descriptors */
+	(struct usb_descriptor_header *) &ncm_control_intf,
+	(struct usb_descriptor_header *) &ncm_header_desc,
+	(struct usb_descriptor_header *) &ncm_union_desc,
+	(struct usb_descriptor_header *) &ecm_desc,
+	(struct usb_descriptor_header *) &ncm_desc,
+	(struct usb_descriptor_header *) &hs_ncm_notify_desc,
+	/* data interface, altsettings 0 and 1 */
+	(struct usb_descriptor_header *) &ncm_data_nop_intf,
+	(struct usb_descriptor_header *) &ncm_data_intf,
+	(struct usb_descriptor_header *) &hs_ncm_in_desc,
+	(struct usb_descriptor_header *) &hs_ncm_out_desc,
+	NULL,
+};
+
+/* string descriptors: */
+
+#define STRING_CTRL_IDX	0
+#define STRING_MAC_IDX	1
+#define STRING_DATA_IDX	2
+#define STRING_IAD_IDX	3
+
+static struct usb_string ncm_string_defs[] = {
+	[STRING_CTRL_IDX].s = "CDC Network Control Model (NCM)",
+	[STRING_MAC_IDX].s = NULL /* DYNAMIC */,
+	[STRING_DATA_IDX].s = "CDC Network Data",
+	[STRING_IAD_IDX].s = "CDC NCM",
+	{  } /* end of list */
+};
+
+static struct usb_gadget_strings ncm_string_table = {
+	.language =		0x0409,	/* en-us */
+	.strings =		ncm_string_defs,
+};
+
+static struct usb_gadget_strings *ncm_strings[] = {
+	&ncm_string_table,
+	NULL,
+};
+
+/*-------------------------------------------------------------------------*/
+
+static void ncm_reset_values(struct f_ncm *ncm)
+{
+	ncm->port.cdc_filter = DEFAULT_FILTER;
+	ncm->port.fixed_out_len = le32_to_cpu(ntb_parameters.dwNtbOutMaxSize);
+	ncm->port.fixed_in_len = le32_to_cpu(ntb_parameters.dwNtbInMaxSize);
+	ncm->tx_seq = 0;
+}
+
+/*
+ * Context: ncm->notify_req is available, or notify_state is NONE
+ */
+static void ncm_do_notify(struct f_ncm *ncm)
+{
+	struct usb_request		*req = ncm->notify_req;
+	struct usb_cdc_notification	*event;
+	struct usb_composite_dev	*cdev = ncm->port.func.config->cdev;
+	__le32				*data;
+	int				status;
+
+	/* notification already in flight? */
+	if (!req)
+		return;
+
+	event = req->buf;
+	switch (ncm->notify_state) {
+	case NCM_NOTIFY_NONE:
+		return;
+
+	case NCM_NOTIFY_CONNECT:
+		event->bNotificationType = USB_CDC_NOTIFY_NETWORK_CONNECTION;
+		if (ncm->is_open)
+			event->wValue = cpu_to_le16(1);
+		else
+			event->wValue = cpu_to_le16(0);
+		event->wLength = 0;
+		req->length = sizeof *event;
+
+		DBG(cdev, "notify connect %s\n",
+				ncm->is_open ? "true" : "false");
+		ncm->notify_state = NCM_NOTIFY_SPEED;
+		break;
+
+	case NCM_NOTIFY_SPEED:
+		event->bNotificationType = USB_CDC_NOTIFY_SPEED_CHANGE;
+		event->wValue = cpu_to_le16(0);
+		event->wLength = cpu_to_le16(8);
+		req->length = NCM_STATUS_BYTECOUNT;
+
+		/* SPEED_CHANGE data is up/down speeds in bits/sec */
+		data = req->buf + sizeof *event;
+		data[0] = cpu_to_le32(ncm_bitrate(cdev->gadget));
+		data[1] = data[0];
+
+		DBG(cdev, "notify speed %d\n", ncm_bitrate(cdev->gadget));
+		ncm->notify_state = NCM_NOTIFY_NONE;
+		break;
+	}
+	event->bmRequestType = 0xA1;
+	event->wIndex = cpu_to_le16(ncm->ctrl_id);
+
+	ncm->notify_req = NULL;
+	status = usb_ep_queue(ncm->notify, req, GFP_ATOMIC);
+	if (status < 0) {
+		ncm->notify_req = req;
+		DBG(cdev, "notify --> %d\n", status);
+	}
+}
+
+static void ncm_notify(struct f_ncm *ncm)
+{
+	/* NOTE on most versions of Linux, host side cdc-ethernet
+	 * won't listen for notifications until its netdevice opens.
+	 * The first notification then sits in the FIFO for a long
+	 * time, and the second one is queued.
+	 */
+	ncm->notify_state = NCM_NOTIFY_CONNECT;
+	ncm_do_notify(ncm);
+}
+
+static void ncm_notify_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	struct f_ncm			*ncm = req->context;
+	struct usb_composite_dev	*cdev = ncm->port.func.config->cdev;
+	struct usb_cdc_notification	*event = req->buf;
+
+	switch (req->status) {
+	case 0:
+		/* no fault */
+		break;
+	case -ECONNRESET:
+	case -ESHUTDOWN:
+		ncm->notify_state = NCM_NOTIFY_NONE;
+		break;
+	default:
+		DBG(cdev, "event %02x --> %d\n",
+			event->bNotificationType, req->status);
+		break;
+	}
+	ncm->notify_req = req;
+	ncm_do_notify(ncm);
+}
+
+static void ncm_ep0out_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	/* now for SET_NTB_INPUT_SIZE only */
+	unsigned		in_size;
+	struct usb_function	*f = req->context;
+	struct f_ncm		*ncm = func_to_ncm(f);
+	struct usb_composite_dev *cdev = ep->driver_data;
+
+	req->context = NULL;
+	if (req->status || req->actual != req->length) {
+		DBG(cdev, "Bad control-OUT transfer\n");
+		goto invalid;
+	}
+
+	in_size = get_unaligned_le32(req->buf);
+	if (in_size < USB_CDC_NCM_NTB_MIN_IN_SIZE ||
+	    in_size > le32_to_cpu(ntb_parameters.dwNtbInMaxSize)) {
+		DBG(cdev, "Got wrong INPUT SIZE (%d) from host\n", in_size);
+		goto invalid;
+	}
+
+	ncm->port.fixed_in_len = in_size;
+	VDBG(cdev, "Set NTB INPUT SIZE %d\n", in_size);
+	return;
+
+invalid:
+	usb_ep_set_halt(ep);
+	return;
+}
+
+static int ncm_setup(struct usb_function *f, const struct usb_ctrlrequest *ctrl)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+	struct usb_composite_dev *cdev = f->config->cdev;
+	struct usb_request	*req = cdev->req;
+	int			value = -EOPNOTSUPP;
+	u16			w_index = le16_to_cpu(ctrl->wIndex);
+	u16			w_value = le16_to_cpu(ctrl->wValue);
+	u16			w_length = le16_to_cpu(ctrl->wLength);
+
+	/* composite driver infrastructure handles everything except
+	 * CDC class messages; interface activation uses set_alt().
+	 */
+	switch ((ctrl->bRequestType << 8) | ctrl->bRequest) {
+	case ((USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_SET_ETHERNET_PACKET_FILTER:
+		/* see 6.2.30: no data, wIndex = interface,
+		 * wValue = packet filter bitmap
+		 */
+		if (w_length != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		DBG(cdev, "packet filter %02x\n", w_value);
+		/* REVISIT locking of cdc_filter.  This assumes the UDC
+		 * driver won't have a concurrent packet TX irq running on
+		 * another CPU; or that if it does, this write is atomic...
+		 */
+		ncm->port.cdc_filter = w_value;
+		value = 0;
+		break;
+
+	case ((USB_DIR_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_GET_NTB_PARAMETERS:
+
+		if (w_length == 0 || w_value != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		value = w_length > sizeof ntb_parameters ?
+			sizeof ntb_parameters : w_length;
+		memcpy(req->buf, &ntb_parameters, value);
+		VDBG(cdev, "Host asked NTB parameters\n");
+		break;
+
+	case ((USB_DIR_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_GET_NTB_INPUT_SIZE:
+
+		if (w_length < 4 || w_value != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		put_unaligned_le32(ncm->port.fixed_in_len, req->buf);
+		value = 4;
+		VDBG(cdev, "Host asked INPUT SIZE, sending %d\n",
+		     ncm->port.fixed_in_len);
+		break;
+
+	case ((USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_SET_NTB_INPUT_SIZE:
+	{
+		/* only the 4 byte form, see NCAPS */
+		if (w_length != 4 || w_value != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		req->complete = ncm_ep0out_complete;
+		req->length = w_length;
+		req->context = f;
+
+		value = req->length;
+		break;
+	}
+
+	case ((USB_DIR_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_GET_NTB_FORMAT:
+	{
+		if (w_length < 2 || w_value != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		put_unaligned_le16(USB_CDC_NCM_NTB16_FORMAT, req->buf);
+		value = 2;
+		VDBG(cdev, "Host asked NTB FORMAT, sending NTB16\n");
+		break;
+	}
+
+	case ((USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_SET_NTB_FORMAT:
+	{
+		/* 32 bit NTBs are not supported */
+		if (w_length != 0 || w_index != ncm->ctrl_id
+				|| w_value != USB_CDC_NCM_NTB16_FORMAT)
+			goto invalid;
+		VDBG(cdev, "NCM16 selected\n");
+		value = 0;
+		break;
+	}
+
+	case ((USB_DIR_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_GET_CRC_MODE:
+	{
+		if (w_length < 2 || w_value != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		put_unaligned_le16(USB_CDC_NCM_CRC_NOT_APPENDED, req->buf);
+		value = 2;
+		break;
+	}
+
+	case ((USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_SET_CRC_MODE:
+	{
+		/* CRCs are not supported */
+		if (w_length != 0 || w_index != ncm->ctrl_id
+				|| w_value != USB_CDC_NCM_CRC_NOT_APPENDED)
+			goto invalid;
+		value = 0;
+		break;
+	}
+
+	/* and optionally:
+	 * case USB_CDC_SEND_ENCAPSULATED_COMMAND:
+	 * case USB_CDC_GET_ENCAPSULATED_RESPONSE:
+	 * case USB_CDC_SET_ETHERNET_MULTICAST_FILTERS:
+	 * case USB_CDC_SET_ETHERNET_PM_PATTERN_FILTER:
+	 * case USB_CDC_GET_ETHERNET_PM_PATTERN_FILTER:
+	 * case USB_CDC_GET_ETHERNET_STATISTIC:
+	 * case USB_CDC_GET_NET_ADDRESS:
+	 * case USB_CDC_SET_NET_ADDRESS:
+	 * case USB_CDC_GET_MAX_DATAGRAM_SIZE:
+	 * case USB_CDC_SET_MAX_DATAGRAM_SIZE:
+	 */
+
+	default:
+invalid:
+		DBG(cdev, "invalid control req%02x.%02x v%04x i%04x l%d\n",
+			ctrl->bRequestType, ctrl->bRequest,
+			w_value, w_index, w_length);
+	}
+
+	/* respond with data transfer or status phase? */
+	if (value >= 0) {
+		DBG(cdev, "ncm req%02x.%02x v%04x i%04x l%d\n",
+			ctrl->bRequestType, ctrl->bRequest,
+			w_value, w_index, w_length);
+		req->zero = 0;
+		req->length = value;
+		value = usb_ep_queue(cdev->gadget->ep0, req, GFP_ATOMIC);
+		if (value < 0)
+			ERROR(cdev, "ncm req %02x.%02x response err %d\n",
+					ctrl->bRequestType, ctrl->bRequest,
+					value);
+	}
+
+	/* device either stalls (value < 0) or reports success */
+	return value;
+}
+
+/*-------------------------------------------------------------------------*/
+
+/* Drop the NTB being assembled, if any */
+static void ncm_discard_ntb(struct f_ncm *ncm)
+{
+	hrtimer_try_to_cancel(&ncm->tx_timer);
+	if (ncm->tx_skb) {
+		dev_kfree_skb_any(ncm->tx_skb);
+		ncm->tx_skb = NULL;
+	}
+	ncm->tx_ndgrams = 0;
+}
+
+static int ncm_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+	struct usb_composite_dev *cdev = f->config->cdev;
+
+	/* Control interface has only altsetting 0 */
+	if (intf == ncm->ctrl_id) {
+		if (alt != 0)
+			goto fail;
+
+		if (ncm->notify->driver_data) {
+			DBG(cdev, "reset ncm control %d\n", intf);
+			usb_ep_disable(ncm->notify);
+		} else {
+			DBG(cdev, "init ncm ctrl %d\n", intf);
+			ncm->notify_desc = ep_choose(cdev->gadget,
+					ncm->hs.notify,
+					ncm->fs.notify);
+		}
+		usb_ep_enable(ncm->notify, ncm->notify_desc);
+		ncm->notify->driver_data = ncm;
+
+	/* Data interface has two altsettings, 0 and 1 */
+	} else if (intf == ncm->data_id) {
+		if (alt > 1)
+			goto fail;
+
+		if (ncm->port.in_ep->driver_data) {
+			DBG(cdev, "reset ncm\n");
+			ncm->netdev = NULL;
+			gether_disconnect(&ncm->port);
+			ncm_discard_ntb(ncm);
+		}
+
+		/*
+		 * CDC Network only sends data in non-default altsettings.
+		 * Changing altsettings resets filters, statistics, etc.
+		 */
+		if (alt == 1) {
+			struct net_device	*net;
+
+			if (!ncm->port.in) {
+				DBG(cdev, "init ncm\n");
+				ncm->port.in = ep_choose(cdev->gadget,
+							 ncm->hs.in,
+							 ncm->fs.in);
+				ncm->port.out = ep_choose(cdev->gadget,
+							  ncm->hs.out,
+							  ncm->fs.out);
+			}
+
+			/* Enable zlps by default for NCM conformance;
+			 * override for musb_hdrc (avoids txdma ovhead)
+			 * and sa1100 (can't).
+			 */
+			ncm->port.is_zlp_ok = !(
+				gadget_is_sa1100(cdev->gadget)
+				|| gadget_is_musbhdrc(cdev->gadget)
+				);
+			ncm_reset_values(ncm);
+			DBG(cdev, "activate ncm\n");
+			net = gether_connect(&ncm->port);
+			if (IS_ERR(net))
+				return PTR_ERR(net);
+			ncm->netdev = net;
+		}
+
+		/* NOTE this can be a minor disagreement with the NCM spec,
+		 * which says speed notifications will "always" follow
+		 * connection notifications.  But we allow one connect to
+		 * follow another (if the first is in flight), and instead
+		 * just guarantee that a speed notification is always sent.
+		 */
+		ncm_notify(ncm);
+	} else
+		goto fail;
+
+	return 0;
+fail:
+	return -EINVAL;
+}
+
+/*
+ * Because the data interface supports multiple altsettings,
+ * this NCM function *MUST* implement a get_alt() method.
+ */
+static int ncm_get_alt(struct usb_function *f, unsigned intf)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+
+	if (intf == ncm->ctrl_id)
+		return 0;
+	return ncm->port.in_ep->driver_data ? 1 : 0;
+}
+
+/*-------------------------------------------------------------------------*/
+
+/* Start a new NTB for the host: the NTH goes first, the NDP last */
+static int ncm_open_ntb(struct f_ncm *ncm)
+{
+	struct usb_cdc_ncm_nth16	*nth;
+
+	ncm->tx_skb = alloc_skb(ncm->port.fixed_in_len, GFP_ATOMIC);
+	if (!ncm->tx_skb)
+		return -ENOMEM;
+
+	nth = (void *) skb_put(ncm->tx_skb, sizeof *nth);
+	put_unaligned_le32(USB_CDC_NCM_NTH16_SIGN, &nth->dwSignature);
+	nth->wHeaderLength = cpu_to_le16(sizeof *nth);
+	nth->wSequence = cpu_to_le16(ncm->tx_seq++);
+	nth->wBlockLength = 0;
+	nth->wNdpIndex = 0;
+	ncm->tx_ndgrams = 0;
+
+	/* bound the delay of the first frame in this NTB */
+	hrtimer_start(&ncm->tx_timer,
+		      ktime_set(0, tx_timeout * NSEC_PER_USEC),
+		      HRTIMER_MODE_REL);
+	return 0;
+}
+
+/* Bytes the NTB would take with one more datagram of len bytes */
+static unsigned ncm_ntb_len(struct f_ncm *ncm, unsigned len)
+{
+	unsigned	size;
+
+	size = ALIGN(ncm->tx_skb->len, NCM_NDP_DIVISOR) + len;
+	size = ALIGN(size, NCM_NDP_ALIGN);
+	/* NDP header, the new and all previous entries, and a terminator */
+	return size + sizeof(struct usb_cdc_ncm_ndp16)
+		+ (ncm->tx_ndgrams + 2) * sizeof(struct usb_cdc_ncm_dpe16);
+}
+
+static void ncm_add_datagram(struct f_ncm *ncm, struct sk_buff *skb)
+{
+	struct usb_cdc_ncm_dpe16	*dpe = &ncm->tx_dpe[ncm->tx_ndgrams++];
+	unsigned			pad;
+
+	pad = ALIGN(ncm->tx_skb->len, NCM_NDP_DIVISOR) - ncm->tx_skb->len;
+	memset(skb_put(ncm->tx_skb, pad), 0, pad);
+
+	dpe->wDatagramIndex = cpu_to_le16(ncm->tx_skb->len);
+	dpe->wDatagramLength = cpu_to_le16(skb->len);
+	memcpy(skb_put(ncm->tx_skb, skb->len), skb->data, skb->len);
+}
+
+/* Finish the NTB being assembled: append the NDP, fill in the NTH */
+static struct sk_buff *ncm_close_ntb(struct f_ncm *ncm)
+{
+	struct sk_buff			*skb = ncm->tx_skb;
+	struct usb_cdc_ncm_nth16	*nth;
+	struct usb_cdc_ncm_ndp16	*ndp;
+	unsigned			ndp_index, ndp_len;
+
+	hrtimer_try_to_cancel(&ncm->tx_timer);
+	ncm->tx_skb = NULL;
+
+	ndp_index = ALIGN(skb->len, NCM_NDP_ALIGN);
+	memset(skb_put(skb, ndp_index - skb->len), 0, ndp_index - skb->len);
+
+	ndp_len = sizeof *ndp + (ncm->tx_ndgrams + 1) * sizeof *ndp->dpe16;
+	ndp = (void *) skb_put(skb, ndp_len);
+	put_unaligned_le32(USB_CDC_NCM_NDP16_NOCRC_SIGN, &ndp->dwSignature);
+	ndp->wLength = cpu_to_le16(ndp_len);
+	ndp->wNextNdpIndex = 0;
+	memcpy(ndp->dpe16, ncm->tx_dpe, ncm->tx_ndgrams * sizeof *ndp->dpe16);
+	memset(&ndp->dpe16[ncm->tx_ndgrams], 0, sizeof *ndp->dpe16);
+	ncm->tx_ndgrams = 0;
+
+	nth = (void *) skb->data;
+	nth->wBlockLength = cpu_to_le16(skb->len);
+	nth->wNdpIndex = cpu_to_le16(ndp_index);
+
+	return skb;
+}
+
+/*
+ * Frames are copied into the NTB being assembled.  That one is returned
+ * for transfer when the next frame doesn't fit any more, on a flush
+ * request (NULL skb, from the tx timer), or right away without timeout.
+ */
+static struct sk_buff *ncm_wrap_ntb(struct gether *port, struct sk_buff *skb)
+{
+	struct f_ncm	*ncm = func_to_ncm(&port->func);
+	struct sk_buff	*ntb = NULL;
+
+	if (!skb) {
+		if (ncm->tx_skb)
+			ntb = ncm_close_ntb(ncm);
+		return ntb;
+	}
+
+	if (ncm->tx_skb && (ncm->tx_ndgrams == TX_MAX_NUM_DPE
+			|| ncm_ntb_len(ncm, skb->len) > port->fixed_in_len))
+		ntb = ncm_close_ntb(ncm);
+
+	if (!ncm->tx_skb && ncm_open_ntb(ncm) < 0) {
+		dev_kfree_skb_any(skb);
+		return ntb;
+	}
+
+	ncm_add_datagram(ncm, skb);
+	dev_kfree_skb_any(skb);
+
+	if (!ntb && !tx_timeout)
+		ntb = ncm_close_ntb(ncm);
+	return ntb;
+}
+
+static enum hrtimer_restart ncm_tx_timeout(struct hrtimer *data)
+{
+	struct f_ncm	*ncm = container_of(data, struct f_ncm, tx_timer);
+
+	/* xmit must not run from hard irq context */
+	tasklet_schedule(&ncm->tx_tasklet);
+	return HRTIMER_NORESTART;
+}
+
+static void ncm_tx_tasklet(unsigned long data)
+{
+	struct f_ncm		*ncm = (void *) data;
+	struct net_device	*net = ncm->netdev;
+	netdev_tx_t		status;
+
+	if (!net)
+		return;
+
+	/* a NULL skb asks u_ether to flush the pending NTB */
+	netif_tx_lock(net);
+	status = net->netdev_ops->ndo_start_xmit(NULL, net);
+	netif_tx_unlock(net);
+
+	/* all requests are busy; try again once some completed */
+	if (status == NETDEV_TX_BUSY)
+		hrtimer_start(&ncm->tx_timer,
+			      ktime_set(0, tx_timeout * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+}
+
+/*
+ * Split an NTB from the host into its datagrams.  They are clones
+ * sharing the NTB buffer, so no data is copied.
+ */
+static int ncm_unwrap_ntb(struct gether *port,
+			  struct sk_buff *skb,
+			  struct sk_buff_head *list)
+{
+	struct f_ncm			*ncm = func_to_ncm(&port->func);
+	struct usb_composite_dev	*cdev = ncm->port.func.config->cdev;
+	struct usb_cdc_ncm_nth16	*nth;
+	struct usb_cdc_ncm_ndp16	*ndp;
+	struct usb_cdc_ncm_dpe16	*dpe, *dpe_end;
+	struct sk_buff			*skb2;
+	unsigned			block_len, ndp_index, ndp_len;
+	unsigned			index, dg_len;
+
+	if (skb->len < sizeof *nth)
+		goto err;
+
+	nth = (void *) skb->data;
+	if (get_unaligned_le32(&nth->dwSignature) != USB_CDC_NCM_NTH16_SIGN) {
+		INFO(cdev, "Wrong NTH SIGN, skblen %d\n", skb->len);
+		goto err;
+	}
+	if (le16_to_cpu(nth->wHeaderLength) != sizeof *nth) {
+		INFO(cdev, "Wrong NTB headersize\n");
+		goto err;
+	}
+
+	block_len = le16_to_cpu(nth->wBlockLength);
+	if (block_len > skb->len ||
+	    block_len > le32_to_cpu(ntb_parameters.dwNtbOutMaxSize)) {
+		INFO(cdev, "OUT size exceeded\n");
+		goto err;
+	}
+
+	ndp_index = le16_to_cpu(nth->wNdpIndex);
+	do {
+		if (ndp_index < USB_CDC_NCM_NDP16_INDEX_MIN
+				|| ndp_index % NCM_NDP_ALIGN
+				|| ndp_index + sizeof *ndp > block_len) {
+			INFO(cdev, "Bad index: %#X\n", ndp_index);
+			goto err;
+		}
+
+		ndp = (void *) (skb->data + ndp_index);
+		if (get_unaligned_le32(&ndp->dwSignature)
+				!= USB_CDC_NCM_NDP16_NOCRC_SIGN) {
+			INFO(cdev, "Wrong NDP SIGN\n");
+			goto err;
+		}
+
+		ndp_len = le16_to_cpu(ndp->wLength);
+		if (ndp_len < USB_CDC_NCM_NDP16_LENGTH_MIN || ndp_len % 4
+				|| ndp_index + ndp_len > block_len) {
+			INFO(cdev, "Bad NDP length: %#X\n", ndp_len);
+			goto err;
+		}
+
+		dpe_end = (void *) ndp + ndp_len;
+		for (dpe = ndp->dpe16; dpe < dpe_end; dpe++) {
+			index = le16_to_cpu(dpe->wDatagramIndex);
+			dg_len = le16_to_cpu(dpe->wDatagramLength);
+
+			/* a null entry terminates the table */
+			if (!index || !dg_len)
+				break;
+
+			if (index + dg_len > block_len) {
+				INFO(cdev, "Bad datagram %#X+%d\n",
+				     index, dg_len);
+				goto err;
+			}
+
+			skb2 = skb_clone(skb, GFP_ATOMIC);
+			if (!skb2)
+				goto err;
+			skb_pull(skb2, index);
+			skb_trim(skb2, dg_len);
+			skb_queue_tail(list, skb2);
+		}
+
+		ndp_index = le16_to_cpu(ndp->wNextNdpIndex);
+	} while (ndp_index);
+
+	dev_kfree_skb_any(skb);
+
+	VDBG(cdev, "Parsed NTB with %d frames\n", skb_queue_len(list));
+	return 0;
+err:
+	skb_queue_purge(list);
+	dev_kfree_skb_any(skb);
+	return -EINVAL;
+}
+
+static void ncm_disable(struct usb_function *f)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+	struct usb_composite_dev *cdev = f->config->cdev;
+
+	DBG(cdev, "ncm deactivated\n");
+
+	if (ncm->port.in_ep->driver_data) {
+		ncm->netdev = NULL;
+		gether_disconnect(&ncm->port);
+		ncm_discard_ntb(ncm);
+	}
+
+	if (ncm->notify->driver_data) {
+		usb_ep_disable(ncm->notify);
+		ncm->notify->driver_data = NULL;
+		ncm->notify_desc = NULL;
+	}
+}
+
+/*-------------------------------------------------------------------------*/
+
+/*
+ * Callbacks let us notify the host about connect/disconnect when the
+ * net device is opened or closed.
+ *
+ * For testing, note that link states on this side include both opened
+ * and closed variants of:
+ *
+ *   - disconnected/unconfigured
+ *   - configured but inactive (data alt 0)
+ *   - configured and active (data alt 1)
+ *
+ * Each needs to be tested with unplug, rmmod, SET_CONFIGURATION, and
+ * SET_INTERFACE (altsetting).  Remember also that "configured" doesn't
+ * imply the host is actually polling the notification endpoint, and
+ * likewise that "active" doesn't imply it's actually using the data
+ * endpoints for traffic.
+ */
+
+static void ncm_open(struct gether *geth)
+{
+	struct f_ncm		*ncm = func_to_ncm(&geth->func);
+
+	DBG(ncm->port.func.config->cdev, "%s\n", __func__);
+
+	ncm->is_open = true;
+	ncm_notify(ncm);
+}
+
+static void ncm_close(struct gether *geth)
+{
+	struct f_ncm		*ncm = func_to_ncm(&geth->func);
+
+	DBG(ncm->port.func.config->cdev, "%s\n", __func__);
+
+	ncm->is_open = false;
+	ncm_notify(ncm);
+}
+
+/*-------------------------------------------------------------------------*/
+
+/* ethernet function driver setup/binding */
+
+static int __init
+ncm_bind(struct usb_configuration *c, struct usb_function *f)
+{
+	struct usb_composite_dev *cdev = c->cdev;
+	struct f_ncm		*ncm = func_to_ncm(f);
+	int			status;
+	struct usb_ep		*ep;
+
+	/* allocate instance-specific interface IDs */
+	status = usb_interface_id(c, f);
+	if (status < 0)
+		goto fail;
+	ncm->ctrl_id = status;
+	ncm_iad_desc.bFirstInterface = status;
+
+	ncm_control_intf.bInterfaceNumber = status;
+	ncm_union_desc.bMasterInterface0 = status;
+
+	status = usb_interface_id(c, f);
+	if (status < 0)
+		goto fail;
+	ncm->data_id = status;
+
+	ncm_data_nop_intf.bInterfaceNumber = status;
+	ncm_data_intf.bInterfaceNumber = status;
+	ncm_union_desc.bSlaveInterface0 = status;
+
+	status = -ENODEV;
+
+	/* allocate instance-specific endpoints */
+	ep = usb_ep_autoconfig(cdev->gadget, &fs_ncm_in_desc);
+	if (!ep)
+		goto fail;
+	ncm->port.in_ep = ep;
+	ep->driver_data = cdev;	/* claim */
+
+	ep = usb_ep_autoconfig(cdev->gadget, &fs_ncm_out_desc);
+	if (!ep)
+		goto fail;
+	ncm->port.out_ep = ep;
+	ep->driver_data = cdev;	/* claim */
+
+	ep = usb_ep_autoconfig(cdev->gadget, &fs_ncm_notify_desc);
+	if (!ep)
+		goto fail;
+	ncm->notify = ep;
+	ep->driver_data = cdev;	/* claim */
+
+	status = -ENOMEM;
+
+	/* allocate notification request and buffer */
+	ncm->notify_req = usb_ep_alloc_request(ep, GFP_KERNEL);
+	if (!ncm->notify_req)
+		goto fail;
+	ncm->notify_req->buf = kmalloc(NCM_STATUS_BYTECOUNT, GFP_KERNEL);
+	if (!ncm->notify_req->buf)
+		goto fail;
+	ncm->notify_req->context = ncm;
+	ncm->notify_req->complete = ncm_notify_complete;
+
+	/* copy descriptors, and track endpoint copies */
+	f->descriptors = usb_copy_descriptors(ncm_fs_function);
+	if (!f->descriptors)
+		goto fail;
+
+	ncm->fs.in = usb_find_endpoint(ncm_fs_function,
+			f->descriptors, &fs_ncm_in_desc);
+	ncm->fs.out = usb_find_endpoint(ncm_fs_function,
+			f->descriptors, &fs_ncm_out_desc);
+	ncm->fs.notify = usb_find_endpoint(ncm_fs_function,
+			f->descriptors, &fs_ncm_notify_desc);
+
+	/*
+	 * support all relevant hardware speeds... we expect that when
+	 * hardware is dual speed, all bulk-capable endpoints work at
+	 * both speeds
+	 */
+	if (gadget_is_dualspeed(c->cdev->gadget)) {
+		hs_ncm_in_desc.bEndpointAddress =
+				fs_ncm_in_desc.bEndpointAddress;
+		hs_ncm_out_desc.bEndpointAddress =
+				fs_ncm_out_desc.bEndpointAddress;
+		hs_ncm_notify_desc.bEndpointAddress =
+				fs_ncm_notify_desc.bEndpointAddress;
+
+		/* copy descriptors, and track endpoint copies */
+		f->hs_descriptors = usb_copy_descriptors(ncm_hs_function);
+		if (!f->hs_descriptors)
+			goto fail;
+
+		ncm->hs.in = usb_find_endpoint(ncm_hs_function,
+				f->hs_descriptors, &hs_ncm_in_desc);
+		ncm->hs.out = usb_find_endpoint(ncm_hs_function,
+				f->hs_descriptors, &hs_ncm_out_desc);
+		ncm->hs.notify = usb_find_endpoint(ncm_hs_function,
+				f->hs_descriptors, &hs_ncm_notify_desc);
+	}
+
+	/*
+	 * NOTE:  all that is done without knowing or caring about
+	 * the network link ... which is unavailable to this code
+	 * until we're activated via set_alt().
+	 */
+
+	ncm->port.open = ncm_open;
+	ncm->port.close = ncm_close;
+
+	hrtimer_init(&ncm->tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ncm->tx_timer.function = ncm_tx_timeout;
+	tasklet_init(&ncm->tx_tasklet, ncm_tx_tasklet, (unsigned long) ncm);
+
+	DBG(cdev, "CDC Network: %s speed IN/%s OUT/%s NOTIFY/%s\n",
+			gadget_is_dualspeed(c->cdev->gadget) ? "dual" : "full",
+			ncm->port.in_ep->name, ncm->port.out_ep->name,
+			ncm->notify->name);
+	return 0;
+
+fail:
+	if (f->descriptors)
+		usb_free_descriptors(f->descriptors);
+
+	if (ncm->notify_req) {
+		kfree(ncm->notify_req->buf);
+		usb_ep_free_request(ncm->notify, ncm->notify_req);
+	}
+
+	/* we might as well release our claims on endpoints */
+	if (ncm->notify)
+		ncm->notify->driver_data = NULL;
+	if (ncm->port.out)
+		ncm->port.out_ep->driver_data = NULL;
+	if (ncm->port.in)
+		ncm->port.in_ep->driver_data = NULL;
+
+	ERROR(cdev, "%s: can't bind, err %d\n", f->name, status);
+
+	return status;
+}
+
+static void
+ncm_unbind(struct usb_configuration *c, struct usb_function *f)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+
+	DBG(c->cdev, "ncm unbind\n");
+
+	hrtimer_cancel(&ncm->tx_timer);
+	tasklet_kill(&ncm->tx_tasklet);
+
+	if (gadget_is_dualspeed(c->cdev->gadget))
+		usb_free_descriptors(f->hs_descriptors);
+	usb_free_descriptors(f->descriptors);
+
+	kfree(ncm->notify_req->buf);
+	usb_ep_free_request(ncm->notify, ncm->notify_req);
+
+	ncm_string_defs[STRING_MAC_IDX].s = NULL;
+	kfree(ncm);
+}
+
+/**
+ * ncm_bind_config - add CDC Network link to a configuration
+ * @c: the configuration to support the network link
+ * @ethaddr: a buffer in which the ethernet address of the host side
+ *	side of the link was recorded
+ * Context: single threaded during gadget setup
+ *
+ * Returns zero on success, else negative errno.
+ *
+ * Caller must have called @gether_setup().  Caller is also responsible
+ * for calling @gether_cleanup() before module unload.
+ */
+int __init ncm_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN])
+{
+	struct f_ncm	*ncm;
+	int		status;
+
+	if (!can_support_ecm(c->cdev->gadget) || !ethaddr)
+		return -EINVAL;
+
+	/* maybe allocate device-global string IDs */
+	if (ncm_string_defs[0].id == 0) {
+
+		/* control interface label */
+		status = usb_string_id(c->cdev);
+		if (status < 0)
+			return status;
+		ncm_string_defs[STRING_CTRL_IDX].id = status;
+		ncm_control_intf.iInterface = status;
+
+		/* data interface label */
+		status = usb_string_id(c->cdev);
+		if (status < 0)
+			return status;
+		ncm_string_defs[STRING_DATA_IDX].id = status;
+		ncm_data_nop_intf.iInterface = status;
+		ncm_data_intf.iInterface = status;
+
+		/* MAC address */
+		status = usb_string_id(c->cdev);
+		if (status < 0)
+			return status;
+		ncm_string_defs[STRING_MAC_IDX].id = status;
+		ecm_desc.iMACAddress = status;
+
+		/* IAD */
+		status = usb_string_id(c->cdev);
+		if (status < 0)
+			return status;
+		ncm_string_defs[STRING_IAD_IDX].id = status;
+		ncm_iad_desc.iFunction = status;
+	}
+
+	/* NTBs must hold at least one full frame, and use 16 bit offsets */
+	ntb_in_size = clamp_t(unsigned, ntb_in_size,
+			USB_CDC_NCM_NTB_MIN_IN_SIZE, NTB_MAX_SIZE);
+	ntb_out_size = clamp_t(unsigned, ntb_out_size,
+			USB_CDC_NCM_NTB_MIN_OUT_SIZE, NTB_MAX_SIZE);
+	ntb_parameters.dwNtbInMaxSize = cpu_to_le32(ntb_in_size);
+	ntb_parameters.dwNtbOutMaxSize = cpu_to_le32(ntb_out_size);
+
+	/* allocate and initialize one new instance */
+	ncm = kzalloc(sizeof *ncm, GFP_KERNEL);
+	if (!ncm)
+		return -ENOMEM;
+
+	/* export host's Ethernet address in CDC format */
+	snprintf(ncm->ethaddr, sizeof ncm->ethaddr,
+		"%02X%02X%02X%02X%02X%02X",
+		ethaddr[0], ethaddr[1], ethaddr[2],
+		ethaddr[3], ethaddr[4], ethaddr[5]);
+	ncm_string_defs[STRING_MAC_IDX].s = ncm->ethaddr;
+
+	ncm_reset_values(ncm);
+	ncm->port.supports_multi_frame = true;
+
+	ncm->port.func.name = "cdc_network";
+	ncm->port.func.strings = ncm_strings;
+	/* descriptors are per-instance copies */
+	ncm->port.func.bind = ncm_bind;
+	ncm->port.func.unbind = ncm_unbind;
+	ncm->port.func.set_alt = ncm_set_alt;
+	ncm->port.func.get_alt = ncm_get_alt;
+	ncm->port.func.setup = ncm_setup;
+	ncm->port.func.disable = ncm_disable;
+
+	ncm->port.wrap = ncm_wrap_ntb;
+	ncm->port.unwrap = ncm_unwrap_ntb;
+
+	status = usb_add_function(c, &ncm->port.func);
+	if (status) {
+		ncm_string_defs[STRING_MAC_IDX].s = NULL;
+		kfree(ncm);
+	}
+	return status;
+}
@@ -40,6 +40,7 @@
 #include <linux/platform_device.h>
 #include <linux/fsl_devices.h>
 #include <linux/dmapool.h>
+#include <linux/scatterlist.h>
 #include <linux/delay.h>
 
 #include <asm/byteorder.h>
@@ -91,6 +92,39 @@ static int fsl_udc_resume(struct platform_device *pdev);
 /********************************************************************
  *	Internal Used Function
 ********************************************************************/
+/* Free the dTD chain of a request */
+static void fsl_free_dtds(struct fsl_req *req)
+{
+	struct ep_td_struct *curr_td, *next_td;
+	int j;
+
+	next_td = req->head;
+	for (j = 0; j < req->dtd_count; j++) {
+		curr_td = next_td;
+		next_td = curr_td->next_td_virt;
+		dma_pool_free(udc_controller->td_pool, curr_td, curr_td->td_dma);
+	}
+	req->dtd_count = 0;
+}
+
+/* Give the request buffer (or scatterlist) back to the CPU */
+static void fsl_unmap_req(struct fsl_ep *ep, struct fsl_req *req)
+{
+	struct device *dev = ep->udc->gadget.dev.parent;
+	enum dma_data_direction dir = ep_is_in(ep)
+			? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+
+	if (req->req.num_mapped_sgs) {
+		dma_unmap_sg(dev, req->req.sg, req->req.num_sgs, dir);
+		req->req.num_mapped_sgs = 0;
+	} else if (req->mapped) {
+		dma_unmap_single(dev, req->req.dma, req->req.length, dir);
+		req->req.dma = DMA_ADDR_INVALID;
+		req->mapped = 0;
+	} else if (req->req.length)
+		dma_sync_single_for_cpu(dev, req->req.dma, req->req.length, dir);
+}
+
 /*-----------------------------------------------------------------
  * done() - retire a request; caller blocked irqs
  * @status : request status to be set, only works when
@@ -98,12 +132,8 @@ static int fsl_udc_resume(struct platform_device *pdev);
  *--------------------------------------------------------------*/
 static void done(struct fsl_ep *ep, struct fsl_req *req, int status)
 {
-	struct fsl_udc *udc = NULL;
 	unsigned char stopped = ep->stopped;
-	struct ep_td_struct *curr_td, *next_td;
-	int j;
 
-	udc = (struct fsl_udc *)ep->udc;
 	/* Removed the req from fsl_ep->queue */
 	list_del_init(&req->queue);
 
@@ -114,29 +144,8 @@ static void done(struct fsl_ep *ep, struct fsl_req *req, int status)
 		status = req->req.status;
 
 	/* Free dtd for the request */
-	next_td = req->head;
-	for (j = 0; j < req->dtd_count; j++) {
-		curr_td = next_td;
-		if (j != req->dtd_count - 1) {
-			next_td = curr_td->next_td_virt;
-		}
-		dma_pool_free(udc->td_pool, curr_td, curr_td->td_dma);
-	}
-
-	if (req->mapped) {
-		dma_unmap_single(ep->udc->gadget.dev.parent,
-			req->req.dma, req->req.length,
-			ep_is_in(ep)
-				? DMA_TO_DEVICE
-				: DMA_FROM_DEVICE);
-		req->req.dma = DMA_ADDR_INVALID;
-		req->mapped = 0;
-	} else
-		dma_sync_single_for_cpu(ep->udc->gadget.dev.parent,
-			req->req.dma, req->req.length,
-			ep_is_in(ep)
-				? DMA_TO_DEVICE
-				: DMA_FROM_DEVICE);
+	fsl_free_dtds(req);
+	fsl_unmap_req(ep, req);
 
 	if (status && (status != -ESHUTDOWN))
 		VDBG("complete %s req %p stat %d len %u/%u",
@@ -622,14 +631,35 @@ static void fsl_free_request(struct usb_ep *_ep, struct usb_request *_req)
 }
 
 /*-------------------------------------------------------------------------*/
-static void fsl_queue_td(struct fsl_ep *ep, struct fsl_req *req)
+/* Point the dQH of an endpoint at a dTD chain and prime the endpoint */
+static void fsl_prime_ep(struct fsl_ep *ep, struct ep_td_struct *td)
 {
 	int i = ep_index(ep) * 2 + ep_is_in(ep);
-	u32 temp, bitmask, tmp_stat;
 	struct ep_queue_head *dQH = &ep->udc->ep_qh[i];
+	u32 temp;
 
-	/* VDBG("QH addr Register 0x%8x", dr_regs->endpointlistaddr);
-	VDBG("ep_qh[%d] addr is 0x%8x", i, (u32)&(ep->udc->ep_qh[i])); */
+	/* Write dQH next pointer and terminate bit to 0 */
+	temp = td->td_dma & EP_QUEUE_HEAD_NEXT_POINTER_MASK;
+	dQH->next_dtd_ptr = cpu_to_le32(temp);
+
+	/* Clear active and halt bit */
+	temp = cpu_to_le32(~(EP_QUEUE_HEAD_STATUS_ACTIVE
+			| EP_QUEUE_HEAD_STATUS_HALT));
+	dQH->size_ioc_int_sts &= temp;
+
+	/* Ensure that updates to the QH will occure before priming. */
+	wmb();
+
+	/* Prime endpoint by writing 1 to ENDPTPRIME */
+	temp = ep_is_in(ep)
+		? (1 << (ep_index(ep) + 16))
+		: (1 << (ep_index(ep)));
+	fsl_writel(temp, &dr_regs->endpointprime);
+}
+
+static void fsl_queue_td(struct fsl_ep *ep, struct fsl_req *req)
+{
+	u32 temp, bitmask, tmp_stat;
 
 	bitmask = ep_is_in(ep)
 		? (1 << (ep_index(ep) + 16))
@@ -664,121 +694,148 @@ static void fsl_queue_td(struct fsl_ep *ep, struct fsl_req *req)
 			goto out;
 	}
 
-	/* Write dQH next pointer and terminate bit to 0 */
-	temp = req->head->td_dma & EP_QUEUE_HEAD_NEXT_POINTER_MASK;
-	dQH->next_dtd_ptr = cpu_to_le32(temp);
-
-	/* Clear active and halt bit */
-	temp = cpu_to_le32(~(EP_QUEUE_HEAD_STATUS_ACTIVE
-			| EP_QUEUE_HEAD_STATUS_HALT));
-	dQH->size_ioc_int_sts &= temp;
-
-	/* Ensure that updates to the QH will occure before priming. */
-	wmb();
-
-	/* Prime endpoint by writing 1 to ENDPTPRIME */
-	temp = ep_is_in(ep)
-		? (1 << (ep_index(ep) + 16))
-		: (1 << (ep_index(ep)));
-	fsl_writel(temp, &dr_regs->endpointprime);
+	fsl_prime_ep(ep, req->head);
 out:
 	return;
 }
 
 /* Fill in the dTD structure
  * @req: request that the transfer belongs to
- * @length: return actually data length of the dTD
- * @dma: return dma address of the dTD
- * @is_last: return flag if it is the last dTD of the request
+ * @addr: dma address of the data of this dTD
+ * @length: data length of the dTD
+ * @is_last: flag if it is the last dTD of the request
+ * @gfp_flags: allocation flags for the dTD
  * return: pointer to the built dTD */
-static struct ep_td_struct *fsl_build_dtd(struct fsl_req *req, unsigned *length,
-		dma_addr_t *dma, int *is_last)
+static struct ep_td_struct *fsl_build_dtd(struct fsl_req *req, dma_addr_t addr,
+		unsigned length, int is_last, gfp_t gfp_flags)
 {
 	u32 swap_temp;
 	struct ep_td_struct *dtd;
+	dma_addr_t dma;
 
-	/* how big will this transfer be? */
-	*length = min(req->req.length - req->req.actual,
-			(unsigned)EP_MAX_LENGTH_TRANSFER);
-
-	dtd = dma_pool_alloc(udc_controller->td_pool, GFP_KERNEL, dma);
+	dtd = dma_pool_alloc(udc_controller->td_pool, gfp_flags, &dma);
 	if (dtd == NULL)
 		return dtd;
 
-	dtd->td_dma = *dma;
-	/* Clear reserved field */
-	swap_temp = cpu_to_le32(dtd->size_ioc_sts);
-	swap_temp &= ~DTD_RESERVED_FIELDS;
-	dtd->size_ioc_sts = cpu_to_le32(swap_temp);
+	dtd->td_dma = dma;
+	dtd->next_td_ptr = cpu_to_le32(DTD_NEXT_TERMINATE);
+	dtd->next_td_virt = NULL;
 
 	/* Init all of buffer page pointers */
-	swap_temp = (u32) (req->req.dma + req->req.actual);
+	swap_temp = (u32) addr;
 	dtd->buff_ptr0 = cpu_to_le32(swap_temp);
 	dtd->buff_ptr1 = cpu_to_le32(swap_temp + 0x1000);
 	dtd->buff_ptr2 = cpu_to_le32(swap_temp + 0x2000);
 	dtd->buff_ptr3 = cpu_to_le32(swap_temp + 0x3000);
 	dtd->buff_ptr4 = cpu_to_le32(swap_temp + 0x4000);
 
-	req->req.actual += *length;
-
-	/* zlp is needed if req->req.zero is set */
-	if (req->req.zero) {
-		if (*length == 0 || (*length % req->ep->ep.maxpacket) != 0)
-			*is_last = 1;
-		else
-			*is_last = 0;
-	} else if (req->req.length == req->req.actual)
-		*is_last = 1;
-	else
-		*is_last = 0;
-
-	if ((*is_last) == 0)
-		VDBG("multi-dtd request!");
 	/* Fill in the transfer size; set active bit */
-	swap_temp = ((*length << DTD_LENGTH_BIT_POS) | DTD_STATUS_ACTIVE);
+	swap_temp = ((length << DTD_LENGTH_BIT_POS) | DTD_STATUS_ACTIVE);
 
-	/* Enable interrupt for the last dtd of a request */
-	if (*is_last && !req->req.no_interrupt)
+	/* Enable interrupt for the last dtd of a request. On OUT endpoints
+	 * every dtd interrupts: a short packet can retire one in the middle
+	 * of the chain, and only dtds with IOC set show up in ENDPTCOMPLETE */
+	if (is_last ? !req->req.no_interrupt : !ep_is_in(req->ep))
 		swap_temp |= DTD_IOC;
 
 	dtd->size_ioc_sts = cpu_to_le32(swap_temp);
 
-	mb();
-
-	VDBG("length = %d address= 0x%x", *length, (int)*dma);
+	VDBG("length = %d address= 0x%x", length, (int)dma);
 
 	return dtd;
 }
 
-/* Generate dtd chain for a request */
-static int fsl_req_to_dtd(struct fsl_req *req)
+/* Append a dTD to the chain of a request */
+static int fsl_req_add_dtd(struct fsl_req *req, dma_addr_t addr,
+		unsigned length, int is_last, gfp_t gfp_flags)
 {
-	unsigned	count;
-	int		is_last;
-	int		is_first =1;
-	struct ep_td_struct	*last_dtd = NULL, *dtd;
-	dma_addr_t dma;
+	struct ep_td_struct *dtd;
+
+	dtd = fsl_build_dtd(req, addr, length, is_last, gfp_flags);
+	if (dtd == NULL)
+		return -ENOMEM;
+
+	if (req->dtd_count == 0) {
+		req->head = dtd;
+	} else {
+		req->tail->next_td_ptr = cpu_to_le32(dtd->td_dma);
+		req->tail->next_td_virt = dtd;
+	}
+	req->tail = dtd;
+	req->dtd_count++;
+
+	return 0;
+}
+
+/* Cover one DMA segment with as few dTDs as the five buffer pages allow.
+ * A dTD that isn't the last of the segment ends on a packet boundary, so
+ * the controller never sends a short packet in the middle of a transfer. */
+static int fsl_seg_to_dtd(struct fsl_req *req, dma_addr_t addr,
+		unsigned length, int is_last, gfp_t gfp_flags)
+{
+	unsigned maxpacket = req->ep->ep.maxpacket;
+	unsigned count;
+	int ret;
 
 	do {
-		dtd = fsl_build_dtd(req, &count, &dma, &is_last);
-		if (dtd == NULL)
-			return -ENOMEM;
+		count = EP_MAX_LENGTH_TRANSFER - (addr & (UDC_DMA_BOUNDARY - 1));
+		if (count < length)
+			count -= count % maxpacket;
+		else
+			count = length;
 
-		if (is_first) {
-			is_first = 0;
-			req->head = dtd;
-		} else {
-			last_dtd->next_td_ptr = cpu_to_le32(dma);
-			last_dtd->next_td_virt = dtd;
+		if (count != length)
+			VDBG("multi-dtd request!");
+
+		ret = fsl_req_add_dtd(req, addr, count,
+				is_last && count == length, gfp_flags);
+		if (ret)
+			return ret;
+
+		addr += count;
+		length -= count;
+	} while (length);
+
+	return 0;
+}
+
+/* Generate dtd chain for a request */
+static int fsl_req_to_dtd(struct fsl_req *req, gfp_t gfp_flags)
+{
+	struct scatterlist *sg;
+	int i, zlp, ret = 0;
+
+	req->dtd_count = 0;
+
+	/* zlp is needed if req->req.zero is set and the last packet is full */
+	zlp = req->req.zero && ep_is_in(req->ep) && req->req.length
+		&& !(req->req.length % req->ep->ep.maxpacket);
+
+	if (req->req.num_mapped_sgs) {
+		for_each_sg(req->req.sg, sg, req->req.num_mapped_sgs, i) {
+			ret = fsl_seg_to_dtd(req, sg_dma_address(sg),
+					sg_dma_len(sg), !zlp &&
+					i == req->req.num_mapped_sgs - 1,
+					gfp_flags);
+			if (ret)
+				break;
 		}
-		last_dtd = dtd;
+	} else if (req->req.length) {
+		ret = fsl_seg_to_dtd(req, req->req.dma, req->req.length,
+				!zlp, gfp_flags);
+	}
 
-		req->dtd_count++;
-	} while (!is_last);
+	/* A zero length request is a single dTD without data */
+	if (!ret && (zlp || !req->req.length))
+		ret = fsl_req_add_dtd(req, 0, 0, 1, gfp_flags);
 
-	dtd->next_td_ptr = cpu_to_le32(DTD_NEXT_TERMINATE);
+	if (ret) {
+		fsl_free_dtds(req);
+		return ret;
+	}
 
-	req->tail = dtd;
+	/* The chain must be in memory before it is linked to the queue */
+	wmb();
 
 	return 0;
 }
@@ -790,12 +847,15 @@ fsl_ep_queue(struct usb_ep *_ep, struct usb_request *_req, gfp_t gfp_flags)
 	struct fsl_ep *ep = container_of(_ep, struct fsl_ep, ep);
 	struct fsl_req *req = container_of(_req, struct fsl_req, req);
 	struct fsl_udc *udc;
+	struct device *dev;
+	enum dma_data_direction dir;
 	unsigned long flags;
 	int is_iso = 0;
 
 	/* catch various bogus parameters */
-	if (!_req || !req->req.complete || !req->req.buf
-			|| !list_empty(&req->queue)) {
+	if (!_req || !req->req.complete || !list_empty(&req->queue)
+			|| (!req->req.buf && !req->req.num_sgs
+				&& req->req.length)) {
 		VDBG("%s, bad params", __func__);
 		return -EINVAL;
 	}
@@ -814,38 +874,53 @@ fsl_ep_queue(struct usb_ep *_ep, struct usb_request *_req, gfp_t gfp_flags)
 		return -ESHUTDOWN;
 
 	req->ep = ep;
+	dev = udc->gadget.dev.parent;
+	dir = ep_is_in(ep) ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
 
 	/* map virtual address to hardware */
-	if (req->req.dma == DMA_ADDR_INVALID) {
-		req->req.dma = dma_map_single(ep->udc->gadget.dev.parent,
-					req->req.buf,
-					req->req.length, ep_is_in(ep)
-						? DMA_TO_DEVICE
-						: DMA_FROM_DEVICE);
+	if (req->req.num_sgs) {
+		struct scatterlist *sg;
+		int i;
+
+		/* Only the last entry may end with a short packet */
+		for_each_sg(req->req.sg, sg, req->req.num_sgs - 1, i) {
+			if (sg->length % ep->ep.maxpacket) {
+				VDBG("%s, bad sg entry", __func__);
+				return -EINVAL;
+			}
+		}
+		req->req.num_mapped_sgs = dma_map_sg(dev, req->req.sg,
+						req->req.num_sgs, dir);
+		if (!req->req.num_mapped_sgs)
+			return -ENOMEM;
+		req->mapped = 0;
+	} else if (!req->req.length) {
+		/* zero length packet, nothing to map */
+		req->mapped = 0;
+	} else if (req->req.dma == DMA_ADDR_INVALID) {
+		req->req.dma = dma_map_single(dev, req->req.buf,
+					req->req.length, dir);
 		req->mapped = 1;
 	} else {
-		dma_sync_single_for_device(ep->udc->gadget.dev.parent,
-					req->req.dma, req->req.length,
-					ep_is_in(ep)
-						? DMA_TO_DEVICE
-						: DMA_FROM_DEVICE);
+		dma_sync_single_for_device(dev, req->req.dma,
+					req->req.length, dir);
 		req->mapped = 0;
 	}
 
 	req->req.status = -EINPROGRESS;
 	req->req.actual = 0;
-	req->dtd_count = 0;
-
-	spin_lock_irqsave(&udc->lock, flags);
 
-	/* build dtds and push them to device queue */
-	if (!fsl_req_to_dtd(req)) {
-		fsl_queue_td(ep, req);
-	} else {
-		spin_unlock_irqrestore(&udc->lock, flags);
+	/* build dtds outside the lock, the pool may have to grow */
+	if (fsl_req_to_dtd(req, gfp_flags)) {
+		fsl_unmap_req(ep, req);
 		return -ENOMEM;
 	}
 
+	spin_lock_irqsave(&udc->lock, flags);
+
+	/* push the dtds to device queue */
+	fsl_queue_td(ep, req);
+
 	/* Update ep0 state */
 	if ((ep_index(ep) == 0))
 		udc->ep0_state = DATA_STATE_XMIT;
@@ -1185,7 +1260,7 @@ static int ep0_prime_status(struct fsl_udc *udc, int direction)
 	req->req.complete = NULL;
 	req->dtd_count = 0;
 
-	if (fsl_req_to_dtd(req) == 0)
+	if (fsl_req_to_dtd(req, GFP_ATOMIC) == 0)
 		fsl_queue_td(ep, req);
 	else
 		return -ENOMEM;
@@ -1263,7 +1338,7 @@ static void ch9getstatus(struct fsl_udc *udc, u8 request_type, u16 value,
 	req->dtd_count = 0;
 
 	/* prime the data phase */
-	if ((fsl_req_to_dtd(req) == 0))
+	if ((fsl_req_to_dtd(req, GFP_ATOMIC) == 0))
 		fsl_queue_td(ep, req);
 	else			/* no mem */
 		goto stall;
@@ -1449,6 +1524,35 @@ static void tripwire_handler(struct fsl_udc *udc, u8 ep_num, u8 *buffer_ptr)
 }
 
 /* process-ep_req(): free the completed Tds for this req */
+/* A short packet ended an OUT request before its last dTD. The controller
+ * has moved on to the rest of the chain, which gets no more data for this
+ * request: flush the endpoint so it lets go of those dTDs before they are
+ * freed, and restart it on the next queued request. Returns the length of
+ * the dTDs that were left over. */
+static int fsl_cut_short_req(struct fsl_udc *udc, int pipe,
+		struct fsl_req *req, struct ep_td_struct *td, int j)
+{
+	struct fsl_ep *ep = get_ep_by_pipe(udc, pipe);
+	int unused = 0;
+
+	for (j++; j < req->dtd_count; j++) {
+		td = td->next_td_virt;
+		unused += (le32_to_cpu(td->size_ioc_sts) & DTD_PACKET_SIZE)
+				>> DTD_LENGTH_BIT_POS;
+	}
+
+	fsl_ep_fifo_flush(&ep->ep);
+
+	if (req->queue.next != &ep->queue) {
+		struct fsl_req *next_req;
+
+		next_req = list_entry(req->queue.next, struct fsl_req, queue);
+		fsl_prime_ep(ep, next_req->head);
+	}
+
+	return unused;
+}
+
 static int process_ep_req(struct fsl_udc *udc, int pipe,
 		struct fsl_req *curr_req)
 {
@@ -1506,6 +1610,9 @@ static int process_ep_req(struct fsl_udc *udc, int pipe,
 				break;
 			} else {
 				td_complete++;
+				if (j != curr_req->dtd_count - 1)
+					actual -= fsl_cut_short_req(udc, pipe,
+							curr_req, curr_td, j);
 				break;
 			}
 		} else {
@@ -2381,6 +2488,7 @@ static int __init fsl_udc_probe(struct platform_device *pdev)
 	/* Setup gadget structure */
 	udc_controller->gadget.ops = &fsl_gadget_ops;
 	udc_controller->gadget.is_dualspeed = 1;
+	udc_controller->gadget.sg_supported = 1;
 	udc_controller->gadget.ep0 = &udc_controller->eps[0].ep;
 	INIT_LIST_HEAD(&udc_controller->gadget.ep_list);
 	udc_controller->gadget.speed = USB_SPEED_UNKNOWN;
@@ -382,7 +382,7 @@ struct ep_queue_head {
 #define  EP_QUEUE_CURRENT_OFFSET_MASK         0x00000FFF
 #define  EP_QUEUE_HEAD_NEXT_POINTER_MASK      0xFFFFFFE0
 #define  EP_QUEUE_FRINDEX_MASK                0x000007FF
-#define  EP_MAX_LENGTH_TRANSFER               0x4000
+#define  EP_MAX_LENGTH_TRANSFER               0x5000	/* 5 buffer pages */
 
 /* Endpoint Transfer Descriptor data struct */
 /* Rem: all the variables of td are LittleEndian Mode */
@@ -289,12 +289,40 @@ static struct fsg_lun *fsg_lun_from_dev(struct device *dev)
 #define EP0_BUFSIZE	256
 #define DELAYED_STATUS	(EP0_BUFSIZE + 999)	/* An impossibly large value */
 
-/* Number of buffers we will use.  2 is enough for double-buffering */
-#define FSG_NUM_BUFFERS	2
+/* Number of buffers we will use.  2 is enough for double-buffering,
+ * more let the backing file I/O run further ahead of (or behind) the
+ * USB transfers. */
+#ifndef CONFIG_USB_GADGET_STORAGE_NUM_BUFFERS
+#define CONFIG_USB_GADGET_STORAGE_NUM_BUFFERS	2
+#endif
+#define FSG_MAX_NUM_BUFFERS	32
+
+static unsigned int fsg_num_buffers = CONFIG_USB_GADGET_STORAGE_NUM_BUFFERS;
+module_param_named(num_buffers, fsg_num_buffers, uint, S_IRUGO);
+MODULE_PARM_DESC(num_buffers, "Number of pipeline buffers (2-32)");
+
+/* Read-ahead window for the backing files, in kB.  The page cache
+ * fetches this much asynchronously while earlier data is on the bus. */
+static unsigned int fsg_readahead_kb = 1024;
+module_param_named(readahead_kb, fsg_readahead_kb, uint, S_IRUGO);
+MODULE_PARM_DESC(readahead_kb, "Backing file read-ahead in kB, "
+		 "0 for the device default");
+
+static inline int fsg_num_buffers_validate(void)
+{
+	if (fsg_num_buffers >= 2 && fsg_num_buffers <= FSG_MAX_NUM_BUFFERS)
+		return 0;
+	pr_err("fsg: invalid number of buffers: %u\n", fsg_num_buffers);
+	return -EINVAL;
+}
 
 /* Default size of buffer length. */
 #define FSG_BUFLEN	((u32)16384)
 
+/* Size of the bulk data area of a buffer on SG-capable controllers */
+#define FSG_SG_BUFLEN	((u32)65536)
+#define FSG_SG_PAGES	(FSG_SG_BUFLEN / PAGE_SIZE)
+
 /* Maximal number of LUNs supported in mass storage function */
 #define FSG_MAX_LUNS	8
 
@@ -309,6 +337,8 @@ struct fsg_buffhd {
 	char				buf[FSG_BUFLEN];
 #else
 	void				*buf;
+	/* Bulk data pages, or NULL if bulk data goes through buf */
+	struct scatterlist		*sg;
 #endif
 	enum fsg_buffer_state		state;
 	struct fsg_buffhd		*next;
@@ -620,6 +650,12 @@ static int fsg_lun_open(struct fsg_lun *curlun, const char *filename)
 		goto out;
 	}
 
+	/* Reads are buffered, so with a large enough window the media is
+	 * already busy with the next blocks while the current ones are
+	 * sent; writes go behind through the page cache anyway. */
+	if (fsg_readahead_kb)
+		filp->f_ra.ra_pages = fsg_readahead_kb >> (PAGE_CACHE_SHIFT - 10);
+
 	get_file(filp);
 	curlun->ro = ro;
 	curlun->filp = filp;
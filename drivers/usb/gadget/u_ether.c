@@ -239,6 +239,10 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
 
+	/* aggregating framings (NCM) receive fixed size transfers */
+	if (dev->port_usb->fixed_out_len)
+		size = max_t(size_t, size, dev->port_usb->fixed_out_len);
+
 	skb = alloc_skb(size + NET_IP_ALIGN, gfp_flags);
 	if (skb == NULL) {
 		DBG(dev, "no rx skb\n");
@@ -494,30 +498,35 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 					struct net_device *net)
 {
 	struct eth_dev		*dev = netdev_priv(net);
-	int			length = skb->len;
+	int			length;
 	int			retval;
 	struct usb_request	*req = NULL;
 	unsigned long		flags;
 	struct usb_ep		*in;
 	u16			cdc_filter;
+	u32			fixed_in_len;
+	bool			flush = !skb;
 
 	spin_lock_irqsave(&dev->lock, flags);
 	if (dev->port_usb) {
 		in = dev->port_usb->in_ep;
 		cdc_filter = dev->port_usb->cdc_filter;
+		fixed_in_len = dev->port_usb->fixed_in_len;
 	} else {
 		in = NULL;
 		cdc_filter = 0;
+		fixed_in_len = 0;
 	}
 	spin_unlock_irqrestore(&dev->lock, flags);
 
 	if (!in) {
-		dev_kfree_skb_any(skb);
+		if (skb)
+			dev_kfree_skb_any(skb);
 		return NETDEV_TX_OK;
 	}
 
 	/* apply outgoing CDC or RNDIS filters */
-	if (!is_promisc(cdc_filter)) {
+	if (skb && !is_promisc(cdc_filter)) {
 		u8		*dest = skb->data;
 
 		if (is_multicast_ether_addr(dest)) {
@@ -563,26 +572,40 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	 */
 	if (dev->wrap) {
 		unsigned long	flags;
+		bool		multi_frame = false;
 
 		spin_lock_irqsave(&dev->lock, flags);
-		if (dev->port_usb)
+		if (dev->port_usb) {
+			multi_frame = dev->port_usb->supports_multi_frame;
 			skb = dev->wrap(dev->port_usb, skb);
+		}
 		spin_unlock_irqrestore(&dev->lock, flags);
-		if (!skb)
+		if (!skb) {
+			/* multi frame framings may keep the frame to send
+			 * it later with others; that's not a drop
+			 */
+			if (multi_frame || flush)
+				goto multiframe;
 			goto drop;
+		}
+	} else if (flush)
+		goto multiframe;
+	length = skb->len;
 
-		length = skb->len;
-	}
 	req->buf = skb->data;
 	req->context = skb;
 	req->complete = tx_complete;
 
 	/* use zlp framing on tx for strict CDC-Ether conformance,
 	 * though any robust network rx path ignores extra padding.
-	 * and some hardware doesn't like to write zlps.
+	 * and some hardware doesn't like to write zlps.  A transfer
+	 * of exactly the host's fixed size (NCM) needs no terminator.
 	 */
-	req->zero = 1;
-	if (!dev->zlp && (length % in->maxpacket) == 0)
+	if (fixed_in_len && length == fixed_in_len)
+		req->zero = 0;
+	else
+		req->zero = 1;
+	if (req->zero && !dev->zlp && (length % in->maxpacket) == 0)
 		length++;
 
 	req->length = length;
@@ -607,6 +630,7 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		dev_kfree_skb_any(skb);
 drop:
 		dev->net->stats.tx_dropped++;
+multiframe:
 		spin_lock_irqsave(&dev->req_lock, flags);
 		if (list_empty(&dev->tx_reqs))
 			netif_start_queue(net);
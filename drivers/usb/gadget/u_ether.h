@@ -60,8 +60,14 @@ struct gether {
 
 	u16				cdc_filter;
 
-	/* hooks for added framing, as needed for RNDIS and EEM. */
+	/* hooks for added framing, as needed for RNDIS, EEM and NCM.
+	 * With supports_multi_frame, wrap() may keep a frame to send it
+	 * later with others, and is called with a NULL skb to flush.
+	 */
 	u32				header_len;
+	u32				fixed_out_len;	/* rx transfer size */
+	u32				fixed_in_len;	/* largest tx transfer */
+	bool				supports_multi_frame;
 	struct sk_buff			*(*wrap)(struct gether *port,
 						struct sk_buff *skb);
 	int				(*unwrap)(struct gether *port,
@@ -111,6 +117,7 @@ static inline bool can_support_ecm(struct usb_gadget *gadget)
 int geth_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN]);
 int ecm_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN]);
 int eem_bind_config(struct usb_configuration *c);
+int ncm_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN]);
 
 #ifdef USB_ETH_RNDIS
 
@@ -106,6 +106,11 @@ struct console {
 	int	cflag;
 	void	*data;
 	struct	 console *next;
+	/* Output statistics, shown in /proc/console_stats */
+	unsigned long	chars_written;
+	unsigned long	writes;
+	u64		write_ns;
+	u64		max_write_ns;
 };
 
 extern int console_set_on_cmdline;
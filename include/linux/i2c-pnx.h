@@ -15,14 +15,19 @@
 #include <linux/pm.h>
 
 struct platform_device;
+struct i2c_adapter;
+struct i2c_msg;
 
 struct i2c_pnx_mif {
 	int			ret;		/* Return value */
-	int			mode;		/* Interface mode */
 	struct completion	complete;	/* I/O completion */
-	struct timer_list	timer;		/* Timeout */
-	u8 *			buf;		/* Data buffer */
-	int			len;		/* Length of data buffer */
+	struct i2c_msg		*msgs;		/* Messages of the transfer */
+	int			num;		/* Number of messages */
+	int			tx_msg;		/* Message being queued */
+	int			tx_pos;		/* Its next byte, -1: address */
+	int			rx_msg;		/* Message being received */
+	int			rx_pos;		/* Its next byte */
+	int			rx_left;	/* Bytes still to receive */
 };
 
 struct i2c_pnx_algo_data {
@@ -30,7 +35,6 @@ struct i2c_pnx_algo_data {
 	u32			ioaddr;
 	int			irq;
 	struct i2c_pnx_mif	mif;
-	int			last;
 };
 
 struct i2c_pnx_data {
@@ -42,4 +46,7 @@ struct i2c_pnx_data {
 	struct i2c_adapter *adapter;
 };
 
+extern int i2c_pnx_xfer_atomic(struct i2c_adapter *adap, struct i2c_msg *msgs,
+			       int num);
+
 #endif /* __I2C_PNX_H__ */
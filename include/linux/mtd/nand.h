@@ -179,8 +179,10 @@ typedef enum {
 #define NAND_MUST_PAD(chip) (!(chip->options & NAND_NO_PADDING))
 #define NAND_HAS_CACHEPROG(chip) ((chip->options & NAND_CACHEPRG))
 #define NAND_HAS_COPYBACK(chip) ((chip->options & NAND_COPYBACK))
-/* Large page NAND with SOFT_ECC should support subpage reads */
-#define NAND_SUBPAGE_READ(chip) ((chip->ecc.mode == NAND_ECC_SOFT) \
+/* Large page NAND with SOFT_ECC or a driver supplied read_subpage
+ * should support subpage reads */
+#define NAND_SUBPAGE_READ(chip) (((chip->ecc.mode == NAND_ECC_SOFT) \
+			|| (chip->options & NAND_HWECC_SUBPAGE_READ)) \
 					&& (chip->page_shift > 9))
 
 /* Mask to zero out the chip options, which come from the id table */
@@ -197,6 +199,8 @@ typedef enum {
 #define NAND_OWN_BUFFERS	0x00040000
 /* Chip may not exist, so silence any errors in scan */
 #define NAND_SCAN_SILENT_NODEV	0x00080000
+/* Hardware ECC driver provides its own ecc.read_subpage */
+#define NAND_HWECC_SUBPAGE_READ	0x00100000
 
 /* Options set by nand scan */
 /* Nand scan has allocated controller struct */
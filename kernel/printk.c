@@ -35,6 +35,10 @@
 #include <linux/kexec.h>
 #include <linux/ratelimit.h>
 #include <linux/kmsg_dump.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include <asm/uaccess.h>
 
@@ -139,6 +143,34 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 /* Flag: console code may call schedule() */
 static int console_may_schedule;
 
+/*
+ * Once the system is up, console output is written by printk_thread
+ * rather than by whoever calls printk() or release_console_sem(), so
+ * that a slow console does not hold up the caller.  The caller only
+ * copies its message into log_buf.  Oopses, panics, shutdown and
+ * printk.sync=1 still print synchronously.
+ */
+static struct task_struct *printk_thread;
+static int printk_sync;
+module_param_named(sync, printk_sync, bool, S_IRUGO | S_IWUSR);
+
+/* printk_thread holds console_sem, protected by logbuf_lock */
+static int printk_thread_owns_console;
+
+/* Chars given to the consoles per batch by printk_thread */
+#define PRINTK_THREAD_BATCH	32
+
+/* Chars that were overwritten in log_buf before reaching the consoles */
+static unsigned long con_dropped;
+
+static inline int printk_direct(void)
+{
+	return !printk_thread || printk_sync || oops_in_progress ||
+		system_state != SYSTEM_RUNNING;
+}
+
+static void wake_up_printk_thread(void);
+
 #ifdef CONFIG_PRINTK
 
 static char __log_buf[__LOG_BUF_LEN];
@@ -430,8 +462,19 @@ static void __call_console_drivers(unsigned start, unsigned end)
 	for_each_console(con) {
 		if ((con->flags & CON_ENABLED) && con->write &&
 				(cpu_online(smp_processor_id()) ||
-				(con->flags & CON_ANYTIME)))
+				(con->flags & CON_ANYTIME))) {
+			int cpu = smp_processor_id();
+			u64 t = cpu_clock(cpu);
+
 			con->write(con, &LOG_BUF(start), end - start);
+
+			t = cpu_clock(cpu) - t;
+			con->chars_written += end - start;
+			con->writes++;
+			con->write_ns += t;
+			if (t > con->max_write_ns)
+				con->max_write_ns = t;
+		}
 	}
 }
 
@@ -520,8 +563,10 @@ static void emit_log_char(char c)
 	log_end++;
 	if (log_end - log_start > log_buf_len)
 		log_start = log_end - log_buf_len;
-	if (log_end - con_start > log_buf_len)
+	if (log_end - con_start > log_buf_len) {
 		con_start = log_end - log_buf_len;
+		con_dropped++;
+	}
 	if (logged_chars < log_buf_len)
 		logged_chars++;
 }
@@ -780,6 +825,27 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 			new_text_line = 1;
 	}
 
+	/*
+	 * Normally the printk thread does the printing and all that
+	 * is left to do here is waking it up.
+	 */
+	if (!printk_direct()) {
+		printk_cpu = UINT_MAX;
+		spin_unlock(&logbuf_lock);
+		wake_up_printk_thread();
+		goto out_lockdep;
+	}
+
+	/*
+	 * An oops may have interrupted the printk thread between two
+	 * batches, with console_sem held.  Take the console away from
+	 * it or the oops might never make it out.
+	 */
+	if (unlikely(oops_in_progress) && printk_thread_owns_console) {
+		printk_thread_owns_console = 0;
+		init_MUTEX(&console_sem);
+	}
+
 	/*
 	 * Try to acquire and then immediately release the
 	 * console semaphore. The release will do all the
@@ -793,6 +859,7 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	if (acquire_console_semaphore_for_printk(this_cpu))
 		release_console_sem();
 
+out_lockdep:
 	lockdep_on();
 out_restore_irqs:
 	raw_local_irq_restore(flags);
@@ -1004,13 +1071,25 @@ int is_console_locked(void)
 	return console_locked;
 }
 
+/*
+ * printk() can be called with runqueue locks held, so wakeups are
+ * left to the next timer tick on this cpu.
+ */
+#define PRINTK_PENDING_KLOGD	0x01
+#define PRINTK_PENDING_CONSOLE	0x02
+
 static DEFINE_PER_CPU(int, printk_pending);
 
 void printk_tick(void)
 {
-	if (__get_cpu_var(printk_pending)) {
+	int pending = __get_cpu_var(printk_pending);
+
+	if (pending) {
 		__get_cpu_var(printk_pending) = 0;
-		wake_up_interruptible(&log_wait);
+		if (pending & PRINTK_PENDING_KLOGD)
+			wake_up_interruptible(&log_wait);
+		if (pending & PRINTK_PENDING_CONSOLE)
+			wake_up_process(printk_thread);
 	}
 }
 
@@ -1022,7 +1101,12 @@ int printk_needs_cpu(int cpu)
 void wake_up_klogd(void)
 {
 	if (waitqueue_active(&log_wait))
-		__raw_get_cpu_var(printk_pending) = 1;
+		__raw_get_cpu_var(printk_pending) |= PRINTK_PENDING_KLOGD;
+}
+
+static void wake_up_printk_thread(void)
+{
+	__raw_get_cpu_var(printk_pending) |= PRINTK_PENDING_CONSOLE;
 }
 
 /**
@@ -1037,13 +1121,16 @@ void wake_up_klogd(void)
  *
  * If there is output waiting for klogd, we wake it up.
  *
+ * Once the printk thread runs, other callers leave the output to it.
+ *
  * release_console_sem() may be called from any context.
  */
 void release_console_sem(void)
 {
 	unsigned long flags;
 	unsigned _con_start, _log_end;
-	unsigned wake_klogd = 0;
+	unsigned wake_klogd = 0, wake_thread = 0;
+	int is_thread = current == printk_thread;
 
 	if (console_suspended) {
 		up(&console_sem);
@@ -1057,23 +1144,127 @@ void release_console_sem(void)
 		wake_klogd |= log_start - log_end;
 		if (con_start == log_end)
 			break;			/* Nothing to print */
+		if (!is_thread && !printk_direct()) {
+			wake_thread = 1;
+			break;
+		}
+		if (is_thread && !printk_thread_owns_console) {
+			/* An oops took console_sem away from us */
+			spin_unlock_irqrestore(&logbuf_lock, flags);
+			return;
+		}
 		_con_start = con_start;
 		_log_end = log_end;
-		con_start = log_end;		/* Flush */
+		/* Short batches keep the irqs-off time down */
+		if (is_thread && _log_end - _con_start > PRINTK_THREAD_BATCH)
+			_log_end = _con_start + PRINTK_THREAD_BATCH;
+		con_start = _log_end;		/* Flush */
 		spin_unlock(&logbuf_lock);
 		stop_critical_timings();	/* don't trace print latency */
 		call_console_drivers(_con_start, _log_end);
 		start_critical_timings();
 		local_irq_restore(flags);
+		if (is_thread)
+			cond_resched();
+	}
+	if (is_thread) {
+		if (!printk_thread_owns_console) {
+			spin_unlock_irqrestore(&logbuf_lock, flags);
+			return;
+		}
+		printk_thread_owns_console = 0;
 	}
 	console_locked = 0;
 	up(&console_sem);
 	spin_unlock_irqrestore(&logbuf_lock, flags);
 	if (wake_klogd)
 		wake_up_klogd();
+	if (wake_thread)
+		wake_up_printk_thread();
 }
 EXPORT_SYMBOL(release_console_sem);
 
+static int printk_thread_fn(void *unused)
+{
+	unsigned long flags;
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (con_start == log_end || console_suspended)
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		acquire_console_sem();
+		spin_lock_irqsave(&logbuf_lock, flags);
+		printk_thread_owns_console = !console_suspended;
+		spin_unlock_irqrestore(&logbuf_lock, flags);
+		release_console_sem();
+	}
+
+	return 0;
+}
+
+static int __init printk_thread_init(void)
+{
+	struct task_struct *t;
+
+	t = kthread_run(printk_thread_fn, NULL, "kprintkd");
+	if (IS_ERR(t)) {
+		printk(KERN_ERR "printk: cannot start console thread, "
+		       "printing synchronously\n");
+		return PTR_ERR(t);
+	}
+	printk_thread = t;
+
+	return 0;
+}
+core_initcall(printk_thread_init);
+
+#ifdef CONFIG_PROC_FS
+static int console_stats_show(struct seq_file *m, void *v)
+{
+	struct console *con;
+
+	seq_printf(m, "dropped %lu\n", con_dropped);
+
+	acquire_console_sem();
+	for_each_console(con) {
+		u64 total_us = con->write_ns;
+		u64 max_us = con->max_write_ns;
+
+		do_div(total_us, NSEC_PER_USEC);
+		do_div(max_us, NSEC_PER_USEC);
+		seq_printf(m, "%s%d chars %lu writes %lu total_us %llu "
+			   "max_us %llu\n", con->name, con->index,
+			   con->chars_written, con->writes,
+			   (unsigned long long)total_us,
+			   (unsigned long long)max_us);
+	}
+	release_console_sem();
+
+	return 0;
+}
+
+static int console_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, console_stats_show, NULL);
+}
+
+static const struct file_operations console_stats_fops = {
+	.open		= console_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init console_stats_init(void)
+{
+	proc_create("console_stats", 0, NULL, &console_stats_fops);
+	return 0;
+}
+module_init(console_stats_init);
+#endif
+
 /**
  * console_conditional_schedule - yield the CPU if required
  *
@@ -1,4 +1,4 @@
-/* Worker thread pool for slow items, such as filesystem lookups or mkdirs
+/* Worker pool for slow items, such as filesystem lookups or mkdirs
  *
  * Copyright (C) 2008 Red Hat, Inc. All Rights Reserved.
  * Written by David Howells (dhowells@redhat.com)
@@ -13,57 +13,42 @@
 
 #include <linux/module.h>
 #include <linux/slow-work.h>
-#include <linux/kthread.h>
-#include <linux/freezer.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
 #include <linux/wait.h>
 #include <linux/debugfs.h>
 #include "slow-work.h"
 
-static void slow_work_cull_timeout(unsigned long);
-static void slow_work_oom_timeout(unsigned long);
-
 #ifdef CONFIG_SYSCTL
-static int slow_work_min_threads_sysctl(struct ctl_table *, int,
-					void __user *, size_t *, loff_t *);
-
 static int slow_work_max_threads_sysctl(struct ctl_table *, int ,
 					void __user *, size_t *, loff_t *);
 #endif
 
 /*
- * The pool of threads has at least min threads in it as long as someone is
- * using the facility, and may have as many as max.
+ * Up to max runners may be processing items at any one time.  The runners are
+ * work items on a workqueue, so they share the worker threads of the global
+ * pool and only occupy a thread whilst they have something to do.
  *
- * A portion of the pool may be processing very slow operations.
+ * A portion of the runners may be processing very slow operations.
  */
-static unsigned slow_work_min_threads = 2;
 static unsigned slow_work_max_threads = 4;
-static unsigned vslow_work_proportion = 50; /* % of threads that may process
+static unsigned vslow_work_proportion = 50; /* % of runners that may process
 					     * very slow work */
 
 #ifdef CONFIG_SYSCTL
-static const int slow_work_min_min_threads = 2;
+static const int slow_work_min_max_threads = 2;
 static int slow_work_max_max_threads = SLOW_WORK_THREAD_LIMIT;
 static const int slow_work_min_vslow = 1;
 static const int slow_work_max_vslow = 99;
 
 ctl_table slow_work_sysctls[] = {
-	{
-		.procname	= "min-threads",
-		.data		= &slow_work_min_threads,
-		.maxlen		= sizeof(unsigned),
-		.mode		= 0644,
-		.proc_handler	= slow_work_min_threads_sysctl,
-		.extra1		= (void *) &slow_work_min_min_threads,
-		.extra2		= &slow_work_max_threads,
-	},
 	{
 		.procname	= "max-threads",
 		.data		= &slow_work_max_threads,
 		.maxlen		= sizeof(unsigned),
 		.mode		= 0644,
 		.proc_handler	= slow_work_max_threads_sysctl,
-		.extra1		= &slow_work_min_threads,
+		.extra1		= (void *) &slow_work_min_max_threads,
 		.extra2		= (void *) &slow_work_max_max_threads,
 	},
 	{
@@ -80,19 +65,19 @@ ctl_table slow_work_sysctls[] = {
 #endif
 
 /*
- * The active state of the thread pool
+ * The runners and the workqueue they are queued on.  A runner keeps requeueing
+ * itself for as long as there are items it may pick up, and retires when there
+ * aren't.  The last runner to retire wakes up anyone waiting on
+ * slow_work_runners_done_wq.
  */
-static atomic_t slow_work_thread_count;
+static struct workqueue_struct *slow_work_wq;
+static struct work_struct slow_work_runners[SLOW_WORK_THREAD_LIMIT];
+static atomic_t slow_work_runner_count;
 static atomic_t vslow_work_executing_count;
-
-static bool slow_work_may_not_start_new_thread;
-static bool slow_work_cull; /* cull a thread due to lack of activity */
-static DEFINE_TIMER(slow_work_cull_timer, slow_work_cull_timeout, 0, 0);
-static DEFINE_TIMER(slow_work_oom_timer, slow_work_oom_timeout, 0, 0);
-static struct slow_work slow_work_new_thread; /* new thread starter */
+static DECLARE_WAIT_QUEUE_HEAD(slow_work_runners_done_wq);
 
 /*
- * slow work ID allocation (use slow_work_queue_lock)
+ * slow work runner ID allocation (use slow_work_queue_lock)
  */
 static DECLARE_BITMAP(slow_work_ids, SLOW_WORK_THREAD_LIMIT);
 
@@ -155,26 +140,17 @@ DEFINE_SPINLOCK(slow_work_queue_lock);
 
 /*
  * The following are two wait queues that get pinged when a work item is placed
- * on an empty queue.  These allow work items that are hogging a thread by
- * sleeping in a way that could be deferred to yield their thread and enqueue
+ * on an empty queue.  These allow work items that are hogging a runner by
+ * sleeping in a way that could be deferred to yield their runner and enqueue
  * themselves.
  */
 static DECLARE_WAIT_QUEUE_HEAD(slow_work_queue_waits_for_occupation);
 static DECLARE_WAIT_QUEUE_HEAD(vslow_work_queue_waits_for_occupation);
 
 /*
- * The thread controls.  A variable used to signal to the threads that they
- * should exit when the queue is empty, a waitqueue used by the threads to wait
- * for signals, and a completion set by the last thread to exit.
- */
-static bool slow_work_threads_should_exit;
-static DECLARE_WAIT_QUEUE_HEAD(slow_work_thread_wq);
-static DECLARE_COMPLETION(slow_work_last_thread_exited);
-
-/*
- * The number of users of the thread pool and its lock.  Whilst this is zero we
- * have no threads hanging around, and when this reaches zero, we wait for all
- * active or queued work items to complete and kill all the threads we do have.
+ * The number of users of the facility and its lock.  Whilst this is zero we
+ * have no workqueue, and when this reaches zero, we wait for all active or
+ * queued work items to complete and destroy the workqueue.
  */
 static int slow_work_user_count;
 static DEFINE_MUTEX(slow_work_user_lock);
@@ -194,27 +170,57 @@ static inline void slow_work_put_ref(struct slow_work *work)
 }
 
 /*
- * Calculate the maximum number of active threads in the pool that are
- * permitted to process very slow work items.
+ * Calculate the maximum number of runners that are permitted to process very
+ * slow work items.
  *
  * The answer is rounded up to at least 1, but may not equal or exceed the
- * maximum number of the threads in the pool.  This means we always have at
- * least one thread that can process slow work items, and we always have at
- * least one thread that won't get tied up doing so.
+ * maximum number of runners.  This means we always have at least one runner
+ * that can process slow work items, and we always have at least one runner
+ * that won't get tied up doing so.
  */
 static unsigned slow_work_calc_vsmax(void)
 {
 	unsigned vsmax;
 
-	vsmax = atomic_read(&slow_work_thread_count) * vslow_work_proportion;
+	vsmax = slow_work_max_threads * vslow_work_proportion;
 	vsmax /= 100;
 	vsmax = max(vsmax, 1U);
 	return min(vsmax, slow_work_max_threads - 1);
 }
 
 /*
- * Attempt to execute stuff queued on a slow thread.  Return true if we managed
- * it, false if there was nothing to do.
+ * Determine if there is slow work available for dispatch
+ */
+static inline bool slow_work_available(int vsmax)
+{
+	return !list_empty(&slow_work_queue) ||
+		(!list_empty(&vslow_work_queue) &&
+		 atomic_read(&vslow_work_executing_count) < vsmax);
+}
+
+/*
+ * Start another runner if there's work available for it and we haven't got as
+ * many as we're allowed yet.  The caller must hold slow_work_queue_lock.
+ */
+static void slow_work_kick_runner(void)
+{
+	int id;
+
+	if (atomic_read(&slow_work_runner_count) >= slow_work_max_threads ||
+	    !slow_work_available(slow_work_calc_vsmax()))
+		return;
+
+	id = find_first_zero_bit(slow_work_ids, SLOW_WORK_THREAD_LIMIT);
+	if (id >= SLOW_WORK_THREAD_LIMIT)
+		return;
+	__set_bit(id, slow_work_ids);
+	atomic_inc(&slow_work_runner_count);
+	queue_work(slow_work_wq, &slow_work_runners[id]);
+}
+
+/*
+ * Attempt to execute stuff queued on a slow work runner.  Return true if we
+ * managed it, false if there was nothing to do.
  */
 static noinline bool slow_work_execute(int id)
 {
@@ -224,14 +230,6 @@ static noinline bool slow_work_execute(int id)
 
 	vsmax = slow_work_calc_vsmax();
 
-	/* see if we can schedule a new thread to be started if we're not
-	 * keeping up with the work */
-	if (!waitqueue_active(&slow_work_thread_wq) &&
-	    (!list_empty(&slow_work_queue) || !list_empty(&vslow_work_queue)) &&
-	    atomic_read(&slow_work_thread_count) < slow_work_max_threads &&
-	    !slow_work_may_not_start_new_thread)
-		slow_work_enqueue(&slow_work_new_thread);
-
 	/* find something to execute */
 	spin_lock_irq(&slow_work_queue_lock);
 	if (!list_empty(&vslow_work_queue) &&
@@ -258,6 +256,10 @@ static noinline bool slow_work_execute(int id)
 	if (work) {
 		slow_work_mark_time(work);
 		slow_work_begin_exec(id, work);
+
+		/* if we're not keeping up with the work, get another runner
+		 * going; it only takes a thread from the pool if we block */
+		slow_work_kick_runner();
 	}
 
 	spin_unlock_irq(&slow_work_queue_lock);
@@ -309,7 +311,7 @@ static noinline bool slow_work_execute(int id)
 auto_requeue:
 	/* we must complete the enqueue operation
 	 * - we transfer our ref on the item back to the appropriate queue
-	 * - don't wake another thread up as we're awake already
+	 * - don't kick another runner as we're still running
 	 */
 	slow_work_mark_time(work);
 	if (test_bit(SLOW_WORK_VERY_SLOW, &work->flags))
@@ -326,9 +328,9 @@ auto_requeue:
  * work: The work item under execution that wants to sleep
  * _timeout: Scheduler sleep timeout
  *
- * Allow a requeueable work item to sleep on a slow-work processor thread until
- * that thread is needed to do some other work or the sleep is interrupted by
- * some other event.
+ * Allow a requeueable work item to sleep on a slow-work runner until that
+ * runner is needed to do some other work or the sleep is interrupted by some
+ * other event.
  *
  * The caller must set up a wake up event before calling this and must have set
  * the appropriate sleep mode (such as TASK_UNINTERRUPTIBLE) and tested its own
@@ -382,11 +384,11 @@ EXPORT_SYMBOL(slow_work_sleep_till_thread_needed);
  * and setxattr operations.  It may sleep on I/O and may sleep to obtain locks.
  *
  * Conversely, if a number of items are awaiting processing, it may take some
- * time before any given item is given attention.  The number of threads in the
- * pool may be increased to deal with demand, but only up to a limit.
+ * time before any given item is given attention.  The number of runners may be
+ * increased to deal with demand, but only up to a limit.
  *
  * If SLOW_WORK_VERY_SLOW is set on the work item, then it will be placed in
- * the very slow queue, from which only a portion of the threads will be
+ * the very slow queue, from which only a portion of the runners will be
  * allowed to pick items to execute.  This ensures that very slow items won't
  * overly block ones that are just ordinarily slow.
  *
@@ -451,10 +453,10 @@ int slow_work_enqueue(struct slow_work *work)
 				goto failed;
 			slow_work_mark_time(work);
 			list_add_tail(&work->link, queue);
-			wake_up(&slow_work_thread_wq);
+			slow_work_kick_runner();
 
 			/* if someone who could be requeued is sleeping on a
-			 * thread, then ask them to yield their thread */
+			 * runner, then ask them to yield their runner */
 			if (work->link.prev == queue)
 				wake_up(wfo_wq);
 		}
@@ -563,7 +565,7 @@ static void delayed_slow_work_timer(unsigned long data)
 	struct list_head *queue;
 	struct slow_work *work = (struct slow_work *) data;
 	unsigned long flags;
-	bool queued = false, put = false, first = false;
+	bool put = false, first = false;
 
 	if (test_bit(SLOW_WORK_VERY_SLOW, &work->flags)) {
 		wfo_wq = &vslow_work_queue_waits_for_occupation;
@@ -585,7 +587,7 @@ static void delayed_slow_work_timer(unsigned long data)
 		} else {
 			slow_work_mark_time(work);
 			list_add_tail(&work->link, queue);
-			queued = true;
+			slow_work_kick_runner();
 			if (work->link.prev == queue)
 				first = true;
 		}
@@ -596,8 +598,6 @@ static void delayed_slow_work_timer(unsigned long data)
 		slow_work_put_ref(work);
 	if (first)
 		wake_up(wfo_wq);
-	if (queued)
-		wake_up(&slow_work_thread_wq);
 }
 
 /**
@@ -662,225 +662,53 @@ cant_get_ref:
 EXPORT_SYMBOL(delayed_slow_work_enqueue);
 
 /*
- * Schedule a cull of the thread pool at some time in the near future
- */
-static void slow_work_schedule_cull(void)
-{
-	mod_timer(&slow_work_cull_timer,
-		  round_jiffies(jiffies + SLOW_WORK_CULL_TIMEOUT));
-}
-
-/*
- * Worker thread culling algorithm
- */
-static bool slow_work_cull_thread(void)
-{
-	unsigned long flags;
-	bool do_cull = false;
-
-	spin_lock_irqsave(&slow_work_queue_lock, flags);
-
-	if (slow_work_cull) {
-		slow_work_cull = false;
-
-		if (list_empty(&slow_work_queue) &&
-		    list_empty(&vslow_work_queue) &&
-		    atomic_read(&slow_work_thread_count) >
-		    slow_work_min_threads) {
-			slow_work_schedule_cull();
-			do_cull = true;
-		}
-	}
-
-	spin_unlock_irqrestore(&slow_work_queue_lock, flags);
-	return do_cull;
-}
-
-/*
- * Determine if there is slow work available for dispatch
- */
-static inline bool slow_work_available(int vsmax)
-{
-	return !list_empty(&slow_work_queue) ||
-		(!list_empty(&vslow_work_queue) &&
-		 atomic_read(&vslow_work_executing_count) < vsmax);
-}
-
-/*
- * Worker thread dispatcher
+ * Slow work runner.  Execute one item, then either requeue ourself to go
+ * round again or retire if there's nothing left that we could pick up.
+ *
+ * Requeueing rather than looping gives other work on the CPU a look in, and
+ * lets the freezer catch us between items.
  */
-static int slow_work_thread(void *_data)
+static void slow_work_runner(struct work_struct *runner)
 {
-	int vsmax, id;
-
-	DEFINE_WAIT(wait);
-
-	set_freezable();
-	set_user_nice(current, -5);
+	int id = runner - slow_work_runners;
+	bool last = false;
 
-	/* allocate ourselves an ID */
-	spin_lock_irq(&slow_work_queue_lock);
-	id = find_first_zero_bit(slow_work_ids, SLOW_WORK_THREAD_LIMIT);
-	BUG_ON(id < 0 || id >= SLOW_WORK_THREAD_LIMIT);
-	__set_bit(id, slow_work_ids);
 	slow_work_set_thread_pid(id, current->pid);
-	spin_unlock_irq(&slow_work_queue_lock);
-
-	sprintf(current->comm, "kslowd%03u", id);
-
-	for (;;) {
-		vsmax = vslow_work_proportion;
-		vsmax *= atomic_read(&slow_work_thread_count);
-		vsmax /= 100;
-
-		prepare_to_wait_exclusive(&slow_work_thread_wq, &wait,
-					  TASK_INTERRUPTIBLE);
-		if (!freezing(current) &&
-		    !slow_work_threads_should_exit &&
-		    !slow_work_available(vsmax) &&
-		    !slow_work_cull)
-			schedule();
-		finish_wait(&slow_work_thread_wq, &wait);
-
-		try_to_freeze();
-
-		vsmax = vslow_work_proportion;
-		vsmax *= atomic_read(&slow_work_thread_count);
-		vsmax /= 100;
-
-		if (slow_work_available(vsmax) && slow_work_execute(id)) {
-			cond_resched();
-			if (list_empty(&slow_work_queue) &&
-			    list_empty(&vslow_work_queue) &&
-			    atomic_read(&slow_work_thread_count) >
-			    slow_work_min_threads)
-				slow_work_schedule_cull();
-			continue;
-		}
-
-		if (slow_work_threads_should_exit)
-			break;
-
-		if (slow_work_cull && slow_work_cull_thread())
-			break;
-	}
+	slow_work_execute(id);
 
 	spin_lock_irq(&slow_work_queue_lock);
-	slow_work_set_thread_pid(id, 0);
-	__clear_bit(id, slow_work_ids);
-	spin_unlock_irq(&slow_work_queue_lock);
-
-	if (atomic_dec_and_test(&slow_work_thread_count))
-		complete_and_exit(&slow_work_last_thread_exited, 0);
-	return 0;
-}
-
-/*
- * Handle thread cull timer expiration
- */
-static void slow_work_cull_timeout(unsigned long data)
-{
-	slow_work_cull = true;
-	wake_up(&slow_work_thread_wq);
-}
-
-/*
- * Start a new slow work thread
- */
-static void slow_work_new_thread_execute(struct slow_work *work)
-{
-	struct task_struct *p;
-
-	if (slow_work_threads_should_exit)
-		return;
-
-	if (atomic_read(&slow_work_thread_count) >= slow_work_max_threads)
-		return;
-
-	if (!mutex_trylock(&slow_work_user_lock))
-		return;
-
-	slow_work_may_not_start_new_thread = true;
-	atomic_inc(&slow_work_thread_count);
-	p = kthread_run(slow_work_thread, NULL, "kslowd");
-	if (IS_ERR(p)) {
-		printk(KERN_DEBUG "Slow work thread pool: OOM\n");
-		if (atomic_dec_and_test(&slow_work_thread_count))
-			BUG(); /* we're running on a slow work thread... */
-		mod_timer(&slow_work_oom_timer,
-			  round_jiffies(jiffies + SLOW_WORK_OOM_TIMEOUT));
+	if (atomic_read(&slow_work_runner_count) <= slow_work_max_threads &&
+	    slow_work_available(slow_work_calc_vsmax())) {
+		queue_work(slow_work_wq, runner);
 	} else {
-		/* ratelimit the starting of new threads */
-		mod_timer(&slow_work_oom_timer, jiffies + 1);
+		slow_work_set_thread_pid(id, 0);
+		__clear_bit(id, slow_work_ids);
+		last = atomic_dec_and_test(&slow_work_runner_count);
 	}
+	spin_unlock_irq(&slow_work_queue_lock);
 
-	mutex_unlock(&slow_work_user_lock);
-}
-
-static const struct slow_work_ops slow_work_new_thread_ops = {
-	.owner		= THIS_MODULE,
-	.execute	= slow_work_new_thread_execute,
-#ifdef CONFIG_SLOW_WORK_DEBUG
-	.desc		= slow_work_new_thread_desc,
-#endif
-};
-
-/*
- * post-OOM new thread start suppression expiration
- */
-static void slow_work_oom_timeout(unsigned long data)
-{
-	slow_work_may_not_start_new_thread = false;
+	if (last)
+		wake_up_all(&slow_work_runners_done_wq);
 }
 
 #ifdef CONFIG_SYSCTL
 /*
- * Handle adjustment of the minimum number of threads
- */
-static int slow_work_min_threads_sysctl(struct ctl_table *table, int write,
-					void __user *buffer,
-					size_t *lenp, loff_t *ppos)
-{
-	int ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
-	int n;
-
-	if (ret == 0) {
-		mutex_lock(&slow_work_user_lock);
-		if (slow_work_user_count > 0) {
-			/* see if we need to start or stop threads */
-			n = atomic_read(&slow_work_thread_count) -
-				slow_work_min_threads;
-
-			if (n < 0 && !slow_work_may_not_start_new_thread)
-				slow_work_enqueue(&slow_work_new_thread);
-			else if (n > 0)
-				slow_work_schedule_cull();
-		}
-		mutex_unlock(&slow_work_user_lock);
-	}
-
-	return ret;
-}
-
-/*
- * Handle adjustment of the maximum number of threads
+ * Handle adjustment of the maximum number of runners
  */
 static int slow_work_max_threads_sysctl(struct ctl_table *table, int write,
 					void __user *buffer,
 					size_t *lenp, loff_t *ppos)
 {
 	int ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
-	int n;
 
-	if (ret == 0) {
+	if (ret == 0 && write) {
 		mutex_lock(&slow_work_user_lock);
 		if (slow_work_user_count > 0) {
-			/* see if we need to stop threads */
-			n = slow_work_max_threads -
-				atomic_read(&slow_work_thread_count);
-
-			if (n < 0)
-				slow_work_schedule_cull();
+			/* surplus runners retire by themselves, but we may
+			 * have room for another now */
+			spin_lock_irq(&slow_work_queue_lock);
+			slow_work_kick_runner();
+			spin_unlock_irq(&slow_work_queue_lock);
 		}
 		mutex_unlock(&slow_work_user_lock);
 	}
@@ -893,33 +721,24 @@ static int slow_work_max_threads_sysctl(struct ctl_table *table, int write,
  * slow_work_register_user - Register a user of the facility
  * @module: The module about to make use of the facility
  *
- * Register a user of the facility, starting up the initial threads if there
- * aren't any other users at this point.  This will return 0 if successful, or
- * an error if not.
+ * Register a user of the facility, setting up the workqueue if there aren't any
+ * other users at this point.  This will return 0 if successful, or an error if
+ * not.
  */
 int slow_work_register_user(struct module *module)
 {
-	struct task_struct *p;
-	int loop;
-
 	mutex_lock(&slow_work_user_lock);
 
 	if (slow_work_user_count == 0) {
 		printk(KERN_NOTICE "Slow work thread pool: Starting up\n");
-		init_completion(&slow_work_last_thread_exited);
-
-		slow_work_threads_should_exit = false;
-		slow_work_init(&slow_work_new_thread,
-			       &slow_work_new_thread_ops);
-		slow_work_may_not_start_new_thread = false;
-		slow_work_cull = false;
-
-		/* start the minimum number of threads */
-		for (loop = 0; loop < slow_work_min_threads; loop++) {
-			atomic_inc(&slow_work_thread_count);
-			p = kthread_run(slow_work_thread, NULL, "kslowd");
-			if (IS_ERR(p))
-				goto error;
+
+		slow_work_wq = alloc_workqueue("slow_work", WQ_FREEZEABLE,
+					       SLOW_WORK_THREAD_LIMIT);
+		if (!slow_work_wq) {
+			printk(KERN_ERR "Slow work thread pool:"
+			       " Aborting startup on ENOMEM\n");
+			mutex_unlock(&slow_work_user_lock);
+			return -ENOMEM;
 		}
 		printk(KERN_NOTICE "Slow work thread pool: Ready\n");
 	}
@@ -927,20 +746,6 @@ int slow_work_register_user(struct module *module)
 	slow_work_user_count++;
 	mutex_unlock(&slow_work_user_lock);
 	return 0;
-
-error:
-	if (atomic_dec_and_test(&slow_work_thread_count))
-		complete(&slow_work_last_thread_exited);
-	if (loop > 0) {
-		printk(KERN_ERR "Slow work thread pool:"
-		       " Aborting startup on ENOMEM\n");
-		slow_work_threads_should_exit = true;
-		wake_up_all(&slow_work_thread_wq);
-		wait_for_completion(&slow_work_last_thread_exited);
-		printk(KERN_ERR "Slow work thread pool: Aborted\n");
-	}
-	mutex_unlock(&slow_work_user_lock);
-	return PTR_ERR(p);
 }
 EXPORT_SYMBOL(slow_work_register_user);
 
@@ -1004,7 +809,7 @@ static void slow_work_wait_for_items(struct module *module)
  * slow_work_unregister_user - Unregister a user of the facility
  * @module: The module whose items should be cleared
  *
- * Unregister a user of the facility, killing all the threads if this was the
+ * Unregister a user of the facility, destroying the workqueue if this was the
  * last one.
  *
  * This waits for all the work items belonging to the nominated module to go
@@ -1026,11 +831,10 @@ void slow_work_unregister_user(struct module *module)
 	slow_work_user_count--;
 	if (slow_work_user_count == 0) {
 		printk(KERN_NOTICE "Slow work thread pool: Shutting down\n");
-		slow_work_threads_should_exit = true;
-		del_timer_sync(&slow_work_cull_timer);
-		del_timer_sync(&slow_work_oom_timer);
-		wake_up_all(&slow_work_thread_wq);
-		wait_for_completion(&slow_work_last_thread_exited);
+		wait_event(slow_work_runners_done_wq,
+			   atomic_read(&slow_work_runner_count) == 0);
+		destroy_workqueue(slow_work_wq);
+		slow_work_wq = NULL;
 		printk(KERN_NOTICE "Slow work thread pool:"
 		       " Shut down complete\n");
 	}
@@ -1045,6 +849,10 @@ EXPORT_SYMBOL(slow_work_unregister_user);
 static int __init init_slow_work(void)
 {
 	unsigned nr_cpus = num_possible_cpus();
+	int loop;
+
+	for (loop = 0; loop < SLOW_WORK_THREAD_LIMIT; loop++)
+		INIT_WORK(&slow_work_runners[loop], slow_work_runner);
 
 	if (slow_work_max_threads < nr_cpus)
 		slow_work_max_threads = nr_cpus;
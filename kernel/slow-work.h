@@ -9,12 +9,7 @@
  * 2 of the Licence, or (at your option) any later version.
  */
 
-#define SLOW_WORK_CULL_TIMEOUT (5 * HZ)	/* cull threads 5s after running out of
-					 * things to do */
-#define SLOW_WORK_OOM_TIMEOUT (5 * HZ)	/* can't start new threads for 5s after
-					 * OOM */
-
-#define SLOW_WORK_THREAD_LIMIT	255	/* abs maximum number of slow-work threads */
+#define SLOW_WORK_THREAD_LIMIT	255	/* abs maximum number of slow-work runners */
 
 /*
  * slow-work.c
@@ -34,8 +29,6 @@ extern spinlock_t slow_work_queue_lock;
  */
 #ifdef CONFIG_SLOW_WORK_DEBUG
 extern const struct file_operations slow_work_runqueue_fops;
-
-extern void slow_work_new_thread_desc(struct slow_work *, struct seq_file *);
 #endif
 
 /*
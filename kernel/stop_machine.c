@@ -38,14 +38,22 @@ struct stop_machine_data {
 static unsigned int num_threads;
 static atomic_t thread_ack;
 static DEFINE_MUTEX(lock);
-/* setup_lock protects refcount, stop_machine_wq and stop_machine_work. */
+/* setup_lock protects refcount and the per-cpu stop_machine threads. */
 static DEFINE_MUTEX(setup_lock);
 /* Users of stop_machine. */
 static int refcount;
-static struct workqueue_struct *stop_machine_wq;
 static struct stop_machine_data active, idle;
 static const struct cpumask *active_cpus;
-static void *stop_machine_work;
+
+/*
+ * One RT thread per online cpu while there are users.  These can't come
+ * from the shared workqueue pool: they must all be runnable at once and
+ * preempt everything else on their cpu.
+ */
+static DEFINE_PER_CPU(struct task_struct *, stop_machine_thread);
+static DEFINE_PER_CPU(int, stop_machine_pending);
+static atomic_t threads_running;
+static struct completion threads_done;
 
 static void set_state(enum stopmachine_state newstate)
 {
@@ -63,8 +71,8 @@ static void ack_state(void)
 }
 
 /* This is the actual function which stops the CPU. It runs
- * in the context of a dedicated stopmachine workqueue. */
-static void stop_cpu(struct work_struct *unused)
+ * in the context of a dedicated stopmachine thread. */
+static void stop_cpu(void)
 {
 	enum stopmachine_state curstate = STOPMACHINE_NONE;
 	struct stop_machine_data *smdata = &idle;
@@ -112,46 +120,141 @@ static int chill(void *unused)
 	return 0;
 }
 
+static int stop_machine_cpu_thread(void *data)
+{
+	unsigned int cpu = (unsigned long)data;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (!per_cpu(stop_machine_pending, cpu)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+		per_cpu(stop_machine_pending, cpu) = 0;
+
+		stop_cpu();
+		if (atomic_dec_and_test(&threads_running))
+			complete(&threads_done);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+/* Called with setup_lock held. */
+static int create_stop_machine_thread(unsigned int cpu)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+	struct task_struct *p;
+
+	p = kthread_create(stop_machine_cpu_thread, (void *)(unsigned long)cpu,
+			   "kstop/%u", cpu);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+	kthread_bind(p, cpu);
+	sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
+	per_cpu(stop_machine_thread, cpu) = p;
+
+	/* A cpu being brought up gets its thread started once online. */
+	if (cpu_online(cpu))
+		wake_up_process(p);
+	return 0;
+}
+
+/* Called with setup_lock held. */
+static void destroy_stop_machine_thread(unsigned int cpu)
+{
+	struct task_struct *p = per_cpu(stop_machine_thread, cpu);
+
+	if (p) {
+		kthread_stop(p);
+		per_cpu(stop_machine_thread, cpu) = NULL;
+	}
+}
+
 int stop_machine_create(void)
 {
+	int cpu, err = 0;
+
+	/* Keep cpus from coming and going while the threads are set up. */
+	get_online_cpus();
 	mutex_lock(&setup_lock);
 	if (refcount)
 		goto done;
-	stop_machine_wq = create_rt_workqueue("kstop");
-	if (!stop_machine_wq)
-		goto err_out;
-	stop_machine_work = alloc_percpu(struct work_struct);
-	if (!stop_machine_work)
-		goto err_out;
+	for_each_online_cpu(cpu) {
+		err = create_stop_machine_thread(cpu);
+		if (err)
+			goto err_out;
+	}
 done:
 	refcount++;
 	mutex_unlock(&setup_lock);
+	put_online_cpus();
 	return 0;
 
 err_out:
-	if (stop_machine_wq)
-		destroy_workqueue(stop_machine_wq);
+	for_each_possible_cpu(cpu)
+		destroy_stop_machine_thread(cpu);
 	mutex_unlock(&setup_lock);
-	return -ENOMEM;
+	put_online_cpus();
+	return err;
 }
 EXPORT_SYMBOL_GPL(stop_machine_create);
 
 void stop_machine_destroy(void)
 {
+	int cpu;
+
 	mutex_lock(&setup_lock);
 	refcount--;
 	if (refcount)
 		goto done;
-	destroy_workqueue(stop_machine_wq);
-	free_percpu(stop_machine_work);
+	for_each_possible_cpu(cpu)
+		destroy_stop_machine_thread(cpu);
 done:
 	mutex_unlock(&setup_lock);
 }
 EXPORT_SYMBOL_GPL(stop_machine_destroy);
 
+static int __cpuinit stop_machine_cpu_callback(struct notifier_block *nfb,
+					       unsigned long action,
+					       void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+	int err = 0;
+
+	mutex_lock(&setup_lock);
+	if (!refcount)
+		goto out;
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_UP_PREPARE:
+		err = create_stop_machine_thread(cpu);
+		break;
+	case CPU_ONLINE:
+		wake_up_process(per_cpu(stop_machine_thread, cpu));
+		break;
+	case CPU_UP_CANCELED:
+	case CPU_POST_DEAD:
+		destroy_stop_machine_thread(cpu);
+		break;
+	}
+out:
+	mutex_unlock(&setup_lock);
+	return err ? NOTIFY_BAD : NOTIFY_OK;
+}
+
+static int __init stop_machine_init(void)
+{
+	hotcpu_notifier(stop_machine_cpu_callback, 0);
+	return 0;
+}
+early_initcall(stop_machine_init);
+
 int __stop_machine(int (*fn)(void *), void *data, const struct cpumask *cpus)
 {
-	struct work_struct *sm_work;
 	int i, ret;
 
 	/* Set up initial state. */
@@ -165,18 +268,19 @@ int __stop_machine(int (*fn)(void *), void *data, const struct cpumask *cpus)
 	idle.data = NULL;
 
 	set_state(STOPMACHINE_PREPARE);
+	atomic_set(&threads_running, num_threads);
+	init_completion(&threads_done);
 
-	/* Schedule the stop_cpu work on all cpus: hold this CPU so one
+	/* Kick the stop_cpu threads on all cpus: hold this CPU so one
 	 * doesn't hit this CPU until we're ready. */
 	get_cpu();
 	for_each_online_cpu(i) {
-		sm_work = per_cpu_ptr(stop_machine_work, i);
-		INIT_WORK(sm_work, stop_cpu);
-		queue_work_on(i, stop_machine_wq, sm_work);
+		per_cpu(stop_machine_pending, i) = 1;
+		wake_up_process(per_cpu(stop_machine_thread, i));
 	}
 	/* This will release the thread on our CPU. */
 	put_cpu();
-	flush_workqueue(stop_machine_wq);
+	wait_for_completion(&threads_done);
 	ret = active.fnret;
 	mutex_unlock(&lock);
 	return ret;
@@ -1328,6 +1328,9 @@ static int __init ip_auto_config(void)
 	/* Give hardware a chance to settle */
 	msleep(CONF_PRE_OPEN);
 
+	/* Network drivers may still be probing asynchronously */
+	wait_for_device_probe();
+
 	/* Setup all network devices */
 	if (ic_open_devs() < 0)
 		return -1;
@@ -979,10 +979,11 @@ static int rpciod_start(void)
 	struct workqueue_struct *wq;
 
 	/*
-	 * Create the rpciod thread and wait for it to start.
+	 * Create the rpciod workqueue.  It may be needed to write back
+	 * pages under memory pressure, so give it a rescuer.
 	 */
 	dprintk("RPC:       creating workqueue rpciod\n");
-	wq = create_workqueue("rpciod");
+	wq = alloc_workqueue("rpciod", WQ_RESCUER, 1);
 	rpciod_workqueue = wq;
 	return rpciod_workqueue != NULL;
 }
@@ -31,27 +31,29 @@
 #include <sound/soc.h>
 
 #include <mach/dma.h>
+#include <mach/lpc313x_dmac.h>
 #include "lpc313x-pcm.h"
 
 #define SND_NAME "lpc313x-audio"
 static u64 lpc313x_pcm_dmamask = DMA_BIT_MASK(32);
 
 #if defined (CONFIG_SND_USE_DMA_LINKLIST)
-/* The DMA controller in the LPC31XX has limited interrupt support
-   for DMA. A timer is used instead to update the current buffer
-   position */
-#define MIN_PERIODS 8
-#define MAX_PERIODS 32
-#define DMA_LIST_SIZE (MAX_PERIODS * sizeof(dma_sg_ll_t))
-#define MIN_BYTES_PERIOD 2048
+/* The buffer is played through a cyclic transfer of the dmaengine
+   driver, with one transaction per period. Its completion is used as
+   the period interrupt. The smallest period is about 1.3ms of 48KHz
+   16-bit stereo audio */
+#define MIN_PERIODS 2
+#define MAX_PERIODS 64
+#define MIN_BYTES_PERIOD 256
 #define MAX_BYTES_PERIOD 4096
-#define MINTICKINC ((MIN_BYTES_PERIOD * HZ * (MIN_PERIODS / 4)) / (48000 * 2 * 2))
+#define MAX_BYTES_BUFFER (32 * MAX_BYTES_PERIOD)
 
 #else
 #define MIN_PERIODS 2
 #define MAX_PERIODS 2
 #define MIN_BYTES_PERIOD (32 * 1024)
 #define MAX_BYTES_PERIOD (32 * 1024)
+#define MAX_BYTES_BUFFER (MAX_PERIODS * MAX_BYTES_PERIOD)
 #endif
 
 #if defined (CONFIG_SND_I2S_TX0_MASTER)
@@ -80,7 +82,7 @@ static const struct snd_pcm_hardware lpc313x_pcm_hardware = {
 	.period_bytes_max = MAX_BYTES_PERIOD,
 	.periods_min = MIN_PERIODS,
 	.periods_max = MAX_PERIODS,
-	.buffer_bytes_max = (MAX_PERIODS * MAX_BYTES_PERIOD)
+	.buffer_bytes_max = MAX_BYTES_BUFFER
 };
 
 struct lpc313x_dma_data {
@@ -90,17 +92,52 @@ struct lpc313x_dma_data {
 	int num_periods;
 
 	/* DMA configuration and support */
-	int dmach;
 	volatile dma_addr_t dma_cur;
-	u32 dma_cfg_base;
 #if defined (CONFIG_SND_USE_DMA_LINKLIST)
-	dma_sg_ll_t *p_sg_cpu;
-	dma_sg_ll_t *p_sg_dma;
-	struct timer_list timer[2];
-	int inccount;
+	struct dma_chan *chan;
+	struct lpc313x_dma_slave slave;
+#else
+	int dmach;
+	u32 dma_cfg_base;
 #endif
 };
 
+#if defined (CONFIG_SND_USE_DMA_LINKLIST)
+/*
+ * Period callback, run from the dmaengine tasklet
+ */
+static void lpc313x_pcm_dma_period(void *handle)
+{
+	struct snd_pcm_substream *substream = (struct snd_pcm_substream *) handle;
+	struct lpc313x_dma_data *prtd = substream->runtime->private_data;
+
+	/* Take the position from the period the controller works on now
+	   rather than counting callbacks, so a late callback can't make
+	   the position drift */
+	prtd->dma_cur = prtd->dma_buffer +
+		lpc313x_dma_cyclic_pos(prtd->chan) * prtd->period_size;
+
+	/* Tell audio system more buffer space is available */
+	snd_pcm_period_elapsed(substream);
+}
+
+/*
+ * Pick a channel of the LPC313x dmaengine driver and hand it the I2S
+ * FIFO it is going to feed
+ */
+static bool lpc313x_pcm_dma_filter(struct dma_chan *chan, void *param)
+{
+	struct lpc313x_dma_slave *dws = param;
+
+	if (strcmp(dev_name(chan->device->dev), "lpc313x-dmac"))
+		return false;
+
+	dws->dma_dev = chan->device->dev;
+	chan->private = dws;
+	return true;
+}
+
+#else
 /*
  * DMA ISR - occurs when a new DMA buffer is needed
  */
@@ -120,27 +157,6 @@ static void lpc313x_pcm_dma_irq(int ch, dma_irq_type_t dtype, void *handle) {
 	/* Tell audio system more buffer space is available */
 	snd_pcm_period_elapsed(substream);
 }
-
-#if defined (CONFIG_SND_USE_DMA_LINKLIST)
-static void lpc313x_check_dmall(unsigned long data) {
-	struct snd_pcm_substream *substream = (struct snd_pcm_substream *) data;
-	struct snd_pcm_runtime *rtd = substream->runtime;
-	struct lpc313x_dma_data *prtd = rtd->private_data;
-
-	/* Determine buffer position from current DMA position. We don't need
-	   the exact address, just the last finished period */
-	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
-		mod_timer(&prtd->timer[0], jiffies + MINTICKINC);
-		prtd->dma_cur = (dma_addr_t) DMACH_SRC_ADDR(prtd->dmach - 1);
-	}
-	else {
-		mod_timer(&prtd->timer[1], jiffies + MINTICKINC);
-		prtd->dma_cur = (dma_addr_t) DMACH_DST_ADDR(prtd->dmach - 1);
-	}
-
-	/* Tell audio system more buffer space is available */
-	snd_pcm_period_elapsed(substream);
-}
 #endif
 
 static int lpc313x_pcm_allocate_dma_buffer(struct snd_pcm *pcm, int stream)
@@ -197,19 +213,18 @@ static int lpc313x_pcm_hw_free(struct snd_pcm_substream *substream)
 	struct lpc313x_dma_data *prtd = substream->runtime->private_data;
 
 	/* Return the DMA channel */
-	if (prtd->dmach != -1) {
 #if defined (CONFIG_SND_USE_DMA_LINKLIST)
-		dma_release_sg_channel(prtd->dmach);
-
-		/* Return the linked list area */
-		dma_free_coherent(substream->pcm->card->dev,
-			DMA_LIST_SIZE, prtd->p_sg_cpu, (dma_addr_t)prtd->p_sg_dma);
+	if (prtd->chan) {
+		lpc313x_dma_cyclic_free(prtd->chan);
+		dma_release_channel(prtd->chan);
+		prtd->chan = NULL;
+	}
 #else
-		dma_release_channel((unsigned int) prtd->dmach);
-#endif
-
+	if (prtd->dmach != -1) {
+		lpc313x_dma_release_channel((unsigned int) prtd->dmach);
 		prtd->dmach = -1;
 	}
+#endif
 
 	return 0;
 }
@@ -218,62 +233,73 @@ static int lpc313x_pcm_prepare(struct snd_pcm_substream *substream)
 {
 	struct lpc313x_dma_data *prtd = substream->runtime->private_data;
 
+#if defined (CONFIG_SND_USE_DMA_LINKLIST)
+	struct lpc313x_dma_cyclic *cdesc;
+	enum dma_data_direction dir;
+	dma_cap_mask_t mask;
+
 	/* Setup DMA channel */
-	if (prtd->dmach == -1) {
+	if (!prtd->chan) {
+		prtd->slave.width = DMA_TRANSFER_WORD;
 		if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
-#if defined (CONFIG_SND_USE_DMA_LINKLIST)
-			prtd->dmach = dma_request_sg_channel("I2STX",
-				lpc313x_pcm_dma_irq, substream, 0, 0, 0);
-			prtd->dma_cfg_base = DMA_CFG_TX_WORD |
-				DMA_CFG_RD_SLV_NR(0) | DMA_CFG_CMP_CH_EN |
-				DMA_CFG_WR_SLV_NR(TX_DMA_CHCFG) |
-				DMA_CFG_CMP_CH_NR(prtd->dmach);
+			prtd->slave.tx_reg = TX_FIFO_ADDR;
+			prtd->slave.slave_nr = TX_DMA_CHCFG;
+		}
+		else {
+			prtd->slave.rx_reg = RX_FIFO_ADDR;
+			prtd->slave.slave_nr = RX_DMA_CHCFG;
+		}
 
+		dma_cap_zero(mask);
+		dma_cap_set(DMA_SLAVE, mask);
+		prtd->chan = dma_request_channel(mask, lpc313x_pcm_dma_filter,
+			&prtd->slave);
+		if (!prtd->chan) {
+			pr_err("Error allocating DMA channel\n");
+			return -EBUSY;
+		}
+	}
+
+	/* (Re)build the ring for the current parameters, the stream is
+	   stopped here */
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		dir = DMA_TO_DEVICE;
+	else
+		dir = DMA_FROM_DEVICE;
+
+	lpc313x_dma_cyclic_free(prtd->chan);
+	cdesc = lpc313x_dma_cyclic_prep(prtd->chan, prtd->dma_buffer,
+		prtd->num_periods * prtd->period_size, prtd->period_size, dir);
+	if (IS_ERR(cdesc)) {
+		pr_err("Error preparing DMA ring\n");
+		return PTR_ERR(cdesc);
+	}
+	cdesc->period_callback = lpc313x_pcm_dma_period;
+	cdesc->period_callback_param = substream;
 #else
-			prtd->dmach = dma_request_channel("I2STX",
+	/* Setup DMA channel */
+	if (prtd->dmach == -1) {
+		if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+			prtd->dmach = lpc313x_dma_request_channel("I2STX",
 				lpc313x_pcm_dma_irq, substream);
 			prtd->dma_cfg_base = DMA_CFG_TX_WORD |
 				DMA_CFG_RD_SLV_NR(0) | DMA_CFG_CIRC_BUF |
 				DMA_CFG_WR_SLV_NR(TX_DMA_CHCFG);
-#endif
 		}
 		else {
-#if defined (CONFIG_SND_USE_DMA_LINKLIST)
-			prtd->dmach = dma_request_sg_channel("I2SRX",
-				lpc313x_pcm_dma_irq, substream, 0, 0, 0);
-			prtd->dma_cfg_base = DMA_CFG_TX_WORD |
-				DMA_CFG_WR_SLV_NR(0) | DMA_CFG_CMP_CH_EN |
-				DMA_CFG_RD_SLV_NR(RX_DMA_CHCFG) |
-				DMA_CFG_CMP_CH_NR(prtd->dmach);
-
-#else
-			prtd->dmach = dma_request_channel("I2SRX",
+			prtd->dmach = lpc313x_dma_request_channel("I2SRX",
 				lpc313x_pcm_dma_irq, substream);
 			prtd->dma_cfg_base = DMA_CFG_TX_WORD |
 				DMA_CFG_WR_SLV_NR(0) | DMA_CFG_CIRC_BUF |
 				DMA_CFG_RD_SLV_NR(RX_DMA_CHCFG);
-#endif
 		}
 
 		if (prtd->dmach < 0) {
 			pr_err("Error allocating DMA channel\n");
 			return prtd->dmach;
 		}
-
-#if defined (CONFIG_SND_USE_DMA_LINKLIST)
-		/* Allocate space for a DMA linked list */
-		prtd->p_sg_cpu = (dma_sg_ll_t *) dma_alloc_coherent(
-			substream->pcm->card->dev, DMA_LIST_SIZE,
-			(dma_addr_t *) &prtd->p_sg_dma, GFP_KERNEL);
-
-		if (prtd->p_sg_cpu == NULL) {
-			pr_err("Error allocating DMA sg list\n");
-			dma_release_sg_channel(prtd->dmach);
-			prtd->dmach = -1;
-			return -ENOMEM;
-		}
-#endif
 	}
+#endif
 
 	return 0;
 }
@@ -287,61 +313,18 @@ static int lpc313x_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 	int ret = 0;
 
 #if defined (CONFIG_SND_USE_DMA_LINKLIST)
-	int i, tch;
-	u32 addr;
-	dma_sg_ll_t *p_sg_cpuw, *p_sg_dmaw;
-	unsigned long timeout;
-
-	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
-		tch = 0;
-	}
-	else {
-		tch = 1;
-	}
-
 	switch (cmd) {
 	case SNDRV_PCM_TRIGGER_START:
 		prtd->dma_cur = prtd->dma_buffer;
-		p_sg_cpuw = prtd->p_sg_cpu;
-		p_sg_dmaw = prtd->p_sg_dma;
-
-		/* Build a linked list that wraps around */
-		addr = (u32) prtd->dma_buffer;
-		for (i = 0; i < prtd->num_periods; i++) {
-			p_sg_cpuw->setup.trans_length = (prtd->period_size / 4) - 1;
-			p_sg_cpuw->setup.cfg = prtd->dma_cfg_base;
-			p_sg_cpuw->next_entry = (u32) (p_sg_dmaw + 1);
-
-			if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
-				p_sg_cpuw->setup.src_address = addr;
-				p_sg_cpuw->setup.dest_address = TX_FIFO_ADDR;
-			}
-			else {
-				p_sg_cpuw->setup.dest_address = addr;
-				p_sg_cpuw->setup.src_address = RX_FIFO_ADDR;
-			}
-
-			/* Wrap end of list back to start? */
-			if (i == (prtd->num_periods - 1))
-				p_sg_cpuw->next_entry = (u32) prtd->p_sg_dma;
-
-			p_sg_cpuw++;
-			p_sg_dmaw++;
-			addr += prtd->period_size;
-		}
-
-		/* Add and start audio data position timer */
-		init_timer(&prtd->timer[tch]);
-		prtd->timer[tch].data = (unsigned long) substream;
-		prtd->timer[tch].function = lpc313x_check_dmall;
-		prtd->timer[tch].expires = jiffies + MINTICKINC;
-		add_timer(&prtd->timer[tch]);
+		ret = lpc313x_dma_cyclic_start(prtd->chan);
+		break;
 
-		/* Program DMA channel and start it */
-		dma_prog_sg_channel(prtd->dmach, (u32) prtd->p_sg_dma);
-		dma_set_irq_mask(prtd->dmach, 1, 1);
+	case SNDRV_PCM_TRIGGER_STOP:
+		lpc313x_dma_cyclic_stop(prtd->chan);
+		break;
 #else
 	dma_setup_t dmasetup;
+	unsigned long timeout;
 
 	switch (cmd) {
 	case SNDRV_PCM_TRIGGER_START:
@@ -362,14 +345,10 @@ static int lpc313x_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 		/* Program DMA channel and start it */
 		dma_prog_channel(prtd->dmach, &dmasetup);
 		dma_set_irq_mask(prtd->dmach, 0, 0);
-#endif
 		dma_start_channel(prtd->dmach);
 		break;
 
 	case SNDRV_PCM_TRIGGER_STOP:
-#if defined (CONFIG_SND_USE_DMA_LINKLIST)
-		del_timer_sync(&prtd->timer[tch]);
-#endif
 		/* Stop the companion channel and let the current DMA
 		   transfer finish */
 		dma_stop_channel_sg(prtd->dmach);
@@ -425,13 +404,23 @@ static int lpc313x_pcm_open(struct snd_pcm_substream *substream)
 	if (ret < 0)
 		goto out;
 
+#if defined (CONFIG_SND_USE_DMA_LINKLIST)
+	/* each period is one linked list entry of whole words */
+	ret = snd_pcm_hw_constraint_step(runtime, 0,
+		SNDRV_PCM_HW_PARAM_PERIOD_BYTES, 4);
+	if (ret < 0)
+		goto out;
+#endif
+
 	prtd = kzalloc(sizeof(*prtd), GFP_KERNEL);
 	if (prtd == NULL) {
 		ret = -ENOMEM;
 		goto out;
 	}
 	runtime->private_data = prtd;
+#if !defined (CONFIG_SND_USE_DMA_LINKLIST)
 	prtd->dmach = -1;
+#endif
 
 out:
 	return ret;